@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// a bounded lock-free queue after Dmitry Vyukov, safe for many producers and consumers
+// elements are filled and consumed in place, so whatever buffers they own are reused
+struct BoundedQueueBase
+{
+    static constexpr size_t CACHE_LINE = 64;
+
+    static size_t roundUp(size_t capacity); // to a power of two
+};
+
+template <typename T> struct BoundedQueue
+{
+public:
+    BoundedQueue(size_t capacity);
+    BoundedQueue(BoundedQueue &&) = delete;
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue & operator=(BoundedQueue &&) = delete;
+    BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+public:
+    template <typename Fill> bool push(Fill && fill);          // calls fill(T &), false if the queue is full
+    template <typename Consume> bool pop(Consume && consume);  // calls consume(T &), false if the queue is empty
+    size_t size() const;                                       // only a snapshot while others are working on it
+    size_t capacity() const;
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_m;
+    size_t mask_m;
+    alignas(BoundedQueueBase::CACHE_LINE) std::atomic<size_t> tail_m; // next position to push to
+    alignas(BoundedQueueBase::CACHE_LINE) std::atomic<size_t> head_m; // next position to pop from
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline size_t BoundedQueueBase::roundUp(size_t capacity)
+{
+    size_t rounded = 1;
+    while (rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+    : cells_m(new Cell[BoundedQueueBase::roundUp(capacity)]),
+      mask_m(BoundedQueueBase::roundUp(capacity) - 1),
+      tail_m(0),
+      head_m(0)
+{
+    for (size_t i = 0; i <= mask_m; i++)
+    {
+        cells_m[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+// a cell whose sequence equals the position is free, position + 1 means it holds an element
+template <typename T> template <typename Fill> bool BoundedQueue<T>::push(Fill && fill)
+{
+    size_t position = tail_m.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell & cell = cells_m[position & mask_m];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0)
+        {
+            if (tail_m.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                fill(cell.value);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = tail_m.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T> template <typename Consume> bool BoundedQueue<T>::pop(Consume && consume)
+{
+    size_t position = head_m.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell & cell = cells_m[position & mask_m];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+        if (difference == 0)
+        {
+            if (head_m.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                consume(cell.value);
+                cell.sequence.store(position + mask_m + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = head_m.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T> size_t BoundedQueue<T>::size() const
+{
+    size_t tail = tail_m.load(std::memory_order_acquire);
+    size_t head = head_m.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+template <typename T> size_t BoundedQueue<T>::capacity() const
+{
+    return mask_m + 1;
+}
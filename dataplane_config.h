@@ -0,0 +1,267 @@
+#pragma once
+
+#include "settings.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// where the network threads take their frames from
+enum class RxBackend
+{
+    Sniffer,    // libtins/libpcap, decodes every frame into a PDU chain
+    PacketMmap, // PACKET_MMAP TPACKET_V3 ring shared with the kernel
+    Xdp,        // AF_XDP sockets sharing one UMEM, forwarding between them moves descriptors
+};
+
+// how the egress sockets hand a batch of frames to the kernel
+enum class TxMode
+{
+    SendMmsg, // one sendmmsg() call per batch
+    TxRing,   // PACKET_TX_RING, one send() kick per batch
+};
+
+// one class of the egress scheduler of a port
+// strict classes are served in order before any weighted one, the rest share what is left by weight
+struct EgressClassConfig
+{
+    bool strict;
+    uint32_t weight; // frames per weighted round robin turn, ignored for strict classes
+};
+
+struct TxConfig
+{
+    TxConfig();
+    TxMode mode;
+    bool qdiscBypass;        // PACKET_QDISC_BYPASS, skips the traffic control layer
+    uint32_t batchSize;      // the most frames a TX thread takes off its queue before flushing
+    uint32_t queueSize;      // frames in each egress queue of a port, rounded up to a power of two
+    std::vector<EgressClassConfig> classes;
+    std::array<uint8_t, 8> pcpClass;   // the class of each 802.1p priority of a tagged frame
+    std::array<uint8_t, 64> dscpClass; // the class of each DSCP of an untagged IP packet
+    uint32_t ringFrameSize;  // bytes, a power of two, larger frames are dropped in TxRing mode
+    uint32_t ringFrameCount;
+    bool vnetHeader;         // PACKET_VNET_HDR, every frame is preceded by a virtio_net_hdr
+};
+
+// geometry of the TPACKET_V3 ring, every port gets its own ring
+struct RingConfig
+{
+    RingConfig();
+    uint32_t blockSize;       // bytes, a power of two multiple of the page size
+    uint32_t blockCount;
+    uint32_t frameSize;       // bytes, only used to size the ring, frames are variable length
+    milliseconds blockTimeout; // a partially filled block is handed over after this
+    bool vnetHeader;           // PACKET_VNET_HDR, GSO super-frames arrive whole with their virtio_net_hdr
+};
+
+// the AF_XDP sockets of all ports share one UMEM
+struct XdpConfig
+{
+    XdpConfig();
+    bool skbMode;        // generic XDP in copy mode, works on any driver including veth
+    uint32_t frameSize;  // bytes per UMEM frame, 2048 or 4096
+    uint32_t frameCount; // frames in the UMEM shared by all ports
+    uint32_t ringSize;   // descriptors per RX, TX, fill and completion ring, a power of two
+    bool fastPath;       // switches known unicast in the kernel, see xdp_fastpath.bpf.c
+};
+
+// the frames copied out of the RX rings, shared by the egress queues of every port
+struct FramePoolConfig
+{
+    FramePoolConfig();
+    uint32_t frameSize;  // bytes, larger frames such as GSO super-frames are copied to the heap instead
+    uint32_t frameCount;
+    bool hugePages;      // MAP_HUGETLB, falls back to transparent huge pages if none are reserved
+};
+
+// how a port treats 802.1Q tags
+enum class VlanMode
+{
+    Access, // untagged frames only, all of them in the port VLAN
+    Trunk,  // the allowed VLANs go tagged, untagged frames belong to the port VLAN, the native one
+};
+
+// the VLAN membership of one port
+struct VlanPortConfig
+{
+    VlanPortConfig();
+    VlanMode mode;
+    uint16_t pvid;                 // untagged frames belong to it and leave it untagged
+    std::vector<uint16_t> allowed; // trunk ports only, the VLANs tagged frames may belong to
+};
+
+// a static link aggregation group, its members act as one port
+// the VLANs of the members are configured under the name of the group
+struct LagConfig
+{
+    std::string name;
+    std::vector<std::string> members; // interface names, ports of the switch
+};
+
+// the parts of the low latency profile, every one of them is off by default
+// each RX and TX thread logs which of them are active once it has started
+struct LatencyConfig
+{
+    LatencyConfig();
+    bool busyPoll;         // the RX and TX threads spin instead of sleeping in poll()
+    uint32_t busyPollTime; // SO_BUSY_POLL in microseconds, the kernel polls the driver on receive, 0 leaves it off
+    bool lockMemory;       // mlockall, everything mapped later is populated right away, no page faults on the data path
+    bool realtime;         // SCHED_FIFO for the RX and TX threads, needs CAP_SYS_NICE
+    int realtimePriority;
+};
+
+// configuration for the network threads, passed to NetworkSwitch::startNetwork
+struct DataplaneConfig
+{
+    DataplaneConfig();
+    RxBackend rxBackend;
+    std::map<std::string, RxBackend> portBackends; // per interface name, overrides rxBackend
+    uint32_t rxWorkers;         // per port, joined into a PACKET_FANOUT group, 0 means one per RX queue
+    std::vector<int> rxCpus;    // the workers are pinned to these in order, port after port
+    std::vector<int> txCpus;    // the TX threads are pinned to these in order, one per port
+    uint32_t burstSize;         // frames switched under one lock of the shared storage, up to MAX_BURST_SIZE
+    bool gsoPassthrough;        // forwards GSO super-frames unsegmented, PACKET_MMAP backend only
+    bool protocolStatistics;    // classifies frames past the Ethernet header to count ARP, IP, TCP...
+    bool multicastSnooping;     // IGMP and MLD, a group joined by hosts only goes to its members and the routers
+    bool neighborSuppression;   // ARP and neighbor solicitations for known hosts are answered by the switch
+    std::map<std::string, VlanPortConfig> vlans; // per interface name, the rest are access ports of DEFAULT_VLAN
+    std::vector<LagConfig> lags; // up to MAX_LAGS, a port can only be in one
+    RingConfig ring;
+    TxConfig tx;
+    XdpConfig xdp;
+    FramePoolConfig pool;
+    LatencyConfig latency;
+
+public:
+    RxBackend backendFor(const std::string & interfaceName) const;
+    VlanPortConfig vlansFor(const std::string & interfaceName) const; // of its LAG if it is in one
+    const LagConfig *lagFor(const std::string & interfaceName) const; // nullptr if it isn't in a LAG
+
+    // every part of the low latency profile except SCHED_FIFO, which can lock up a machine with too few cores
+    static DataplaneConfig lowLatency(const std::vector<int> & rxCpus, const std::vector<int> & txCpus);
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline RingConfig::RingConfig()
+    : blockSize(DEFAULT_RING_BLOCK_SIZE),
+      blockCount(DEFAULT_RING_BLOCK_COUNT),
+      frameSize(DEFAULT_RING_FRAME_SIZE),
+      blockTimeout(DEFAULT_RING_BLOCK_TIMEOUT),
+      vnetHeader(false)
+{
+}
+
+inline TxConfig::TxConfig()
+    : mode(TxMode::SendMmsg),
+      qdiscBypass(false),
+      batchSize(DEFAULT_TX_BATCH_SIZE),
+      queueSize(DEFAULT_TX_QUEUE_SIZE),
+      classes{{true, 1}, {false, 4}, {false, 2}, {false, 1}},
+      pcpClass{2, 3, 3, 2, 1, 0, 0, 0},
+      dscpClass{},
+      ringFrameSize(DEFAULT_TX_RING_FRAME_SIZE),
+      ringFrameCount(DEFAULT_TX_RING_FRAME_COUNT),
+      vnetHeader(false)
+{
+    // voice and network control are strict, the rest goes by the IP precedence, like 802.1p does
+    for (uint32_t dscp = 0; dscp < dscpClass.size(); dscp++)
+    {
+        dscpClass[dscp] = pcpClass[dscp >> 3];
+    }
+}
+
+inline XdpConfig::XdpConfig()
+    : skbMode(false),
+      frameSize(DEFAULT_XDP_FRAME_SIZE),
+      frameCount(DEFAULT_XDP_FRAME_COUNT),
+      ringSize(DEFAULT_XDP_RING_SIZE),
+      fastPath(false)
+{
+}
+
+inline FramePoolConfig::FramePoolConfig()
+    : frameSize(DEFAULT_POOL_FRAME_SIZE),
+      frameCount(DEFAULT_POOL_FRAME_COUNT),
+      hugePages(true)
+{
+}
+
+inline VlanPortConfig::VlanPortConfig()
+    : mode(VlanMode::Access),
+      pvid(DEFAULT_VLAN),
+      allowed{}
+{
+}
+
+inline LatencyConfig::LatencyConfig()
+    : busyPoll(false),
+      busyPollTime(0),
+      lockMemory(false),
+      realtime(false),
+      realtimePriority(DEFAULT_REALTIME_PRIORITY)
+{
+}
+
+inline DataplaneConfig::DataplaneConfig()
+    : rxBackend(RxBackend::PacketMmap),
+      portBackends{},
+      rxWorkers(DEFAULT_RX_WORKERS),
+      rxCpus{},
+      txCpus{},
+      burstSize(DEFAULT_BURST_SIZE),
+      gsoPassthrough(false),
+      protocolStatistics(true),
+      multicastSnooping(true),
+      neighborSuppression(true),
+      vlans{},
+      lags{},
+      ring{},
+      tx{},
+      xdp{},
+      pool{},
+      latency{}
+{
+}
+
+inline RxBackend DataplaneConfig::backendFor(const std::string & interfaceName) const
+{
+    auto it = portBackends.find(interfaceName);
+    return it == portBackends.end() ? rxBackend : it->second;
+}
+
+inline VlanPortConfig DataplaneConfig::vlansFor(const std::string & interfaceName) const
+{
+    const LagConfig *lag = lagFor(interfaceName);
+    auto it = vlans.find(lag == nullptr ? interfaceName : lag->name);
+    return it == vlans.end() ? VlanPortConfig() : it->second;
+}
+
+inline const LagConfig *DataplaneConfig::lagFor(const std::string & interfaceName) const
+{
+    for (const auto & lag : lags)
+    {
+        if (std::find(lag.members.begin(), lag.members.end(), interfaceName) != lag.members.end())
+        {
+            return &lag;
+        }
+    }
+    return nullptr;
+}
+
+inline DataplaneConfig DataplaneConfig::lowLatency(const std::vector<int> & rxCpus, const std::vector<int> & txCpus)
+{
+    DataplaneConfig config;
+    config.rxCpus = rxCpus;
+    config.txCpus = txCpus;
+    config.ring.blockTimeout = LOW_LATENCY_BLOCK_TIMEOUT; // a spinning worker still waits for the block to retire
+    config.latency.busyPoll = true;
+    config.latency.busyPollTime = DEFAULT_BUSY_POLL_TIME;
+    config.latency.lockMemory = true;
+    return config;
+}
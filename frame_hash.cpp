@@ -0,0 +1,186 @@
+#include "frame_hash.h"
+#include <cstring>
+
+#ifdef __x86_64__
+#include <nmmintrin.h>
+#endif
+
+// odd constants without a pattern, the fractional digits of pi
+static constexpr uint64_t SECRETS[5] = {
+    0x243f6a8885a308d3,
+    0x13198a2e03707344,
+    0xa4093822299f31d0,
+    0x082efa98ec4e6c89,
+    0x452821e638d01377,
+};
+
+static inline uint64_t read64(const uint8_t *data)
+{
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+static inline uint16_t read16(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+// the last 1 to 7 bytes, padded with zeros
+static inline uint64_t readTail(const uint8_t *data, size_t size)
+{
+    uint64_t word = 0;
+    std::memcpy(&word, data, size);
+    return word;
+}
+
+// the full 128 bit product folded into 64 bits, every input bit reaches every output bit
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+    uint64_t high = (a >> 32) * (b >> 32) + (((a >> 32) * (b & 0xffffffff)) >> 32) +
+                    (((a & 0xffffffff) * (b >> 32)) >> 32);
+    return (a * b) ^ high;
+#endif
+}
+
+// four independent lanes of 8 bytes, 32 bytes a step, so the multiplies overlap
+uint64_t frameHashPortable(const uint8_t *data, size_t size)
+{
+    uint64_t seed = SECRETS[4] ^ mix(size, SECRETS[0]);
+    uint64_t lanes[4] = {seed, seed ^ SECRETS[1], seed ^ SECRETS[2], seed ^ SECRETS[3]};
+    const uint8_t *end = data + size;
+    for (; end - data >= 32; data += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            lanes[lane] = mix(read64(data + 8 * lane) ^ SECRETS[lane], lanes[lane] ^ SECRETS[4]);
+        }
+    }
+    for (int lane = 0; end - data >= 8; data += 8, lane++)
+    {
+        lanes[lane] = mix(read64(data) ^ SECRETS[lane], lanes[lane] ^ SECRETS[4]);
+    }
+    if (data != end)
+    {
+        lanes[3] = mix(readTail(data, end - data) ^ SECRETS[3], lanes[3] ^ SECRETS[0]);
+    }
+
+    uint64_t hash = mix(lanes[0] ^ lanes[1], lanes[2] ^ lanes[3] ^ SECRETS[1]);
+    return mix(hash ^ SECRETS[2], size ^ SECRETS[3]);
+}
+
+#ifdef __x86_64__
+// three CRC chains of 8 bytes, 24 bytes a step, the instruction has a latency of three and issues every cycle
+// a CRC is linear, the chains are folded together with a multiply
+__attribute__((target("sse4.2"))) uint64_t frameHashCrc32c(const uint8_t *data, size_t size)
+{
+    uint64_t a = SECRETS[0] ^ size;
+    uint64_t b = SECRETS[1];
+    uint64_t c = SECRETS[2];
+    const uint8_t *end = data + size;
+    for (; end - data >= 24; data += 24)
+    {
+        a = _mm_crc32_u64(a, read64(data));
+        b = _mm_crc32_u64(b, read64(data + 8));
+        c = _mm_crc32_u64(c, read64(data + 16));
+    }
+    for (; end - data >= 8; data += 8)
+    {
+        a = _mm_crc32_u64(a, read64(data));
+    }
+    if (data != end)
+    {
+        b = _mm_crc32_u64(b, readTail(data, end - data));
+    }
+
+    uint64_t hash = mix((a << 32 | b) ^ SECRETS[3], (c << 32 | c) ^ SECRETS[4]);
+    return mix(hash ^ SECRETS[1], size ^ SECRETS[2]);
+}
+
+using FrameHashFunction = uint64_t (*)(const uint8_t *, size_t);
+
+// an ifunc resolver, run by the loader before any other code, so the CPU features are read here once
+extern "C" FrameHashFunction resolveFrameHash()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") ? frameHashCrc32c : frameHashPortable;
+}
+
+uint64_t frameHash(const uint8_t *data, size_t size) __attribute__((ifunc("resolveFrameHash")));
+
+const char *frameHashKernel()
+{
+    return resolveFrameHash() == frameHashCrc32c ? "crc32c" : "portable";
+}
+#else
+uint64_t frameHash(const uint8_t *data, size_t size)
+{
+    return frameHashPortable(data, size);
+}
+
+const char *frameHashKernel()
+{
+    return "portable";
+}
+#endif
+
+// the fields are gathered into one key past any VLAN tags, which differ between the ports of a flow
+// and may have been stripped by the kernel, the VLAN the frame was admitted to goes into the key instead
+// fragments leave the ports out, a non-first one doesn't carry them, IPv6 extension headers aren't walked
+uint64_t flowHash(const uint8_t *frame, size_t size, uint16_t vlan)
+{
+    static constexpr size_t MAC_BYTES = 12;
+    if (size < MAC_BYTES + 2)
+    {
+        return frameHash(frame, size) ^ vlan;
+    }
+
+    uint8_t key[MAC_BYTES + 2 + 2 + 32 + 1 + 4];
+    std::memcpy(key, frame, MAC_BYTES);
+    key[MAC_BYTES] = vlan >> 8;
+    key[MAC_BYTES + 1] = vlan & 0xff;
+    size_t offset = MAC_BYTES;
+    uint16_t etherType = read16(frame + offset);
+    while ((etherType == 0x8100 || etherType == 0x88a8) && offset + 6 <= size)
+    {
+        offset += 4;
+        etherType = read16(frame + offset);
+    }
+    offset += 2;
+    key[MAC_BYTES + 2] = etherType >> 8;
+    key[MAC_BYTES + 3] = etherType & 0xff;
+    size_t used = MAC_BYTES + 4;
+
+    uint8_t protocol = 0;
+    size_t transport = 0;
+    if (etherType == 0x0800 && size >= offset + 20)
+    {
+        std::memcpy(key + used, frame + offset + 12, 8);
+        used += 8;
+        protocol = frame[offset + 9];
+        transport = (read16(frame + offset + 6) & 0x3fff) == 0 ? offset + (frame[offset] & 0x0f) * 4 : 0;
+    }
+    else if (etherType == 0x86dd && size >= offset + 40)
+    {
+        std::memcpy(key + used, frame + offset + 8, 32);
+        used += 32;
+        protocol = frame[offset + 6];
+        transport = offset + 40;
+    }
+    else
+    {
+        return frameHash(key, used);
+    }
+
+    key[used++] = protocol;
+    if ((protocol == 6 || protocol == 17) && transport != 0 && size >= transport + 4)
+    {
+        std::memcpy(key + used, frame + transport, 4);
+        used += 4;
+    }
+    return frameHash(key, used);
+}
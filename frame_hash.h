@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit hashes of whole frames, for hash tables of frames
+// the kernel is picked once when the program is loaded: CRC32C on CPUs with SSE4.2,
+// a portable multiply and fold over 64 bit words everywhere else
+// the two kernels give different hashes, so a hash must never leave the process
+
+uint64_t frameHash(const uint8_t *data, size_t size);
+const char *frameHashKernel(); // the name of the kernel frameHash() uses
+
+// a hash of the VLAN, the addresses, the IP protocol and the TCP or UDP ports of an Ethernet frame,
+// whichever it has, every frame of a flow gets the same one, the fragments of a datagram too
+uint64_t flowHash(const uint8_t *frame, size_t size, uint16_t vlan);
+
+// the kernels themselves, for comparing them
+uint64_t frameHashPortable(const uint8_t *data, size_t size);
+#ifdef __x86_64__
+uint64_t frameHashCrc32c(const uint8_t *data, size_t size); // only on CPUs with SSE4.2
+#endif
@@ -0,0 +1,183 @@
+#include "frame_pool.h"
+#include <cerrno>
+#include <cstring>
+#include <qlogging.h>
+#include <stdexcept>
+#include <sys/mman.h>
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+// the free handles of one thread, given back to their pool when the thread exits
+struct FrameCache
+{
+    FramePool *owner; // the first pool the thread used, zero initialized
+    vector<uint32_t> frames;
+
+    ~FrameCache()
+    {
+        if (owner != nullptr)
+        {
+            owner->spill(frames, frames.size());
+        }
+    }
+};
+
+static thread_local FrameCache cache;
+
+FramePool::FramePool(const FramePoolConfig & config)
+    : config_m(config),
+      area_m(nullptr),
+      size_m(static_cast<size_t>(config.frameSize) * config.frameCount),
+      hugePages_m(false),
+      references_m(new std::atomic<uint32_t>[config.frameCount]),
+      lock_m{},
+      free_m{},
+      peak_m(0),
+      exhaustions_m(0),
+      oversize_m(0)
+{
+    // the whole pool is populated up front, the data path never takes a page fault on it
+    size_m = (size_m + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *area = MAP_FAILED;
+    if (config_m.hugePages)
+    {
+        area = mmap(nullptr, size_m, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                    -1, 0);
+        hugePages_m = area != MAP_FAILED;
+        if (!hugePages_m)
+        {
+            qInfo("No huge pages reserved for the frame pool, using transparent huge pages: %s", std::strerror(errno));
+        }
+    }
+    if (area == MAP_FAILED)
+    {
+        area = mmap(nullptr, size_m, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area == MAP_FAILED)
+        {
+            throw std::runtime_error(string("Cannot allocate the frame pool: ") + std::strerror(errno));
+        }
+        if (config_m.hugePages)
+        {
+            madvise(area, size_m, MADV_HUGEPAGE);
+        }
+        std::memset(area, 0, size_m);
+    }
+    area_m = static_cast<uint8_t *>(area);
+
+    // handed out from the back, so the first frames go first
+    free_m.reserve(config_m.frameCount);
+    for (uint32_t i = config_m.frameCount; i > 0; i--)
+    {
+        free_m.push_back(i - 1);
+        references_m[i - 1].store(0, std::memory_order_relaxed);
+    }
+    qInfo("Frame pool of %u frames of %u bytes (%s)", config_m.frameCount, config_m.frameSize,
+          hugePages_m ? "huge pages" : "regular pages");
+}
+
+FramePool::~FramePool()
+{
+    munmap(area_m, size_m);
+}
+
+uint32_t FramePool::allocate()
+{
+    uint32_t frame = INVALID;
+    if (cached())
+    {
+        if (cache.frames.empty())
+        {
+            refill(cache.frames);
+        }
+        if (!cache.frames.empty())
+        {
+            frame = cache.frames.back();
+            cache.frames.pop_back();
+        }
+    }
+    else
+    {
+        // a thread is only expected to use one pool, any other one goes without the cache
+        std::lock_guard<std::mutex> lock(lock_m);
+        if (!free_m.empty())
+        {
+            frame = free_m.back();
+            free_m.pop_back();
+            peak_m = std::max<uint32_t>(peak_m, config_m.frameCount - free_m.size());
+        }
+    }
+
+    if (frame == INVALID)
+    {
+        exhaustions_m.fetch_add(1, std::memory_order_relaxed);
+        return INVALID;
+    }
+    references_m[frame].store(1, std::memory_order_relaxed);
+    return frame;
+}
+
+void FramePool::release(uint32_t frame)
+{
+    if (references_m[frame].fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    if (!cached())
+    {
+        std::lock_guard<std::mutex> lock(lock_m);
+        free_m.push_back(frame);
+        return;
+    }
+    cache.frames.push_back(frame);
+    if (cache.frames.size() >= 2 * POOL_CACHE_BATCH)
+    {
+        spill(cache.frames, POOL_CACHE_BATCH);
+    }
+}
+
+void FramePool::countOversize()
+{
+    oversize_m.fetch_add(1, std::memory_order_relaxed);
+}
+
+PoolStatistics FramePool::statistics() const
+{
+    std::lock_guard<std::mutex> lock(lock_m);
+    PoolStatistics statistics{};
+    statistics.frames = config_m.frameCount;
+    statistics.frameSize = config_m.frameSize;
+    statistics.inUse = config_m.frameCount - free_m.size();
+    statistics.peak = peak_m;
+    statistics.exhaustions = exhaustions_m.load(std::memory_order_relaxed);
+    statistics.oversize = oversize_m.load(std::memory_order_relaxed);
+    statistics.hugePages = hugePages_m;
+    return statistics;
+}
+
+// binds the cache of the calling thread to this pool on first use
+bool FramePool::cached()
+{
+    if (cache.owner == nullptr)
+    {
+        cache.owner = this;
+        cache.frames.reserve(2 * POOL_CACHE_BATCH);
+    }
+    return cache.owner == this;
+}
+
+void FramePool::refill(vector<uint32_t> & frames)
+{
+    std::lock_guard<std::mutex> lock(lock_m);
+    uint32_t count = std::min<uint32_t>(POOL_CACHE_BATCH, free_m.size());
+    frames.insert(frames.end(), free_m.end() - count, free_m.end());
+    free_m.resize(free_m.size() - count);
+    peak_m = std::max<uint32_t>(peak_m, config_m.frameCount - free_m.size());
+}
+
+void FramePool::spill(vector<uint32_t> & frames, uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(lock_m);
+    free_m.insert(free_m.end(), frames.end() - count, frames.end());
+    frames.resize(frames.size() - count);
+}
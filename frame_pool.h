@@ -0,0 +1,81 @@
+#pragma once
+
+#include "dataplane_config.h"
+#include "packet_ring.h"
+#include "shared_storage.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using std::vector, std::unique_ptr;
+
+// fixed-size frame buffers in one hugepage-backed area, shared by every RX worker and TX thread
+// frames are passed around by handle and reference counted, so a flooded frame is stored once
+// every thread keeps a small cache of free handles and only takes the lock to exchange whole batches
+// every frame has HEADROOM bytes in front of data(), so a VLAN tag can be pushed without moving the payload
+// the pool has to outlive every thread that allocates from or releases to it
+struct FramePool
+{
+public:
+    static constexpr uint32_t INVALID = UINT32_MAX;
+    static constexpr uint32_t HEADROOM = VLAN_TAG_SIZE;
+
+    FramePool(const FramePoolConfig & config);
+    FramePool(FramePool &&) = delete;
+    FramePool(const FramePool &) = delete;
+    FramePool & operator=(FramePool &&) = delete;
+    FramePool & operator=(const FramePool &) = delete;
+    ~FramePool();
+
+public:
+    uint32_t allocate(); // holds one reference, INVALID if the pool is exhausted
+    void retain(uint32_t frame, uint32_t references = 1);
+    void release(uint32_t frame); // the frame goes back to the pool with its last reference
+
+    uint8_t *data(uint32_t frame) const;
+    uint32_t frameSize() const; // what fits behind data()
+    void countOversize(); // a frame didn't fit and went to the heap
+
+    PoolStatistics statistics() const;
+
+private:
+    friend struct FrameCache;
+
+    bool cached();
+    void refill(vector<uint32_t> & cache);
+    void spill(vector<uint32_t> & cache, uint32_t count);
+
+private:
+    FramePoolConfig config_m;
+    uint8_t *area_m;
+    size_t size_m;
+    bool hugePages_m;
+    unique_ptr<std::atomic<uint32_t>[]> references_m;
+
+    mutable std::mutex lock_m;
+    vector<uint32_t> free_m;
+    uint32_t peak_m;
+    std::atomic<int64_t> exhaustions_m;
+    std::atomic<int64_t> oversize_m;
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline uint8_t *FramePool::data(uint32_t frame) const
+{
+    return area_m + static_cast<size_t>(frame) * config_m.frameSize + HEADROOM;
+}
+
+inline uint32_t FramePool::frameSize() const
+{
+    return config_m.frameSize - HEADROOM;
+}
+
+inline void FramePool::retain(uint32_t frame, uint32_t references)
+{
+    references_m[frame].fetch_add(references, std::memory_order_relaxed);
+}
@@ -34,7 +34,7 @@ void InfoTable::refreshUi()
         ui_m->timeoutValue->setEnabled(true);
         ui_m->acceptTimeout->setEnabled(true);
 
-        auto guard = networkSwitch_m.getStorage().guard();
+        auto guard = networkSwitch_m.getStorage().device();
         ui_m->currentTimeout->setText(
             QString("%1")
             .arg(duration_cast<seconds>(guard->deviceInfo.defaultMacTimeout).count())
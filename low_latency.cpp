@@ -0,0 +1,105 @@
+#include "low_latency.h"
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <qlogging.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+LatencyReport::LatencyReport(const string & thread)
+    : thread(thread),
+      cpu(-1),
+      realtime(false),
+      spinning(false),
+      busyPoll(false)
+{
+}
+
+void LatencyReport::log() const
+{
+    string pinning = cpu < 0 ? "inactive" : "active (CPU " + std::to_string(cpu) + ")";
+    qInfo("%s: pinning %s, spinning %s, SO_BUSY_POLL %s, SCHED_FIFO %s", thread.c_str(), pinning.c_str(),
+          spinning ? "active" : "inactive", busyPoll ? "active" : "inactive", realtime ? "active" : "inactive");
+}
+
+LatencyReport tuneThread(const string & name, const LatencyConfig & config, int cpu)
+{
+    LatencyReport report(name);
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (result == 0)
+        {
+            report.cpu = cpu;
+        }
+        else
+        {
+            qWarning("Cannot pin %s to CPU %d: %s", name.c_str(), cpu, std::strerror(result));
+        }
+    }
+
+    if (config.realtime)
+    {
+        sched_param parameters{};
+        parameters.sched_priority = config.realtimePriority;
+        int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+        if (result == 0)
+        {
+            report.realtime = true;
+        }
+        else
+        {
+            qWarning("Cannot give %s SCHED_FIFO priority %d: %s", name.c_str(), config.realtimePriority,
+                     std::strerror(result));
+        }
+    }
+
+    report.spinning = config.busyPoll;
+    return report;
+}
+
+bool enableBusyPoll(int fd, const LatencyConfig & config)
+{
+    if (config.busyPollTime == 0)
+    {
+        return false;
+    }
+
+    int time = config.busyPollTime;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &time, sizeof(time)) < 0)
+    {
+        qWarning("Cannot enable SO_BUSY_POLL: %s", std::strerror(errno));
+        return false;
+    }
+
+    // keeps the softirq from taking the queue back while the thread polls it, since Linux 5.11
+#ifdef SO_PREFER_BUSY_POLL
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0)
+    {
+        qDebug("SO_PREFER_BUSY_POLL is not available: %s", std::strerror(errno));
+    }
+#endif
+    return true;
+}
+
+bool lockMemory(const LatencyConfig & config)
+{
+    if (!config.lockMemory)
+    {
+        munlockall();
+        return false;
+    }
+
+    // MCL_FUTURE also populates every ring and buffer mapped from now on
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        qWarning("Cannot lock the memory of the switch: %s", std::strerror(errno));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "dataplane_config.h"
+#include <string>
+
+using std::string;
+
+// what one RX or TX thread managed to apply of the low latency profile
+struct LatencyReport
+{
+    LatencyReport(const string & thread);
+    string thread;
+    int cpu;       // -1 if the thread isn't pinned
+    bool realtime;
+    bool spinning;
+    bool busyPoll; // SO_BUSY_POLL was accepted
+
+    void log() const; // one line, every part either active or inactive
+};
+
+// pins the calling thread to cpu, unless it is negative, and gives it SCHED_FIFO if asked to
+LatencyReport tuneThread(const string & name, const LatencyConfig & config, int cpu);
+
+// SO_BUSY_POLL and SO_PREFER_BUSY_POLL on a receiving socket, false if it is off or the kernel refuses
+bool enableBusyPoll(int fd, const LatencyConfig & config);
+
+// mlockall for the whole process, or munlockall if the profile doesn't ask for it
+// returns whether the memory is locked
+bool lockMemory(const LatencyConfig & config);
@@ -0,0 +1,273 @@
+#include "mac_table.h"
+
+// sized for at most 7 entries out of 8 slots, the table never grows
+MacTable::MacTable(uint32_t capacity)
+    : buckets_m(nullptr),
+      mask_m(0),
+      capacity_m(capacity),
+      size_m(0),
+      overflows_m(0),
+      lastSweep_m(steady_clock::now()),
+      writer_m{}
+{
+    size_t buckets = 1;
+    while (buckets * SLOTS * 7 < static_cast<size_t>(capacity_m) * 8)
+    {
+        buckets <<= 1;
+    }
+    buckets_m.reset(new Bucket[buckets]());
+    mask_m = buckets - 1;
+}
+
+// a seqlock per bucket, entries never move between buckets, so every bucket is checked on its own
+bool MacTable::find(uint64_t key, size_t & bucket, uint32_t & slot, uint64_t & entry, uint32_t & port) const
+{
+    uint64_t hashed = hash(key);
+    uint8_t wanted = tag(hashed);
+    for (size_t probe = 0; probe <= mask_m; probe++)
+    {
+        bucket = (hashed + probe) & mask_m;
+        const auto & candidate = buckets_m[bucket];
+        bool found = false;
+        uint64_t tags = 0;
+        while (true)
+        {
+            uint16_t sequence = candidate.sequence.load(std::memory_order_acquire);
+            if (sequence % 2 != 0)
+            {
+                spinPause();
+                continue;
+            }
+
+            found = false;
+            tags = candidate.tags.load(std::memory_order_relaxed);
+            for (uint32_t matches = match(tags, wanted); matches != 0; matches &= matches - 1)
+            {
+                slot = __builtin_ctz(matches);
+                entry = candidate.slots[slot].load(std::memory_order_relaxed);
+                if ((entry & KEY_MASK) == key)
+                {
+                    port = candidate.ports[slot].load(std::memory_order_relaxed);
+                    found = true;
+                    break;
+                }
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (candidate.sequence.load(std::memory_order_relaxed) == sequence)
+            {
+                break;
+            }
+            spinPause();
+        }
+
+        if (found)
+        {
+            return true;
+        }
+        if ((tags >> OVERFLOW_SHIFT) == 0)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+void MacTable::beginWrite(Bucket & bucket)
+{
+    bucket.sequence.store(bucket.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void MacTable::endWrite(Bucket & bucket)
+{
+    bucket.sequence.store(bucket.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool MacTable::insert(uint64_t key, uint32_t port)
+{
+    if (size_m.load(std::memory_order_relaxed) >= capacity_m)
+    {
+        overflows_m.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t hashed = hash(key);
+    for (size_t probe = 0; probe <= mask_m; probe++)
+    {
+        auto & bucket = buckets_m[(hashed + probe) & mask_m];
+        uint64_t tags = bucket.tags.load(std::memory_order_relaxed);
+        uint32_t empty = match(tags, EMPTY);
+        if (empty == 0)
+        {
+            // only ever set, a reader that missed it couldn't have been looking for the new entry
+            bucket.tags.store(tags | OVERFLOWED, std::memory_order_release);
+            continue;
+        }
+
+        uint32_t slot = __builtin_ctz(empty);
+        beginWrite(bucket);
+        bucket.ports[slot].store(static_cast<uint8_t>(port), std::memory_order_relaxed);
+        bucket.slots[slot].store(key | HIT, std::memory_order_relaxed);
+        bucket.tags.store(tags | (static_cast<uint64_t>(tag(hashed)) << (8 * slot)), std::memory_order_relaxed);
+        endWrite(bucket);
+        size_m.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void MacTable::erase(size_t index, uint32_t slot)
+{
+    auto & bucket = buckets_m[index];
+    beginWrite(bucket);
+    bucket.tags.store(bucket.tags.load(std::memory_order_relaxed) & ~(uint64_t(0xff) << (8 * slot)),
+                      std::memory_order_relaxed);
+    bucket.slots[slot].store(0, std::memory_order_relaxed);
+    bucket.ports[slot].store(NO_PORT, std::memory_order_relaxed);
+    endWrite(bucket);
+    size_m.fetch_sub(1, std::memory_order_relaxed);
+    shorten((index - 1) & mask_m);
+}
+
+// an insert only goes past a bucket into the next one, so once the next bucket is empty and has no bit
+// of its own, nothing that went past this bucket is left, and a bucket that empties this way
+// may let the one in front of it go in turn
+void MacTable::shorten(size_t index)
+{
+    for (size_t probe = 0; probe <= mask_m; probe++, index = (index - 1) & mask_m)
+    {
+        auto & bucket = buckets_m[index];
+        uint64_t tags = bucket.tags.load(std::memory_order_relaxed);
+        if ((tags & OVERFLOWED) == 0 || buckets_m[(index + 1) & mask_m].tags.load(std::memory_order_relaxed) != 0)
+        {
+            return;
+        }
+        bucket.tags.store(tags & ~OVERFLOWED, std::memory_order_release);
+        if (full(tags) != 0)
+        {
+            return;
+        }
+    }
+}
+
+// the common case, a known host on the same port, doesn't write at all once its hit bit is set
+bool MacTable::learn(uint64_t key, uint32_t port)
+{
+    if (port >= MAX_PORTS)
+    {
+        return false;
+    }
+
+    size_t bucket = 0;
+    uint32_t slot = 0;
+    uint64_t entry = 0;
+    uint32_t current = NO_PORT;
+    if (find(key, bucket, slot, entry, current) && current == port)
+    {
+        if ((entry & HIT) ||
+            buckets_m[bucket].slots[slot].compare_exchange_strong(entry, entry | HIT, std::memory_order_relaxed))
+        {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(writer_m);
+    if (!find(key, bucket, slot, entry, current))
+    {
+        return insert(key, port);
+    }
+
+    // a moved host gets its new port under the sequence number, a reader never sees a port of another key
+    auto & target = buckets_m[bucket];
+    bool moved = current != port;
+    if (moved)
+    {
+        beginWrite(target);
+        target.ports[slot].store(static_cast<uint8_t>(port), std::memory_order_relaxed);
+    }
+    target.slots[slot].store(key | HIT, std::memory_order_relaxed);
+    if (moved)
+    {
+        endWrite(target);
+    }
+    return moved;
+}
+
+void MacTable::touch(uint64_t key)
+{
+    size_t bucket = 0;
+    uint32_t slot = 0;
+    uint64_t entry = 0;
+    uint32_t port = NO_PORT;
+    if (find(key, bucket, slot, entry, port))
+    {
+        // fails only if the entry changed meanwhile, it was learned or aged then
+        buckets_m[bucket].slots[slot].compare_exchange_strong(entry, entry | HIT, std::memory_order_relaxed);
+    }
+}
+
+void MacTable::refresh()
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t i = 0; i <= mask_m; i++)
+    {
+        auto & bucket = buckets_m[i];
+        for (uint32_t slots = full(bucket.tags.load(std::memory_order_relaxed)); slots != 0; slots &= slots - 1)
+        {
+            bucket.slots[__builtin_ctz(slots)].fetch_or(HIT, std::memory_order_relaxed);
+        }
+    }
+}
+
+void MacTable::clear()
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t i = 0; i <= mask_m; i++)
+    {
+        auto & bucket = buckets_m[i];
+        if (bucket.tags.load(std::memory_order_relaxed) == 0)
+        {
+            continue;
+        }
+        beginWrite(bucket);
+        bucket.tags.store(0, std::memory_order_relaxed);
+        for (uint32_t slot = 0; slot < SLOTS; slot++)
+        {
+            bucket.slots[slot].store(0, std::memory_order_relaxed);
+            bucket.ports[slot].store(NO_PORT, std::memory_order_relaxed);
+        }
+        endWrite(bucket);
+    }
+    size_m.store(0, std::memory_order_relaxed);
+}
+
+vector<MacEntry> MacTable::entries(steady_clock::time_point now, milliseconds timeout) const
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    milliseconds epoch = std::max<milliseconds>(timeout / MAC_AGING_EPOCHS, 1ms);
+    auto sinceSweep = std::chrono::duration_cast<milliseconds>(now - lastSweep_m);
+
+    vector<MacEntry> entries;
+    entries.reserve(size());
+    for (size_t i = 0; i <= mask_m; i++)
+    {
+        const auto & bucket = buckets_m[i];
+        for (uint32_t slots = full(bucket.tags.load(std::memory_order_relaxed)); slots != 0; slots &= slots - 1)
+        {
+            uint32_t slot = __builtin_ctz(slots);
+            uint64_t entry = bucket.slots[slot].load(std::memory_order_relaxed);
+            uint64_t age = (entry & HIT) ? 0 : entry >> AGE_SHIFT;
+            uint8_t address[6];
+            for (int byte = 0; byte < 6; byte++)
+            {
+                address[byte] = (entry >> (40 - 8 * byte)) & 0xff;
+            }
+
+            milliseconds left = epoch * static_cast<int64_t>(MAC_AGING_EPOCHS - age) - sinceSweep;
+            entries.push_back({mac_address(address), keyVlan(entry), bucket.ports[slot].load(std::memory_order_relaxed),
+                               std::max<milliseconds>(left, 0ms)});
+        }
+    }
+    return entries;
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include "settings.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <tins/hw_address.h>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using mac_address = Tins::HWAddress<6>;
+using std::chrono::steady_clock, std::chrono::milliseconds;
+using std::vector, std::unique_ptr;
+
+// a learned host as shown to the user
+struct MacEntry
+{
+    mac_address address;
+    uint16_t vlan;
+    uint32_t port; // index into the port table
+    milliseconds timeLeft;
+};
+
+// the forwarding database, an open-addressing hash table of fixed capacity
+// every entry is a single word: the key, a VLAN and a MAC address packed into 60 bits by vlanKey(),
+// a hit bit and an age, the index of its port in the port table is a byte next to the sequence number
+// the entries are grouped by six into cache line sized buckets, which start with a tag byte per entry,
+// so a lookup usually compares the tags of one bucket at once and reads a single key
+// entries don't carry a timeout, sweep() ages the ones that weren't hit since the last epoch
+//
+// lookups never block: every bucket has a sequence number, odd while an entry is being added or removed,
+// and a reader that saw it change reads the bucket again
+// a known host is learned without the lock too, by setting its hit bit in place,
+// only new and moved hosts, aging and management take the writer lock
+struct MacTable
+{
+public:
+    static constexpr uint32_t NO_PORT = 0xff;
+    static constexpr uint32_t MAX_PORTS = NO_PORT;
+    static_assert(MAX_SWITCH_PORTS <= MAX_PORTS, "a port index has to fit into an entry");
+
+    MacTable(uint32_t capacity = MAC_TABLE_CAPACITY);
+    MacTable(MacTable &&) = delete;
+    MacTable(const MacTable &) = delete;
+    MacTable & operator=(MacTable &&) = delete;
+    MacTable & operator=(const MacTable &) = delete;
+
+public:
+    uint32_t lookup(uint64_t key) const; // the port index, NO_PORT for an unknown host, lock-free
+
+    // a known host on the same port only gets its hit bit set
+    // returns whether the host is new or has moved, false as well if the table is full
+    bool learn(uint64_t key, uint32_t port);
+    void touch(uint64_t key); // the host was seen elsewhere, the fast path for example
+    void refresh();           // every entry counts as just learned
+    void clear();
+
+    // ages every entry by the epochs passed since the last sweep, an entry expires after MAC_AGING_EPOCHS
+    // epochs without a hit, forget(key) is called for every expired one
+    // the writer lock is only held for SWEEP_CHUNK buckets at a time, so learning goes on in between
+    template <typename Forget> void sweep(steady_clock::time_point now, milliseconds timeout, Forget && forget);
+
+    template <typename Visit> void forEach(Visit && visit) const; // visit(key, port index), under the writer lock
+    vector<MacEntry> entries(steady_clock::time_point now, milliseconds timeout) const;
+
+    size_t size() const;
+    size_t capacity() const;
+    size_t memory() const; // bytes taken by the buckets
+    int64_t overflows() const; // hosts not learned because the table was full
+
+private:
+    static constexpr uint32_t SLOTS = 6;
+    static constexpr uint32_t SLOT_MASK = (1 << SLOTS) - 1;
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint64_t KEY_MASK = (uint64_t(1) << 60) - 1;
+    static constexpr uint64_t HIT = uint64_t(1) << 60;
+    static constexpr uint32_t AGE_SHIFT = 61;
+    static constexpr uint64_t MAX_AGE = 7;
+    static constexpr uint32_t OVERFLOW_SHIFT = 8 * SLOTS;
+    static constexpr uint64_t OVERFLOWED = uint64_t(1) << OVERFLOW_SHIFT;
+    static constexpr size_t SWEEP_CHUNK = 4096; // buckets, 256 KiB
+    static_assert(MAC_AGING_EPOCHS <= MAX_AGE + 1, "the age of an entry has to fit into its top bits");
+
+    // the tags are one word, so they are read at once and written together with the sequence number
+    // byte i is the tag of slot i, EMPTY or 0x80 with 7 bits of the hash,
+    // the byte after them is set once an insert went past the full bucket, lookups have to go on then
+    // the ports of the slots fill the rest of the first word, they only change under the sequence number
+    struct alignas(64) Bucket
+    {
+        std::atomic<uint16_t> sequence;
+        std::atomic<uint8_t> ports[SLOTS];
+        std::atomic<uint64_t> tags;
+        std::atomic<uint64_t> slots[SLOTS];
+    };
+    static_assert(sizeof(Bucket) == 64, "a bucket has to fill exactly one cache line");
+
+    static uint32_t match(uint64_t tags, uint8_t tag); // a bit for every slot with the tag
+    static uint32_t full(uint64_t tags);
+
+    static uint64_t hash(uint64_t key);
+    static uint8_t tag(uint64_t hash);
+
+    // entry and port are the slot as it was read, with the sequence number checked
+    bool find(uint64_t key, size_t & bucket, uint32_t & slot, uint64_t & entry, uint32_t & port) const;
+    bool insert(uint64_t key, uint32_t port);
+    void erase(size_t bucket, uint32_t slot); // under the writer lock
+    void shorten(size_t bucket); // under the writer lock, clears the overflow bits nothing probes past anymore
+    void beginWrite(Bucket & bucket);
+    void endWrite(Bucket & bucket);
+
+private:
+    unique_ptr<Bucket[]> buckets_m;
+    size_t mask_m;
+    size_t capacity_m;
+    std::atomic<size_t> size_m;
+    std::atomic<int64_t> overflows_m;
+    steady_clock::time_point lastSweep_m;
+    mutable std::mutex writer_m;
+};
+
+static constexpr uint64_t BROADCAST_KEY = 0xffffffffffff; // the macKey() of ff:ff:ff:ff:ff:ff
+
+uint64_t macKey(const mac_address & mac);
+uint64_t macKey(const uint8_t *mac); // the 6 bytes of the address as they are on the wire
+uint64_t vlanKey(uint16_t vlan, uint64_t mac); // the key of the MAC table, mac is a macKey()
+uint64_t keyMac(uint64_t key);                 // the macKey() part of a vlanKey()
+uint16_t keyVlan(uint64_t key);
+
+// a reader that waits for a writer to finish, it lets the writer run on the SMT sibling
+void spinPause();
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline uint64_t macKey(const uint8_t *mac)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        key = (key << 8) | mac[i];
+    }
+    return key;
+}
+
+inline uint64_t macKey(const mac_address & mac)
+{
+    return macKey(mac.begin());
+}
+
+inline uint64_t vlanKey(uint16_t vlan, uint64_t mac)
+{
+    return (static_cast<uint64_t>(vlan & 0xfff) << 48) | mac;
+}
+
+inline uint64_t keyMac(uint64_t key)
+{
+    return key & ((uint64_t(1) << 48) - 1);
+}
+
+inline uint16_t keyVlan(uint64_t key)
+{
+    return static_cast<uint16_t>((key >> 48) & 0xfff);
+}
+
+inline void spinPause()
+{
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+inline uint64_t MacTable::hash(uint64_t key)
+{
+    key ^= key >> 29;
+    key *= 0x9e3779b97f4a7c15;
+    return key ^ (key >> 32);
+}
+
+inline uint8_t MacTable::tag(uint64_t hash)
+{
+    return 0x80 | (hash >> 57);
+}
+
+inline uint32_t MacTable::match(uint64_t tags, uint8_t tag)
+{
+#ifdef __SSE2__
+    __m128i lane = _mm_cvtsi64_si128(static_cast<long long>(tags));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(lane, _mm_set1_epi8(static_cast<char>(tag)))) & SLOT_MASK;
+#else
+    uint32_t matches = 0;
+    for (uint32_t i = 0; i < SLOTS; i++)
+    {
+        matches |= static_cast<uint32_t>(((tags >> (8 * i)) & 0xff) == tag) << i;
+    }
+    return matches;
+#endif
+}
+
+inline uint32_t MacTable::full(uint64_t tags)
+{
+    return SLOT_MASK & ~match(tags, EMPTY);
+}
+
+inline uint32_t MacTable::lookup(uint64_t key) const
+{
+    size_t bucket = 0;
+    uint32_t slot = 0;
+    uint64_t entry = 0;
+    uint32_t port = NO_PORT;
+    if (!find(key, bucket, slot, entry, port))
+    {
+        return NO_PORT;
+    }
+    return port;
+}
+
+inline size_t MacTable::size() const
+{
+    return size_m.load(std::memory_order_relaxed);
+}
+
+inline size_t MacTable::capacity() const
+{
+    return capacity_m;
+}
+
+inline size_t MacTable::memory() const
+{
+    return (mask_m + 1) * sizeof(Bucket);
+}
+
+inline int64_t MacTable::overflows() const
+{
+    return overflows_m.load(std::memory_order_relaxed);
+}
+
+// the hit bit can be set concurrently, so the entries are aged with a compare and swap,
+// an expired entry is claimed by swapping in 0 before it is erased, a hit that came first keeps it
+template <typename Forget> void MacTable::sweep(steady_clock::time_point now, milliseconds timeout, Forget && forget)
+{
+    uint64_t elapsed = 0;
+    {
+        std::lock_guard<std::mutex> lock(writer_m);
+        milliseconds epoch = std::max<milliseconds>(timeout / MAC_AGING_EPOCHS, 1ms);
+        elapsed = static_cast<uint64_t>((now - lastSweep_m) / epoch);
+        if (elapsed == 0)
+        {
+            return;
+        }
+        lastSweep_m += epoch * elapsed;
+        elapsed = std::min(elapsed, MAX_AGE);
+    }
+
+    for (size_t start = 0; start <= mask_m; start += SWEEP_CHUNK)
+    {
+        std::lock_guard<std::mutex> lock(writer_m);
+        for (size_t i = start, end = std::min(start + SWEEP_CHUNK, mask_m + 1); i < end; i++)
+        {
+            auto & bucket = buckets_m[i];
+            for (uint32_t slots = full(bucket.tags.load(std::memory_order_relaxed)); slots != 0; slots &= slots - 1)
+            {
+                uint32_t slot = __builtin_ctz(slots);
+                uint64_t entry = bucket.slots[slot].load(std::memory_order_relaxed);
+                while (true)
+                {
+                    uint64_t age = (entry & HIT) ? 0 : (entry >> AGE_SHIFT) + elapsed;
+                    bool expired = age >= MAC_AGING_EPOCHS;
+                    uint64_t aged = expired ? 0 : (entry & KEY_MASK) | (age << AGE_SHIFT);
+                    if (!bucket.slots[slot].compare_exchange_weak(entry, aged, std::memory_order_relaxed))
+                    {
+                        continue;
+                    }
+                    if (expired)
+                    {
+                        forget(entry & KEY_MASK);
+                        erase(i, slot);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+template <typename Visit> void MacTable::forEach(Visit && visit) const
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t i = 0; i <= mask_m; i++)
+    {
+        const auto & bucket = buckets_m[i];
+        for (uint32_t slots = full(bucket.tags.load(std::memory_order_relaxed)); slots != 0; slots &= slots - 1)
+        {
+            uint32_t slot = __builtin_ctz(slots);
+            visit(bucket.slots[slot].load(std::memory_order_relaxed) & KEY_MASK,
+                  static_cast<uint32_t>(bucket.ports[slot].load(std::memory_order_relaxed)));
+        }
+    }
+}
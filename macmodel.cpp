@@ -7,7 +7,8 @@ using std::chrono::duration_cast, std::chrono::seconds;
 MacModel::MacModel(const SharedStorageHandle & handle, QObject *parent)
     : QAbstractTableModel(parent),
     storageHandle_m{handle},
-    timer_m{this}
+    timer_m{this},
+    entries_m{}
 {
     timer_m.setInterval(MAC_UPDATE_TIMER.count());
     connect(&timer_m, &QTimer::timeout, this, &MacModel::updateMac);
@@ -23,8 +24,10 @@ QVariant MacModel::headerData(int section, Qt::Orientation orientation, int role
         case 0:
             return QString("address");
         case 1:
-            return QString("interface");
+            return QString("vlan");
         case 2:
+            return QString("interface");
+        case 3:
             return QString("timeout");
         }
     }
@@ -33,13 +36,12 @@ QVariant MacModel::headerData(int section, Qt::Orientation orientation, int role
 
 int MacModel::rowCount(const QModelIndex & parent) const
 {
-    auto guard = storageHandle_m.guard();
-    return guard->macTable.size();
+    return entries_m.size();
 }
 
 int MacModel::columnCount(const QModelIndex & parent) const
 {
-    return 3;
+    return 4;
 }
 
 QVariant MacModel::data(const QModelIndex & index, int role) const
@@ -54,34 +56,46 @@ QVariant MacModel::data(const QModelIndex & index, int role) const
         return QVariant();
     }
 
-    auto guard = storageHandle_m.guard();
-    int currentRow = 0;
-    for (auto it = guard->macTable.begin(); it != guard->macTable.end(); it++)
+    if (index.row() >= static_cast<int>(entries_m.size()))
+    {
+        return QVariant();
+    }
+
+    const auto & entry = entries_m[index.row()];
+    switch (index.column())
     {
-        if (currentRow != index.row())
+    case 0:
+        return QVariant(QString("%1").arg(entry.address.to_string().c_str()));
+    case 1:
+        return QVariant(QString("%1").arg(entry.vlan));
+    case 2:
+        if (entry.port >= storageHandle_m.ports().size())
         {
-            currentRow++;
-            continue;
+            return QVariant(QString("%1").arg(entry.port));
         }
-
-        switch (index.column())
+        if (storageHandle_m.ports().lag(entry.port) != PortTable::NO_LAG)
         {
-        case 0:
-            return QVariant(QString("%1").arg(it->first.to_string().c_str()));
-        case 1:
-            return QVariant(QString("%1").arg(it->second.interface.name().c_str()));
-        case 2:
-            return QVariant(QString("%1 s").arg(duration_cast<seconds>(it->second.expiration.timeLeft()).count()));
-        default:
-            qDebug("Unknown column! %d", index.column());
-            return QVariant();
+            const auto & lag = storageHandle_m.ports().lagName(storageHandle_m.ports().lag(entry.port));
+            return QVariant(QString("%1").arg(lag.c_str()));
         }
+        return QVariant(QString("%1").arg(storageHandle_m.ports()[entry.port].name().c_str()));
+    case 3:
+        return QVariant(QString("%1 s").arg(duration_cast<seconds>(entry.timeLeft).count()));
+    default:
+        qDebug("Unknown column! %d", index.column());
+        return QVariant();
     }
-    return QVariant();
 }
 
 void MacModel::updateMac()
 {
+    milliseconds timeout;
+    {
+        auto guard = storageHandle_m.device();
+        timeout = guard->deviceInfo.defaultMacTimeout;
+    }
+
     beginResetModel();
+    entries_m = storageHandle_m.macTable().entries(steady_clock::now(), timeout);
     endResetModel();
 }
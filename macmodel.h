@@ -25,4 +25,5 @@ private slots:
 private:
     mutable SharedStorageHandle storageHandle_m;
     QTimer timer_m;
+    vector<MacEntry> entries_m; // taken on every update, the table is too large to walk for every cell
 };
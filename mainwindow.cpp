@@ -17,9 +17,6 @@ MainWindow::MainWindow(QWidget *parent)
       interfaces_m{},
       configurationTimer_m{this},
       threadTimer_m{this},
-      macTimer_m{this},
-      packetsTimer_m{this},
-      sessionTimer_m{this},
       networkSwitch_m{},
       firstModel{nullptr},
       secondModel{nullptr}
@@ -36,12 +33,6 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(&configurationTimer_m, &QTimer::timeout, this, &MainWindow::updateInterfaces);
     connect(&threadTimer_m, &QTimer::timeout, this, &MainWindow::refreshUi);
-    connect(&macTimer_m, &QTimer::timeout, this, &MainWindow::updateMac);
-    connect(&packetsTimer_m, &QTimer::timeout, this, &MainWindow::updatePackets);
-    connect(&sessionTimer_m, &QTimer::timeout, this, &MainWindow::updateSessions);
-    macTimer_m.start(MAC_UPDATE_TIMER);
-    packetsTimer_m.start(SENT_PACKETS_TIMER);
-    sessionTimer_m.start(SESSION_UPDATE_TIMER);
     configurationTimer_m.start(INTERFACE_UPDATE_TIMER);
     updateInterfaces();
 
@@ -157,24 +148,29 @@ void MainWindow::refreshUi()
         ui_m->restStartStop->setText("Start REST");
         ui_m->port->setEnabled(true);
         auto activeInterfaces = networkSwitch_m.interfaces();
+        activeInterfaces.resize(2); // the window shows the first two ports
         ui_m->status->setText(
             QString("Status: Running on interfaces: %1 <-> %2")
-                .arg(activeInterfaces.first.identificator.c_str(), activeInterfaces.second.identificator.c_str())
+                .arg(activeInterfaces[0].identificator.c_str(), activeInterfaces[1].identificator.c_str())
         );
         ui_m->interface1Name->setText(QString("%1").arg(
-            activeInterfaces.first.name.c_str()
+            activeInterfaces[0].name.c_str()
         ));
         ui_m->interface2Name->setText(QString("%1").arg(
-            activeInterfaces.second.name.c_str()
-        ));
-        ui_m->interface1Status->setText(QString("%1, %2").arg(
-            activeInterfaces.first.identificator.c_str(),
-            activeInterfaces.first.up ? "up" : "down"
-        ));
-        ui_m->interface2Status->setText(QString("%1, %2").arg(
-            activeInterfaces.second.identificator.c_str(),
-            activeInterfaces.second.up ? "up" : "down"
+            activeInterfaces[1].name.c_str()
         ));
+        ui_m->interface1Status->setText(QString("%1, %2, rx burst %3 avg, tx batch %4 avg / %5 max, queue peak %6").arg(
+            activeInterfaces[0].identificator.c_str(),
+            activeInterfaces[0].up ? "up" : "down"
+        ).arg(activeInterfaces[0].rx.averageBurst(), 0, 'f', 1)
+         .arg(activeInterfaces[0].tx.averageBatch(), 0, 'f', 1).arg(activeInterfaces[0].tx.maxBatch)
+         .arg(activeInterfaces[0].tx.highWater));
+        ui_m->interface2Status->setText(QString("%1, %2, rx burst %3 avg, tx batch %4 avg / %5 max, queue peak %6").arg(
+            activeInterfaces[1].identificator.c_str(),
+            activeInterfaces[1].up ? "up" : "down"
+        ).arg(activeInterfaces[1].rx.averageBurst(), 0, 'f', 1)
+         .arg(activeInterfaces[1].tx.averageBatch(), 0, 'f', 1).arg(activeInterfaces[1].tx.maxBatch)
+         .arg(activeInterfaces[1].tx.highWater));
     }
     else if (networkSwitch_m.state() == NetworkSwitch::SwitchState::RunningRest)
     {
@@ -186,22 +182,27 @@ void MainWindow::refreshUi()
         ui_m->restStartStop->setText("Stop REST");
         ui_m->port->setEnabled(true);
         auto activeInterfaces = networkSwitch_m.interfaces();
+        activeInterfaces.resize(2); // the window shows the first two ports
         ui_m->status->setText(QString("Status: Running on interfaces: %1 <-> %2\nREST on port: %3")
-                                  .arg(activeInterfaces.first.identificator.c_str(), activeInterfaces.second.identificator.c_str(), "8888"));
+                                  .arg(activeInterfaces[0].identificator.c_str(), activeInterfaces[1].identificator.c_str(), "8888"));
         ui_m->interface1Name->setText(QString("%1").arg(
-            activeInterfaces.first.name.c_str()
+            activeInterfaces[0].name.c_str()
         ));
         ui_m->interface2Name->setText(QString("%1").arg(
-            activeInterfaces.second.name.c_str()
-        ));
-        ui_m->interface1Status->setText(QString("%1, %2").arg(
-            activeInterfaces.first.identificator.c_str(),
-            activeInterfaces.first.up ? "up" : "down"
-        ));
-        ui_m->interface2Status->setText(QString("%1, %2").arg(
-            activeInterfaces.second.identificator.c_str(),
-            activeInterfaces.second.up ? "up" : "down"
+            activeInterfaces[1].name.c_str()
         ));
+        ui_m->interface1Status->setText(QString("%1, %2, rx burst %3 avg, tx batch %4 avg / %5 max, queue peak %6").arg(
+            activeInterfaces[0].identificator.c_str(),
+            activeInterfaces[0].up ? "up" : "down"
+        ).arg(activeInterfaces[0].rx.averageBurst(), 0, 'f', 1)
+         .arg(activeInterfaces[0].tx.averageBatch(), 0, 'f', 1).arg(activeInterfaces[0].tx.maxBatch)
+         .arg(activeInterfaces[0].tx.highWater));
+        ui_m->interface2Status->setText(QString("%1, %2, rx burst %3 avg, tx batch %4 avg / %5 max, queue peak %6").arg(
+            activeInterfaces[1].identificator.c_str(),
+            activeInterfaces[1].up ? "up" : "down"
+        ).arg(activeInterfaces[1].rx.averageBurst(), 0, 'f', 1)
+         .arg(activeInterfaces[1].tx.averageBatch(), 0, 'f', 1).arg(activeInterfaces[1].tx.maxBatch)
+         .arg(activeInterfaces[1].tx.highWater));
     }
     else if (networkSwitch_m.state() == NetworkSwitch::SwitchState::Idle)
     {
@@ -225,8 +226,9 @@ void MainWindow::refreshUi()
         ui_m->restStartStop->setText("Stopping REST...");
         ui_m->port->setEnabled(false);
         auto activeInterfaces = networkSwitch_m.interfaces();
+        activeInterfaces.resize(2); // the window shows the first two ports
         ui_m->status->setText(QString("Status: Running on interfaces: %1 -> %2 (finishing...)")
-                                  .arg(activeInterfaces.first.identificator.c_str(), activeInterfaces.second.identificator.c_str()));
+                                  .arg(activeInterfaces[0].identificator.c_str(), activeInterfaces[1].identificator.c_str()));
     }
     else
     {
@@ -267,21 +269,6 @@ void MainWindow::refreshUi()
     /* } */
 }
 
-void MainWindow::updateMac()
-{
-    networkSwitch_m.updateMac();
-}
-
-void MainWindow::updatePackets()
-{
-    networkSwitch_m.updatePackets();
-}
-
-void MainWindow::updateSessions()
-{
-    networkSwitch_m.updateSessions();
-}
-
 void MainWindow::updateInterfaces()
 {
     auto current = Tins::NetworkInterface::all();
@@ -291,8 +278,6 @@ void MainWindow::updateInterfaces()
         qInfo("Configuration updated.");
         refreshUi();
     }
-
-    networkSwitch_m.updateMac();
 }
 
 void MainWindow::clearMacTable()
@@ -310,14 +295,16 @@ void MainWindow::clearStatsTable()
 void MainWindow::clearFirstStatsTable()
 {
     auto activeInterfaces = networkSwitch_m.interfaces();
-    networkSwitch_m.clearStats(activeInterfaces.first.networkInterface);
+    activeInterfaces.resize(2); // the window shows the first two ports
+    networkSwitch_m.clearStats(activeInterfaces[0].networkInterface);
     refreshUi();
 }
 
 void MainWindow::clearSecondStatsTable()
 {
     auto activeInterfaces = networkSwitch_m.interfaces();
-    networkSwitch_m.clearStats(activeInterfaces.second.networkInterface);
+    activeInterfaces.resize(2); // the window shows the first two ports
+    networkSwitch_m.clearStats(activeInterfaces[1].networkInterface);
     refreshUi();
 }
 
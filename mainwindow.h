@@ -42,10 +42,6 @@ private slots:
     void clearSecondStatsTable();
     void resetMac();
 
-    void updateMac();
-    void updatePackets();
-    void updateSessions();
-
 private:
     void updateInterfaces();
     void startNetworkThread();
@@ -59,7 +55,7 @@ private:
     InfoTable *info_m;
 
     vector<NetworkInterface> interfaces_m;
-    QTimer configurationTimer_m, threadTimer_m, macTimer_m, packetsTimer_m, sessionTimer_m;
+    QTimer configurationTimer_m, threadTimer_m;
     NetworkSwitch networkSwitch_m;
     unique_ptr<StatisticsModel> firstModel, secondModel;
 };
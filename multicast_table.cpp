@@ -0,0 +1,455 @@
+#include "multicast_table.h"
+#include "mac_table.h"
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint32_t ETHERNET_TYPE_OFFSET = 12;
+static constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+static constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+static constexpr uint8_t IP_PROTOCOL_IGMP = 2;
+static constexpr uint8_t IP_PROTOCOL_ICMPV6 = 58;
+static constexpr uint8_t IPV6_HOP_BY_HOP = 0;
+
+// IGMP message types
+static constexpr uint8_t IGMP_QUERY = 0x11;
+static constexpr uint8_t IGMP_V1_REPORT = 0x12;
+static constexpr uint8_t IGMP_V2_REPORT = 0x16;
+static constexpr uint8_t IGMP_LEAVE = 0x17;
+static constexpr uint8_t IGMP_V3_REPORT = 0x22;
+
+// MLD message types, ICMPv6
+static constexpr uint8_t MLD_QUERY = 130;
+static constexpr uint8_t MLD_V1_REPORT = 131;
+static constexpr uint8_t MLD_DONE = 132;
+static constexpr uint8_t MLD_V2_REPORT = 143;
+
+// the group record types of IGMPv3 and MLDv2 reports
+static constexpr uint8_t MODE_IS_INCLUDE = 1;
+static constexpr uint8_t CHANGE_TO_INCLUDE = 3;
+static constexpr uint8_t BLOCK_OLD_SOURCES = 6;
+
+static uint16_t read16(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+static uint32_t read32(const uint8_t *data)
+{
+    return (static_cast<uint32_t>(read16(data)) << 16) | read16(data + 2);
+}
+
+// the floating point format of the Max Resp Code and QQIC fields of IGMPv3 and MLDv2, RFC 3376 4.1.1
+static uint32_t decodeInterval(uint32_t code, uint32_t bits)
+{
+    uint32_t limit = 1u << (bits - 1);
+    if (code < limit)
+    {
+        return code;
+    }
+    uint32_t exponent = (code >> (bits - 4)) & 0x7;
+    uint32_t mantissa = code & ((1u << (bits - 4)) - 1);
+    return (mantissa | (1u << (bits - 4))) << (exponent + 3);
+}
+
+// 01:00:5e and the low 23 bits of an IPv4 group, 33:33 and the low 32 bits of an IPv6 one
+static uint64_t groupMac(const uint8_t *group, bool ipv6)
+{
+    if (ipv6)
+    {
+        return 0x333300000000 | read32(group + 12);
+    }
+    return 0x01005e000000 | (read32(group) & 0x7fffff);
+}
+
+static bool multicastGroup(const uint8_t *group, bool ipv6)
+{
+    return ipv6 ? group[0] == 0xff : (group[0] & 0xf0) == 0xe0;
+}
+
+// sized for at most half of the slots taken
+MulticastTable::MulticastTable(uint32_t capacity)
+    : entries_m(nullptr),
+      mask_m(0),
+      capacity_m(capacity),
+      size_m(0),
+      routers_m(0),
+      routerExpires_m{},
+      membershipInterval_m(MULTICAST_MEMBERSHIP_INTERVAL.count()),
+      overflows_m(0),
+      writer_m{}
+{
+    size_t slots = 1;
+    while (slots < static_cast<size_t>(capacity_m) * 2)
+    {
+        slots <<= 1;
+    }
+    entries_m.reset(new Entry[slots]());
+    mask_m = slots - 1;
+}
+
+// the frame may still carry its VLAN tags, the IP header follows them
+MulticastMessage MulticastTable::snoop(const uint8_t *frame, uint32_t size, uint16_t vlan, uint32_t port)
+{
+    if (size < ETHERNET_TYPE_OFFSET + 2 || port >= MAX_PORTS)
+    {
+        return MulticastMessage::None;
+    }
+    uint32_t offset = ETHERNET_TYPE_OFFSET;
+    uint16_t etherType = read16(frame + offset);
+    while ((etherType == 0x8100 || etherType == 0x88a8) && offset + 6 <= size)
+    {
+        offset += 4;
+        etherType = read16(frame + offset);
+    }
+    offset += 2;
+
+    if (etherType == ETHERTYPE_IPV4 && size >= offset + 20)
+    {
+        const uint8_t *ip = frame + offset;
+        uint32_t header = (ip[0] & 0x0f) * 4;
+        uint32_t length = std::min<uint32_t>(read16(ip + 2), size - offset);
+        if (ip[9] != IP_PROTOCOL_IGMP || header < 20 || length < header + 8)
+        {
+            return MulticastMessage::None;
+        }
+        return snoopIgmp(ip + header, length - header, vlan, port);
+    }
+    if (etherType == ETHERTYPE_IPV6 && size >= offset + 40)
+    {
+        // MLD always comes behind a hop-by-hop header with the router alert option
+        const uint8_t *ip = frame + offset;
+        uint32_t length = std::min<uint32_t>(read16(ip + 4), size - offset - 40);
+        uint8_t next = ip[6];
+        uint32_t header = 40;
+        if (next == IPV6_HOP_BY_HOP && length >= 8)
+        {
+            next = ip[header];
+            uint32_t skipped = (ip[header + 1] + 1) * 8;
+            if (skipped > length)
+            {
+                return MulticastMessage::None;
+            }
+            header += skipped;
+            length -= skipped;
+        }
+        if (next != IP_PROTOCOL_ICMPV6 || length < 8)
+        {
+            return MulticastMessage::None;
+        }
+        return snoopMld(ip + header, length, vlan, port);
+    }
+    return MulticastMessage::None;
+}
+
+MulticastMessage MulticastTable::snoopIgmp(const uint8_t *message, uint32_t size, uint16_t vlan, uint32_t port)
+{
+    int64_t now = stamp(steady_clock::now());
+    std::lock_guard<std::mutex> lock(writer_m);
+    switch (message[0])
+    {
+    case IGMP_QUERY:
+    {
+        // an IGMPv3 querier announces its robustness and interval, the membership interval follows from them
+        int64_t interval = 0;
+        if (size >= 12)
+        {
+            uint32_t robustness = message[8] & 0x7;
+            uint32_t queryInterval = decodeInterval(message[9], 8);
+            uint32_t maxResponse = decodeInterval(message[1], 8); // tenths of a second
+            if (robustness != 0 && queryInterval != 0)
+            {
+                interval = robustness * queryInterval * 1000 + maxResponse * 100;
+            }
+        }
+        query(port, interval, now);
+        return MulticastMessage::Query;
+    }
+    case IGMP_V1_REPORT:
+    case IGMP_V2_REPORT:
+        join(vlan, message + 4, false, port, now);
+        return MulticastMessage::Report;
+    case IGMP_LEAVE:
+        leave(vlan, message + 4, false, port, now);
+        return MulticastMessage::Report;
+    case IGMP_V3_REPORT:
+    {
+        uint32_t offset = 8;
+        for (uint16_t records = read16(message + 6); records != 0 && offset + 8 <= size; records--)
+        {
+            const uint8_t *entry = message + offset;
+            uint16_t sources = read16(entry + 2);
+            record(entry[0], sources, vlan, entry + 4, false, port, now);
+            offset += 8 + 4 * sources + 4 * entry[1];
+        }
+        return MulticastMessage::Report;
+    }
+    default:
+        return MulticastMessage::None;
+    }
+}
+
+MulticastMessage MulticastTable::snoopMld(const uint8_t *message, uint32_t size, uint16_t vlan, uint32_t port)
+{
+    int64_t now = stamp(steady_clock::now());
+    std::lock_guard<std::mutex> lock(writer_m);
+    switch (message[0])
+    {
+    case MLD_QUERY:
+    {
+        int64_t interval = 0;
+        if (size >= 28)
+        {
+            uint32_t robustness = message[24] & 0x7;
+            uint32_t queryInterval = decodeInterval(message[25], 8);
+            uint32_t maxResponse = decodeInterval(read16(message + 4), 16); // milliseconds
+            if (robustness != 0 && queryInterval != 0)
+            {
+                interval = robustness * queryInterval * 1000 + maxResponse;
+            }
+        }
+        query(port, interval, now);
+        return MulticastMessage::Query;
+    }
+    case MLD_V1_REPORT:
+        if (size >= 24)
+        {
+            join(vlan, message + 8, true, port, now);
+        }
+        return MulticastMessage::Report;
+    case MLD_DONE:
+        if (size >= 24)
+        {
+            leave(vlan, message + 8, true, port, now);
+        }
+        return MulticastMessage::Report;
+    case MLD_V2_REPORT:
+    {
+        uint32_t offset = 8;
+        for (uint16_t records = read16(message + 6); records != 0 && offset + 20 <= size; records--)
+        {
+            const uint8_t *entry = message + offset;
+            uint16_t sources = read16(entry + 2);
+            record(entry[0], sources, vlan, entry + 4, true, port, now);
+            offset += 20 + 16 * sources + 4 * entry[1];
+        }
+        return MulticastMessage::Report;
+    }
+    default:
+        return MulticastMessage::None;
+    }
+}
+
+// an include record without sources is a leave, blocking sources doesn't change who gets the group
+void MulticastTable::record(uint8_t type, uint16_t sources, uint16_t vlan, const uint8_t *group, bool ipv6,
+                            uint32_t port, int64_t now)
+{
+    if (type == BLOCK_OLD_SOURCES)
+    {
+        return;
+    }
+    if ((type == MODE_IS_INCLUDE || type == CHANGE_TO_INCLUDE) && sources == 0)
+    {
+        leave(vlan, group, ipv6, port, now);
+        return;
+    }
+    join(vlan, group, ipv6, port, now);
+}
+
+void MulticastTable::join(uint16_t vlan, const uint8_t *group, bool ipv6, uint32_t port, int64_t now)
+{
+    uint64_t mac = groupMac(group, ipv6);
+    if (!multicastGroup(group, ipv6) || reserved(mac))
+    {
+        return;
+    }
+
+    uint64_t key = vlanKey(vlan, mac);
+    size_t slot = locate(key);
+    if (slot == NO_GROUP)
+    {
+        slot = insert(key);
+        if (slot == NO_GROUP)
+        {
+            overflows_m.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    auto & entry = entries_m[slot];
+    entry.expires[port] = now + membershipInterval_m;
+    std::memcpy(entry.address, group, ipv6 ? 16 : 4);
+    entry.ipv6 = ipv6;
+    entry.members.fetch_or(PortMask(1) << port, std::memory_order_relaxed);
+}
+
+// the querier asks the port whether anyone else is still in the group, a member that is answers in time
+void MulticastTable::leave(uint16_t vlan, const uint8_t *group, bool ipv6, uint32_t port, int64_t now)
+{
+    size_t slot = locate(vlanKey(vlan, groupMac(group, ipv6)));
+    if (slot == NO_GROUP)
+    {
+        return;
+    }
+    auto & entry = entries_m[slot];
+    entry.expires[port] = std::min(entry.expires[port], now + MULTICAST_LAST_MEMBER_TIME.count());
+}
+
+void MulticastTable::query(uint32_t port, int64_t interval, int64_t now)
+{
+    if (interval != 0)
+    {
+        membershipInterval_m = interval;
+    }
+    routerExpires_m[port] = now + MULTICAST_QUERIER_INTERVAL.count();
+    routers_m.fetch_or(PortMask(1) << port, std::memory_order_relaxed);
+}
+
+size_t MulticastTable::locate(uint64_t key) const
+{
+    for (size_t probe = 0, slot = hash(key) & mask_m; probe <= mask_m; probe++, slot = (slot + 1) & mask_m)
+    {
+        uint64_t current = entries_m[slot].key.load(std::memory_order_relaxed);
+        if (current == key)
+        {
+            return slot;
+        }
+        if (current == EMPTY)
+        {
+            return NO_GROUP;
+        }
+    }
+    return NO_GROUP;
+}
+
+// a new entry is complete before its key is, a reader that finds the key finds the entry cleared
+size_t MulticastTable::insert(uint64_t key)
+{
+    if (size_m >= capacity_m)
+    {
+        return NO_GROUP;
+    }
+    for (size_t probe = 0, slot = hash(key) & mask_m; probe <= mask_m; probe++, slot = (slot + 1) & mask_m)
+    {
+        auto & entry = entries_m[slot];
+        uint64_t current = entry.key.load(std::memory_order_relaxed);
+        if (current != EMPTY && current != TOMBSTONE)
+        {
+            continue;
+        }
+
+        entry.members.store(0, std::memory_order_relaxed);
+        entry.frames.store(0, std::memory_order_relaxed);
+        entry.bytes.store(0, std::memory_order_relaxed);
+        std::fill_n(entry.expires, MAX_PORTS, 0);
+        std::fill_n(entry.address, sizeof(entry.address), 0);
+        entry.ipv6 = false;
+        entry.key.store(key, std::memory_order_release);
+        size_m++;
+        return slot;
+    }
+    return NO_GROUP;
+}
+
+// the tombstone keeps the probe sequences of the other keys going, unless nothing follows it
+void MulticastTable::erase(size_t slot)
+{
+    auto & entry = entries_m[slot];
+    entry.key.store(TOMBSTONE, std::memory_order_release);
+    entry.members.store(0, std::memory_order_relaxed);
+    size_m--;
+
+    while (entries_m[(slot + 1) & mask_m].key.load(std::memory_order_relaxed) == EMPTY &&
+           entries_m[slot].key.load(std::memory_order_relaxed) == TOMBSTONE)
+    {
+        entries_m[slot].key.store(EMPTY, std::memory_order_release);
+        slot = (slot - 1) & mask_m;
+    }
+}
+
+void MulticastTable::sweep(steady_clock::time_point now)
+{
+    int64_t time = stamp(now);
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t slot = 0; slot <= mask_m; slot++)
+    {
+        auto & entry = entries_m[slot];
+        uint64_t key = entry.key.load(std::memory_order_relaxed);
+        if (key == EMPTY || key == TOMBSTONE)
+        {
+            continue;
+        }
+
+        PortMask members = entry.members.load(std::memory_order_relaxed);
+        for (PortMask left = members; left != 0; left &= left - 1)
+        {
+            uint32_t port = __builtin_ctz(left);
+            if (entry.expires[port] <= time)
+            {
+                members &= ~(PortMask(1) << port);
+            }
+        }
+        entry.members.store(members, std::memory_order_relaxed);
+        if (members == 0)
+        {
+            erase(slot);
+        }
+    }
+
+    PortMask routers = routers_m.load(std::memory_order_relaxed);
+    for (PortMask left = routers; left != 0; left &= left - 1)
+    {
+        uint32_t port = __builtin_ctz(left);
+        if (routerExpires_m[port] <= time)
+        {
+            routers &= ~(PortMask(1) << port);
+        }
+    }
+    routers_m.store(routers, std::memory_order_relaxed);
+}
+
+void MulticastTable::clear()
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t slot = 0; slot <= mask_m; slot++)
+    {
+        entries_m[slot].key.store(EMPTY, std::memory_order_release);
+        entries_m[slot].members.store(0, std::memory_order_relaxed);
+    }
+    size_m = 0;
+    routers_m.store(0, std::memory_order_relaxed);
+    std::fill_n(routerExpires_m, MAX_PORTS, 0);
+    membershipInterval_m = MULTICAST_MEMBERSHIP_INTERVAL.count();
+}
+
+vector<MulticastGroup> MulticastTable::groups() const
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    vector<MulticastGroup> groups;
+    groups.reserve(size_m);
+    for (size_t slot = 0; slot <= mask_m; slot++)
+    {
+        const auto & entry = entries_m[slot];
+        uint64_t key = entry.key.load(std::memory_order_relaxed);
+        if (key == EMPTY || key == TOMBSTONE)
+        {
+            continue;
+        }
+
+        MulticastGroup group{};
+        group.vlan = keyVlan(key);
+        group.mac = keyMac(key);
+        std::memcpy(group.address, entry.address, sizeof(group.address));
+        group.ipv6 = entry.ipv6;
+        group.members = entry.members.load(std::memory_order_relaxed);
+        group.frames = entry.frames.load(std::memory_order_relaxed);
+        group.bytes = entry.bytes.load(std::memory_order_relaxed);
+        groups.push_back(group);
+    }
+    return groups;
+}
+
+size_t MulticastTable::size() const
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    return size_m;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "port_table.h"
+#include "settings.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using std::chrono::steady_clock, std::chrono::milliseconds;
+using std::vector, std::unique_ptr;
+
+// what snooping made of a frame sent to a multicast address
+enum class MulticastMessage
+{
+    None,   // not IGMP or MLD, data for a group
+    Query,  // from a multicast router, goes to every port
+    Report, // a join or a leave of a host, goes to the multicast routers
+};
+
+// a multicast group as shown to the user
+struct MulticastGroup
+{
+    uint16_t vlan;
+    uint64_t mac;         // see macKey()
+    uint8_t address[16];  // the last IP group reported for the MAC address, an IPv4 one takes the first 4 bytes
+    bool ipv6;
+    PortTable::PortMask members;
+    uint64_t frames;
+    uint64_t bytes;
+};
+
+// the multicast groups hosts have joined with IGMPv2/v3 or MLDv1/v2, per VLAN and group MAC address,
+// with the ports that have members, and the ports that queries came in on, which lead to multicast routers
+// several IP groups map to the same MAC address, they share an entry and go to the members of all of them,
+// sources aren't tracked, a host that joins a group with sources gets every source
+//
+// the memberships age by the interval the querier announces, a leave shortens it to the last member query time,
+// the router ports age by the other querier present interval
+// lookups never block, an open-addressing table of fixed capacity that the entries never move in,
+// snooping and aging take the writer lock
+struct MulticastTable
+{
+public:
+    using PortMask = PortTable::PortMask;
+    static constexpr uint32_t NO_GROUP = UINT32_MAX;
+
+    MulticastTable(uint32_t capacity = MULTICAST_GROUPS);
+    MulticastTable(MulticastTable &&) = delete;
+    MulticastTable(const MulticastTable &) = delete;
+    MulticastTable & operator=(MulticastTable &&) = delete;
+    MulticastTable & operator=(const MulticastTable &) = delete;
+
+public:
+    // the ports with members of the group of key, a vlanKey(), lock-free
+    // group is the index to count the frame to, NO_GROUP if no host joined the group
+    PortMask lookup(uint64_t key, uint32_t & group) const;
+    PortMask routers() const;
+    void count(uint32_t group, uint64_t frames, uint64_t bytes);
+
+    // learns from an IGMP or MLD message that came in on the port, a logical port of the port table
+    MulticastMessage snoop(const uint8_t *frame, uint32_t size, uint16_t vlan, uint32_t port);
+
+    // the groups of 224.0.0.0/24 and the link-local IPv6 ones, they always go to every port
+    static bool reserved(uint64_t mac);
+
+    void sweep(steady_clock::time_point now); // drops the expired members and routers
+    void clear();
+    vector<MulticastGroup> groups() const;
+    size_t size() const;
+    int64_t overflows() const; // groups not learned because the table was full
+
+private:
+    static constexpr uint64_t EMPTY = 0; // VLAN 0 is never a key
+    static constexpr uint64_t TOMBSTONE = UINT64_MAX;
+    static constexpr uint32_t MAX_PORTS = PortTable::MAX_PORTS;
+
+    struct alignas(64) Entry
+    {
+        std::atomic<uint64_t> key;
+        std::atomic<PortMask> members;
+        std::atomic<uint64_t> frames;
+        std::atomic<uint64_t> bytes;
+        int64_t expires[MAX_PORTS]; // milliseconds of steady_clock, under the writer lock
+        uint8_t address[16];
+        bool ipv6;
+    };
+
+    static size_t hash(uint64_t key);
+    static int64_t stamp(steady_clock::time_point time); // in milliseconds
+
+    // the IP group, 4 or 16 bytes, is mapped to its MAC address
+    void join(uint16_t vlan, const uint8_t *group, bool ipv6, uint32_t port, int64_t now);
+    void leave(uint16_t vlan, const uint8_t *group, bool ipv6, uint32_t port, int64_t now);
+    void query(uint32_t port, int64_t interval, int64_t now); // interval 0 keeps the membership interval
+    void record(uint8_t type, uint16_t sources, uint16_t vlan, const uint8_t *group, bool ipv6, uint32_t port,
+                int64_t now); // a group record of an IGMPv3 or MLDv2 report
+
+    MulticastMessage snoopIgmp(const uint8_t *message, uint32_t size, uint16_t vlan, uint32_t port);
+    MulticastMessage snoopMld(const uint8_t *message, uint32_t size, uint16_t vlan, uint32_t port);
+
+    size_t locate(uint64_t key) const; // under the writer lock, the slot of the key or NO_GROUP
+    size_t insert(uint64_t key);      // under the writer lock, NO_GROUP if the table is full
+    void erase(size_t slot);
+
+private:
+    unique_ptr<Entry[]> entries_m;
+    size_t mask_m;
+    size_t capacity_m;
+    size_t size_m;
+    std::atomic<PortMask> routers_m;
+    int64_t routerExpires_m[MAX_PORTS];
+    int64_t membershipInterval_m; // milliseconds, from the queries
+    std::atomic<int64_t> overflows_m;
+    mutable std::mutex writer_m;
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline size_t MulticastTable::hash(uint64_t key)
+{
+    return static_cast<size_t>((key * 0x9e3779b97f4a7c15) >> 32);
+}
+
+inline int64_t MulticastTable::stamp(steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+// an entry can be dropped and taken by another group while it is read, the key is read again to tell
+inline MulticastTable::PortMask MulticastTable::lookup(uint64_t key, uint32_t & group) const
+{
+    group = NO_GROUP;
+    for (size_t probe = 0, slot = hash(key) & mask_m; probe <= mask_m; probe++, slot = (slot + 1) & mask_m)
+    {
+        const auto & entry = entries_m[slot];
+        uint64_t current = entry.key.load(std::memory_order_acquire);
+        if (current == EMPTY)
+        {
+            return 0;
+        }
+        if (current != key)
+        {
+            continue;
+        }
+
+        PortMask members = entry.members.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.key.load(std::memory_order_relaxed) != key)
+        {
+            return 0;
+        }
+        group = static_cast<uint32_t>(slot);
+        return members;
+    }
+    return 0;
+}
+
+inline MulticastTable::PortMask MulticastTable::routers() const
+{
+    return routers_m.load(std::memory_order_relaxed);
+}
+
+inline void MulticastTable::count(uint32_t group, uint64_t frames, uint64_t bytes)
+{
+    if (group > mask_m)
+    {
+        return;
+    }
+    entries_m[group].frames.fetch_add(frames, std::memory_order_relaxed);
+    entries_m[group].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// 01:00:5e:00:00:xx and 33:33:00:00:00:xx
+inline bool MulticastTable::reserved(uint64_t mac)
+{
+    return (mac >> 8) == 0x01005e0000 || (mac >> 8) == 0x3333000000;
+}
+
+inline int64_t MulticastTable::overflows() const
+{
+    return overflows_m.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,478 @@
+#include "neighbor_table.h"
+#include "mac_table.h"
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint32_t ETHERNET_TYPE_OFFSET = 12;
+static constexpr uint16_t ETHERTYPE_ARP = 0x0806;
+static constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+static constexpr uint32_t ARP_SIZE = 28;
+static constexpr uint16_t ARP_REQUEST = 1;
+static constexpr uint16_t ARP_REPLY = 2;
+static constexpr uint32_t ARP_FRAME_SIZE = 60; // the shortest Ethernet frame without the FCS
+static constexpr uint8_t IP_PROTOCOL_ICMPV6 = 58;
+static constexpr uint8_t ND_HOP_LIMIT = 255;   // anything else crossed a router and is ignored, RFC 4861
+static constexpr uint8_t ND_SOLICITATION = 135;
+static constexpr uint8_t ND_ADVERTISEMENT = 136;
+static constexpr uint8_t ND_SOURCE_ADDRESS = 1; // the link-layer address options
+static constexpr uint8_t ND_TARGET_ADDRESS = 2;
+static constexpr uint8_t NA_ROUTER = 0x80;
+static constexpr uint8_t NA_SOLICITED = 0x40;
+static constexpr uint8_t NA_OVERRIDE = 0x20;
+static constexpr uint32_t ND_SIZE = 24;         // up to the options
+
+static uint16_t read16(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+static uint64_t read64(const uint8_t *data)
+{
+    uint64_t word = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        word = (word << 8) | data[i];
+    }
+    return word;
+}
+
+static void writeMac(uint8_t *data, uint64_t mac)
+{
+    for (int byte = 0; byte < 6; byte++)
+    {
+        data[byte] = (mac >> (40 - 8 * byte)) & 0xff;
+    }
+}
+
+static bool zero(const uint8_t *data, size_t size)
+{
+    return std::all_of(data, data + size, [](uint8_t byte) { return byte == 0; });
+}
+
+// over the IPv6 pseudo-header and the ICMPv6 message
+static uint16_t icmpv6Checksum(const uint8_t *ip, const uint8_t *message, uint32_t size)
+{
+    uint32_t sum = IP_PROTOCOL_ICMPV6 + size;
+    for (uint32_t i = 8; i < 40; i += 2)
+    {
+        sum += read16(ip + i);
+    }
+    for (uint32_t i = 0; i + 1 < size; i += 2)
+    {
+        sum += read16(message + i);
+    }
+    if (size % 2 != 0)
+    {
+        sum += message[size - 1] << 8;
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+
+// sized for at most half of the slots taken
+NeighborTable::NeighborTable(uint32_t capacity)
+    : entries_m(nullptr),
+      mask_m(0),
+      capacity_m(capacity),
+      size_m(0),
+      overflows_m(0),
+      writer_m{}
+{
+    size_t slots = 1;
+    while (slots < static_cast<size_t>(capacity_m) * 2)
+    {
+        slots <<= 1;
+    }
+    entries_m.reset(new Entry[slots]());
+    mask_m = slots - 1;
+}
+
+NeighborTable::Key NeighborTable::makeKey(uint16_t vlan, bool ipv6, const uint8_t *address)
+{
+    if (ipv6)
+    {
+        return {{USED | IPV6 | vlan, read64(address), read64(address + 8)}};
+    }
+    return {{USED | vlan, 0, static_cast<uint64_t>(read16(address)) << 16 | read16(address + 2)}};
+}
+
+bool NeighborTable::find(const Key & key, size_t & slot, uint64_t & mac) const
+{
+    for (size_t probe = 0, index = hash(key) & mask_m; probe <= mask_m; probe++, index = (index + 1) & mask_m)
+    {
+        const auto & entry = entries_m[index];
+        bool empty = false;
+        bool found = false;
+        while (true)
+        {
+            uint32_t sequence = entry.sequence.load(std::memory_order_acquire);
+            if (sequence % 2 != 0)
+            {
+                spinPause();
+                continue;
+            }
+
+            uint64_t first = entry.key[0].load(std::memory_order_relaxed);
+            empty = first == EMPTY;
+            found = first == key.words[0] && entry.key[1].load(std::memory_order_relaxed) == key.words[1] &&
+                    entry.key[2].load(std::memory_order_relaxed) == key.words[2];
+            mac = entry.mac.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.sequence.load(std::memory_order_relaxed) == sequence)
+            {
+                break;
+            }
+            spinPause();
+        }
+
+        if (found)
+        {
+            slot = index;
+            return true;
+        }
+        if (empty)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+void NeighborTable::write(Entry & entry, const Key & key, uint64_t mac, int64_t expires)
+{
+    entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int word = 0; word < 3; word++)
+    {
+        entry.key[word].store(key.words[word], std::memory_order_relaxed);
+    }
+    entry.mac.store(mac, std::memory_order_relaxed);
+    entry.expires.store(expires, std::memory_order_relaxed);
+    entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// a binding seen again only has its expiry pushed back, without the lock
+// only a neighbor advertisement says whether the host is a router, the rest keep what it said
+void NeighborTable::learn(uint16_t vlan, bool ipv6, const uint8_t *address, uint64_t mac, bool advertised,
+                          bool router)
+{
+    Key key = makeKey(vlan, ipv6, address);
+    int64_t expires = stamp(steady_clock::now()) + NEIGHBOR_TIMEOUT.count();
+    size_t slot = 0;
+    uint64_t current = 0;
+    bool known = find(key, slot, current);
+    uint64_t value = mac | ((advertised ? router : (known && (current & ROUTER))) ? ROUTER : 0);
+    if (known && current == value)
+    {
+        entries_m[slot].expires.store(expires, std::memory_order_relaxed);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(writer_m);
+    if (find(key, slot, current))
+    {
+        write(entries_m[slot], key, value, expires);
+        return;
+    }
+    if (size_m >= capacity_m)
+    {
+        overflows_m.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (size_t probe = 0, index = hash(key) & mask_m; probe <= mask_m; probe++, index = (index + 1) & mask_m)
+    {
+        uint64_t first = entries_m[index].key[0].load(std::memory_order_relaxed);
+        if (first == EMPTY || first == TOMBSTONE)
+        {
+            write(entries_m[index], key, value, expires);
+            size_m++;
+            return;
+        }
+    }
+}
+
+// the frame may still carry its VLAN tags, the ARP packet or the IPv6 header follows them
+bool NeighborTable::snoop(const uint8_t *frame, uint32_t size, uint16_t vlan, NeighborQuery & query)
+{
+    if (size < ETHERNET_TYPE_OFFSET + 2)
+    {
+        return false;
+    }
+    uint32_t offset = ETHERNET_TYPE_OFFSET;
+    uint16_t etherType = read16(frame + offset);
+    while ((etherType == 0x8100 || etherType == 0x88a8) && offset + 6 <= size)
+    {
+        offset += 4;
+        etherType = read16(frame + offset);
+    }
+    offset += 2;
+
+    uint64_t source = macKey(frame + 6);
+    if (etherType == ETHERTYPE_ARP)
+    {
+        return snoopArp(frame + offset, size - offset, source, vlan, query);
+    }
+    if (etherType == ETHERTYPE_IPV6)
+    {
+        return snoopNd(frame + offset, size - offset, source, vlan, query);
+    }
+    return false;
+}
+
+// probes and gratuitous ARP are left to the hosts, they detect conflicts with them
+// a sender address other than the Ethernet source would let any host take over the binding of another,
+// such a packet is neither learned from nor answered
+bool NeighborTable::snoopArp(const uint8_t *arp, uint32_t size, uint64_t source, uint16_t vlan, NeighborQuery & query)
+{
+    if (size < ARP_SIZE || read16(arp) != 1 || read16(arp + 2) != 0x0800 || arp[4] != 6 || arp[5] != 4)
+    {
+        return false;
+    }
+    const uint8_t *senderMac = arp + 8;
+    const uint8_t *sender = arp + 14;
+    const uint8_t *target = arp + 24;
+    bool probe = zero(sender, 4);
+    if (macKey(senderMac) != source)
+    {
+        return false;
+    }
+    if (!probe && (senderMac[0] & 1) == 0)
+    {
+        learn(vlan, false, sender, macKey(senderMac), false, false);
+    }
+    if (read16(arp + 6) != ARP_REQUEST || probe || std::memcmp(sender, target, 4) == 0)
+    {
+        return false;
+    }
+
+    query = {};
+    query.ipv6 = false;
+    query.vlan = vlan;
+    std::memcpy(query.target, target, 4);
+    std::memcpy(query.requester, sender, 4);
+    query.requesterMac = source;
+    return true;
+}
+
+// a solicitation for duplicate address detection comes from the unspecified address, it is left to the hosts
+// the link-layer address option has to be the Ethernet source, as the sender address of ARP
+bool NeighborTable::snoopNd(const uint8_t *ip, uint32_t size, uint64_t source, uint16_t vlan, NeighborQuery & query)
+{
+    if (size < 40 + ND_SIZE || (ip[0] >> 4) != 6 || ip[6] != IP_PROTOCOL_ICMPV6 || ip[7] != ND_HOP_LIMIT)
+    {
+        return false;
+    }
+    uint32_t length = std::min<uint32_t>(read16(ip + 4), size - 40);
+    const uint8_t *message = ip + 40;
+    uint8_t type = message[0];
+    if (length < ND_SIZE || (type != ND_SOLICITATION && type != ND_ADVERTISEMENT))
+    {
+        return false;
+    }
+    const uint8_t *target = message + 8;
+    if (target[0] == 0xff)
+    {
+        return false;
+    }
+
+    uint64_t optionMac = 0;
+    bool option = false;
+    uint8_t wanted = type == ND_SOLICITATION ? ND_SOURCE_ADDRESS : ND_TARGET_ADDRESS;
+    for (uint32_t offset = ND_SIZE; offset + 8 <= length;)
+    {
+        uint32_t optionSize = message[offset + 1] * 8;
+        if (optionSize == 0 || offset + optionSize > length)
+        {
+            break;
+        }
+        if (message[offset] == wanted)
+        {
+            optionMac = macKey(message + offset + 2);
+            option = true;
+        }
+        offset += optionSize;
+    }
+    if (option && optionMac != source)
+    {
+        return false;
+    }
+
+    if (type == ND_ADVERTISEMENT)
+    {
+        learn(vlan, true, target, source, true, (message[4] & NA_ROUTER) != 0);
+        return false;
+    }
+
+    const uint8_t *sender = ip + 8;
+    if (zero(sender, 16))
+    {
+        return false;
+    }
+    if (option)
+    {
+        learn(vlan, true, sender, source, false, false);
+    }
+
+    query = {};
+    query.ipv6 = true;
+    query.vlan = vlan;
+    std::memcpy(query.target, target, 16);
+    std::memcpy(query.requester, sender, 16);
+    query.requesterMac = source;
+    return true;
+}
+
+bool NeighborTable::resolve(const NeighborQuery & query, uint64_t & mac, bool & router) const
+{
+    size_t slot = 0;
+    uint64_t value = 0;
+    if (!find(makeKey(query.vlan, query.ipv6, query.target), slot, value))
+    {
+        return false;
+    }
+    mac = keyMac(value);
+    router = (value & ROUTER) != 0;
+    return true;
+}
+
+// the neighbor advertisement is solicited and overrides the cache of the requester, as the host itself would
+uint32_t NeighborTable::reply(const NeighborQuery & query, uint64_t mac, bool router, uint64_t source,
+                              uint8_t *frame)
+{
+    writeMac(frame, query.requesterMac);
+    writeMac(frame + 6, source);
+    if (!query.ipv6)
+    {
+        std::memset(frame + ETHERNET_TYPE_OFFSET, 0, ARP_FRAME_SIZE - ETHERNET_TYPE_OFFSET);
+        frame[12] = ETHERTYPE_ARP >> 8;
+        frame[13] = ETHERTYPE_ARP & 0xff;
+        uint8_t *arp = frame + 14;
+        arp[1] = 1;
+        arp[2] = 0x08;
+        arp[4] = 6;
+        arp[5] = 4;
+        arp[7] = ARP_REPLY;
+        writeMac(arp + 8, mac);
+        std::memcpy(arp + 14, query.target, 4);
+        writeMac(arp + 18, query.requesterMac);
+        std::memcpy(arp + 24, query.requester, 4);
+        return ARP_FRAME_SIZE;
+    }
+
+    static constexpr uint32_t MESSAGE_SIZE = ND_SIZE + 8;
+    std::memset(frame + ETHERNET_TYPE_OFFSET, 0, REPLY_SIZE - ETHERNET_TYPE_OFFSET);
+    frame[12] = ETHERTYPE_IPV6 >> 8;
+    frame[13] = ETHERTYPE_IPV6 & 0xff;
+    uint8_t *ip = frame + 14;
+    ip[0] = 0x60;
+    ip[5] = MESSAGE_SIZE;
+    ip[6] = IP_PROTOCOL_ICMPV6;
+    ip[7] = ND_HOP_LIMIT;
+    std::memcpy(ip + 8, query.target, 16);
+    std::memcpy(ip + 24, query.requester, 16);
+
+    uint8_t *message = ip + 40;
+    message[0] = ND_ADVERTISEMENT;
+    message[4] = NA_SOLICITED | NA_OVERRIDE | (router ? NA_ROUTER : 0);
+    std::memcpy(message + 8, query.target, 16);
+    message[ND_SIZE] = ND_TARGET_ADDRESS;
+    message[ND_SIZE + 1] = 1;
+    writeMac(message + ND_SIZE + 2, mac);
+    uint16_t checksum = icmpv6Checksum(ip, message, MESSAGE_SIZE);
+    message[2] = checksum >> 8;
+    message[3] = checksum & 0xff;
+    return 14 + 40 + MESSAGE_SIZE;
+}
+
+// a tombstone keeps the probe sequences of the other keys going, unless nothing follows it
+void NeighborTable::sweep(steady_clock::time_point now)
+{
+    int64_t time = stamp(now);
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t slot = 0; slot <= mask_m; slot++)
+    {
+        auto & entry = entries_m[slot];
+        uint64_t first = entry.key[0].load(std::memory_order_relaxed);
+        if (first == EMPTY || first == TOMBSTONE || entry.expires.load(std::memory_order_relaxed) > time)
+        {
+            continue;
+        }
+
+        write(entry, {{TOMBSTONE, 0, 0}}, 0, 0);
+        size_m--;
+        for (size_t last = slot; entries_m[(last + 1) & mask_m].key[0].load(std::memory_order_relaxed) == EMPTY &&
+                                 entries_m[last].key[0].load(std::memory_order_relaxed) == TOMBSTONE;
+             last = (last - 1) & mask_m)
+        {
+            write(entries_m[last], {{EMPTY, 0, 0}}, 0, 0);
+        }
+    }
+}
+
+void NeighborTable::clear()
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    for (size_t slot = 0; slot <= mask_m; slot++)
+    {
+        if (entries_m[slot].key[0].load(std::memory_order_relaxed) != EMPTY)
+        {
+            write(entries_m[slot], {{EMPTY, 0, 0}}, 0, 0);
+        }
+    }
+    size_m = 0;
+}
+
+vector<NeighborEntry> NeighborTable::entries(steady_clock::time_point now) const
+{
+    int64_t time = stamp(now);
+    std::lock_guard<std::mutex> lock(writer_m);
+    vector<NeighborEntry> entries;
+    entries.reserve(size_m);
+    for (size_t slot = 0; slot <= mask_m; slot++)
+    {
+        const auto & entry = entries_m[slot];
+        uint64_t first = entry.key[0].load(std::memory_order_relaxed);
+        if (first == EMPTY || first == TOMBSTONE)
+        {
+            continue;
+        }
+
+        NeighborEntry neighbor{};
+        neighbor.vlan = static_cast<uint16_t>(first & 0xfff);
+        neighbor.ipv6 = (first & IPV6) != 0;
+        uint64_t words[2] = {
+            entry.key[1].load(std::memory_order_relaxed),
+            entry.key[2].load(std::memory_order_relaxed),
+        };
+        if (neighbor.ipv6)
+        {
+            for (int byte = 0; byte < 16; byte++)
+            {
+                neighbor.address[byte] = (words[byte / 8] >> (56 - 8 * (byte % 8))) & 0xff;
+            }
+        }
+        else
+        {
+            for (int byte = 0; byte < 4; byte++)
+            {
+                neighbor.address[byte] = (words[1] >> (24 - 8 * byte)) & 0xff;
+            }
+        }
+        uint64_t mac = entry.mac.load(std::memory_order_relaxed);
+        neighbor.mac = keyMac(mac);
+        neighbor.router = (mac & ROUTER) != 0;
+        neighbor.timeLeft = milliseconds(std::max<int64_t>(entry.expires.load(std::memory_order_relaxed) - time, 0));
+        entries.push_back(neighbor);
+    }
+    return entries;
+}
+
+size_t NeighborTable::size() const
+{
+    std::lock_guard<std::mutex> lock(writer_m);
+    return size_m;
+}
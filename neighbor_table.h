@@ -0,0 +1,130 @@
+#pragma once
+
+#include "settings.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using std::chrono::steady_clock, std::chrono::milliseconds;
+using std::vector, std::unique_ptr;
+
+// an ARP request or an IPv6 neighbor solicitation the switch may answer for the target
+struct NeighborQuery
+{
+    bool ipv6;
+    uint16_t vlan;
+    uint8_t target[16];    // an IPv4 address takes the first 4 bytes
+    uint8_t requester[16];
+    uint64_t requesterMac; // see macKey()
+};
+
+// an IP address learned from ARP or neighbor discovery, as shown to the user
+struct NeighborEntry
+{
+    uint16_t vlan;
+    bool ipv6;
+    uint8_t address[16];
+    uint64_t mac;
+    bool router;
+    milliseconds timeLeft;
+};
+
+// the IP to MAC bindings of the hosts, per VLAN, snooped from every ARP packet and every neighbor
+// solicitation and advertisement, so the switch can answer a request for a known host itself
+// instead of flooding it
+// an entry is a few words, an open-addressing table of fixed capacity with a sequence number per entry,
+// odd while it is written, lookups and refreshing a known binding never block, new and changed bindings
+// and aging take the writer lock
+struct NeighborTable
+{
+public:
+    NeighborTable(uint32_t capacity = NEIGHBOR_TABLE_CAPACITY);
+    NeighborTable(NeighborTable &&) = delete;
+    NeighborTable(const NeighborTable &) = delete;
+    NeighborTable & operator=(NeighborTable &&) = delete;
+    NeighborTable & operator=(const NeighborTable &) = delete;
+
+public:
+    // learns the bindings in an ARP or neighbor discovery packet, the frame may still be VLAN tagged
+    // returns whether it is a request that could be answered, query is filled in then
+    bool snoop(const uint8_t *frame, uint32_t size, uint16_t vlan, NeighborQuery & query);
+
+    // the MAC address of the target of the query and whether it is a router, lock-free
+    bool resolve(const NeighborQuery & query, uint64_t & mac, bool & router) const;
+
+    // writes the ARP reply or the neighbor advertisement for the query into frame, untagged, from the address
+    // of the switch port, returns its size, at most REPLY_SIZE
+    static uint32_t reply(const NeighborQuery & query, uint64_t mac, bool router, uint64_t source, uint8_t *frame);
+    static constexpr uint32_t REPLY_SIZE = 86;
+
+    void sweep(steady_clock::time_point now); // drops the bindings not seen for NEIGHBOR_TIMEOUT
+    void clear();
+    vector<NeighborEntry> entries(steady_clock::time_point now) const;
+    size_t size() const;
+    int64_t overflows() const; // bindings not learned because the table was full
+
+private:
+    static constexpr uint64_t EMPTY = 0;
+    static constexpr uint64_t TOMBSTONE = UINT64_MAX;
+    static constexpr uint64_t USED = uint64_t(1) << 62;
+    static constexpr uint64_t IPV6 = uint64_t(1) << 61;
+    static constexpr uint64_t ROUTER = uint64_t(1) << 63;
+
+    // the key is the first three words: the VLAN and the family, then the address, an IPv4 one in the low word
+    struct alignas(64) Entry
+    {
+        std::atomic<uint32_t> sequence;
+        std::atomic<uint64_t> key[3];
+        std::atomic<uint64_t> mac; // the ROUTER bit is set for routers
+        std::atomic<int64_t> expires; // milliseconds of steady_clock
+    };
+
+    struct Key
+    {
+        uint64_t words[3];
+    };
+
+    static Key makeKey(uint16_t vlan, bool ipv6, const uint8_t *address);
+    static size_t hash(const Key & key);
+    static int64_t stamp(steady_clock::time_point time); // in milliseconds
+
+    // slot is where the key is, mac is read with the sequence number checked, lock-free
+    bool find(const Key & key, size_t & slot, uint64_t & mac) const;
+    // advertised is whether it came from a neighbor advertisement, only they tell about router
+    void learn(uint16_t vlan, bool ipv6, const uint8_t *address, uint64_t mac, bool advertised, bool router);
+    bool snoopArp(const uint8_t *arp, uint32_t size, uint64_t source, uint16_t vlan, NeighborQuery & query);
+    bool snoopNd(const uint8_t *ip, uint32_t size, uint64_t source, uint16_t vlan, NeighborQuery & query);
+    void write(Entry & entry, const Key & key, uint64_t mac, int64_t expires); // under the writer lock
+
+private:
+    unique_ptr<Entry[]> entries_m;
+    size_t mask_m;
+    size_t capacity_m;
+    size_t size_m;
+    std::atomic<int64_t> overflows_m;
+    mutable std::mutex writer_m;
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline size_t NeighborTable::hash(const Key & key)
+{
+    uint64_t hashed = (key.words[0] ^ key.words[1] * 0xc2b2ae3d27d4eb4f ^ key.words[2]) * 0x9e3779b97f4a7c15;
+    return static_cast<size_t>(hashed >> 32);
+}
+
+inline int64_t NeighborTable::stamp(steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<milliseconds>(time.time_since_epoch()).count();
+}
+
+inline int64_t NeighborTable::overflows() const
+{
+    return overflows_m.load(std::memory_order_relaxed);
+}
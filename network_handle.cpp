@@ -1,276 +1,804 @@
 #include "network_handle.h"
+#include "frame_hash.h"
+#include "packet_ring.h"
 #include "shared_storage.h"
 #include "shared_storage_handle.h"
+#include <algorithm>
+#include <cstring>
 #include <qlogging.h>
 #include <thread>
-#include <tins/ethernetII.h>
+#include <pcap.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <tins/exceptions.h>
-#include <tins/packet_sender.h>
-#include <tins/pdu.h>
 
 void NetworkThreadHandle::start()
 {
+    uint32_t workers = workerCount_m;
+
     {
         auto guard = storageHandle_m.guard();
-        guard.storage.interfaces[interface_m] = {};
-        guard.storage.interfaces[interface_m].control.running = true;
-        guard.storage.interfaces[interface_m].up = true;
+        entry_m = &guard.storage.interfaces[interface_m];
+        *entry_m = {};
+        entry_m->control.running = true;
+        entry_m->up = true;
+        entry_m->workers = workers;
+        port_m = guard->ports.index(interface_m);
+        address_m = port_m == PortTable::NO_PORT ? 0 : guard->ports.address(port_m);
     }
 
     // the actual start
-    thread_m = std::thread(&NetworkThreadHandle::thread, this);
+    {
+        auto statistics = storageHandle_m.statistics();
+        for (uint32_t i = 0; i < workers; i++)
+        {
+            workers_m.emplace_back(new Worker(i, "RX " + interface_m.name() + "/" + std::to_string(i)));
+            workers_m.back()->received.reserve(config_m.burstSize);
+            workers_m.back()->statistics = &statistics->statisticsTable.claim();
+        }
+    }
+    for (uint32_t i = 0; i < workers; i++)
+    {
+        threads_m.emplace_back(&NetworkThreadHandle::thread, this, std::ref(*workers_m[i]));
+    }
+    qInfo("Started %u RX workers on %s", workers, interface_m.name().c_str());
 }
 
 void NetworkThreadHandle::signalStop()
 {
-    auto guard = storageHandle_m.guard();
-    guard.storage.interfaces[interface_m].control.running = false;
+    entry_m->control.running = false;
+
+    // never read, it stays readable and wakes up every worker that polls it from now on
+    uint64_t one = 1;
+    if (write(wakeup_m, &one, sizeof(one)) < 0)
+    {
+        qWarning("Cannot wake up the workers of %s: %s", interface_m.name().c_str(), std::strerror(errno));
+    }
 }
 
 // the network thread function itself
-void NetworkThreadHandle::thread()
+void NetworkThreadHandle::thread(Worker & worker)
+{
+    int cpu = worker.index < config_m.rxCpus.size() ? config_m.rxCpus[worker.index] : -1;
+    worker.latency = tuneThread(worker.latency.thread, config_m.latency, cpu);
+
+    try
+    {
+        switch (config_m.rxBackend)
+        {
+        case RxBackend::Sniffer:
+            sniffLoop(worker);
+            break;
+        case RxBackend::PacketMmap:
+            ringLoop(worker);
+            break;
+        case RxBackend::Xdp:
+            xdpLoop(worker);
+            break;
+        }
+    }
+    catch (std::runtime_error & e)
+    {
+        qWarning("Thread %s/%u failed: %s", name_m.c_str(), worker.index, e.what());
+    }
+
+    // the last worker to leave marks the interface as finished
+    auto guard = storageHandle_m.guard();
+    auto & entry = guard.storage.interfaces[interface_m];
+    entry.workers--;
+    if (entry.workers == 0)
+    {
+        entry.control.finished = true;
+    }
+    qInfo("Thread %s/%u is down", name_m.c_str(), worker.index);
+}
+
+void NetworkThreadHandle::sniffLoop(Worker & worker)
 {
     Tins::SnifferConfiguration config;
     config.set_promisc_mode(true);
     config.set_immediate_mode(true);
-    config.set_timeout(500);
+    config.set_timeout(RX_POLL_TIMEOUT.count());
     Tins::Sniffer reader(interface_m.name(), config);
-    reader.sniff_loop([&](Tins::PDU & packet) {
-        qInfo("Received a packet!");
-        if (!packet.find_pdu<Tins::EthernetII>())
-        {
-            qInfo("Non-EthernetII packet");
 
-            auto guard = storageHandle_m.guard();
-            return guard.storage.interfaces[interface_m].control.running;
-        }
-        auto guard = storageHandle_m.guard();
-        SnifferHelper me(guard, interface_m);
-        auto eth = packet.rfind_pdu<Tins::EthernetII>();
+    // libpcap hands out the captured bytes, libtins would decode every frame into a PDU chain
+    // the bytes are only lent for the duration of the callback, so they are copied into the frame pool
+    // and the TX threads take the pool frames over without another copy
+    pcap_t *handle = reader.get_pcap_handle();
+
+    // the handle never blocks, the worker waits in poll() itself so that a stop can wake it up
+    char error[PCAP_ERRBUF_SIZE];
+    if (pcap_setnonblock(handle, 1, error) < 0)
+    {
+        throw std::runtime_error("Cannot make the capture of " + interface_m.name() + " non-blocking: " + error);
+    }
+    int selectable = pcap_get_selectable_fd(handle);
+    worker.latency.busyPoll = enableBusyPoll(selectable, config_m.latency);
+    worker.latency.log();
+
+    // the frames the switch sends out itself must not come back in
+    if (pcap_setdirection(handle, PCAP_D_IN) < 0)
+    {
+        throw std::runtime_error(string("Cannot capture only incoming frames: ") + pcap_geterr(handle));
+    }
 
-        // is this interface up?
-        if (!me.up())
+    struct Capture
+    {
+        FramePool & pool;
+        vector<FrameView> burst;
+        vector<uint32_t> frames;
+        vector<vector<uint8_t>> oversize; // frames too large for the pool
+    };
+    Capture capture{tx_m->pool(), {}, {}, {}};
+    capture.burst.reserve(config_m.burstSize);
+    capture.frames.reserve(config_m.burstSize);
+
+    // an exhausted pool drops the frame, the pool counts it
+    auto collect = [](u_char *user, const pcap_pkthdr *header, const u_char *data) {
+        auto & capture = *reinterpret_cast<Capture *>(user);
+        uint32_t frame = FramePool::INVALID;
+        const uint8_t *copy = nullptr;
+        if (header->caplen <= capture.pool.frameSize())
         {
-            qDebug("The interface %s is down, skipping", interface_m.hw_address().to_string().c_str());
-            return me.running();
+            frame = capture.pool.allocate();
+            if (frame == FramePool::INVALID)
+            {
+                return;
+            }
+            copy = capture.pool.data(frame);
+            std::memcpy(capture.pool.data(frame), data, header->caplen);
         }
+        else
+        {
+            // counted as oversize once it is forwarded
+            capture.oversize.emplace_back(data, data + header->caplen);
+            copy = capture.oversize.back().data();
+        }
+        capture.burst.push_back({copy, header->caplen, nullptr});
+        capture.frames.push_back(frame);
+    };
 
-        // did we send this packet?
-        if (guard.storage.sentPackets.count(packet) == 1)
+    bool running = true;
+    while (running)
+    {
+        capture.burst.clear();
+        capture.frames.clear();
+        capture.oversize.clear();
+        if (pcap_dispatch(handle, config_m.burstSize, collect, reinterpret_cast<u_char *>(&capture)) < 0)
         {
-            qDebug("Found a duplicate packet on interface %s, skipping",
-                   interface_m.hw_address().to_string().c_str());
-            return me.running();
+            throw std::runtime_error(string("Capture failed: ") + pcap_geterr(handle));
+        }
+        if (capture.burst.empty())
+        {
+            pollfd descriptors[2]{};
+            descriptors[0].fd = selectable;
+            descriptors[0].events = POLLIN;
+            descriptors[1].fd = wakeup_m;
+            descriptors[1].events = POLLIN;
+            poll(descriptors, 2, pollTimeout().count());
+            running = this->running();
+            continue;
         }
 
-        // record the packet as input
-        inputStatistics(packet, interface_m, guard);
+        worker.pooled = capture.frames.data();
+        running = processBurst(capture.burst, worker);
+        worker.pooled = nullptr;
 
-        // did our device send this?
-        if (eth.src_addr() == interface_m.hw_address())
+        // the TX threads hold their own references
+        for (auto frame : capture.frames)
         {
-            qDebug("The packet on interface %s was sent by that interface, skipping",
-                   interface_m.hw_address().to_string().c_str());
-            return me.running();
+            if (frame != FramePool::INVALID)
+            {
+                capture.pool.release(frame);
+            }
         }
+    }
+}
 
-        if (eth.dst_addr()[0] % 2 != 0)
+// frames are switched straight out of the ring blocks, there is no libpcap copy in between
+void NetworkThreadHandle::ringLoop(Worker & worker)
+{
+    RxRing ring(interface_m.name(), config_m.ring);
+    if (workers_m.size() > 1)
+    {
+        joinFanout(ring);
+    }
+    worker.latency.busyPoll = enableBusyPoll(ring.fd(), config_m.latency);
+    worker.latency.log();
+
+    bool running = true;
+    while (running)
+    {
+        if (!ring.wait(pollTimeout(), wakeup_m))
         {
-            qDebug("Detected a multicast, sending it as broadcast");
-            broadcast(packet, guard);
-            return me.running();
+            running = this->running();
+            continue;
         }
 
-        if (eth.dst_addr().is_broadcast())
+        ring.readBlock(config_m.burstSize, [&](const vector<FrameView> & burst) {
+            running = processBurst(burst, worker);
+        });
+    }
+}
+
+// frames stay in the UMEM, forwarding to another AF_XDP port only moves the descriptor
+void NetworkThreadHandle::xdpLoop(Worker & worker)
+{
+    XdpSocket *socket = xdp_m == nullptr ? nullptr : xdp_m->socket(interface_m, worker.index);
+    if (socket == nullptr)
+    {
+        throw std::runtime_error("No AF_XDP socket was set up for " + interface_m.name());
+    }
+    worker.latency.busyPoll = enableBusyPoll(socket->fd(), config_m.latency);
+    worker.latency.log();
+
+    vector<XdpFrame> frames;
+    vector<FrameView> burst;
+    frames.reserve(config_m.burstSize);
+    burst.reserve(config_m.burstSize);
+    bool running = true;
+    while (running)
+    {
+        if (!socket->wait(pollTimeout(), wakeup_m))
         {
-            qDebug("Detected a broadcast address");
-            broadcast(packet, guard);
-            return me.running();
+            running = this->running();
+            continue;
         }
 
-        // update MAC table
-        updateMac(eth.src_addr(), guard);
-
-        // did they send this packet to us?
-        if (eth.dst_addr() == interface_m.hw_address())
+        socket->receive(frames, config_m.burstSize);
+        for (const auto & frame : frames)
         {
-            qDebug("The packet on interface %s was meant for that interface, skipping",
-                   interface_m.hw_address().to_string().c_str());
-            return me.running();
+            burst.push_back({frame.data, frame.size, nullptr});
         }
+        worker.origins = frames.data();
+        running = processBurst(burst, worker);
+        worker.origins = nullptr;
 
-        // is the destination on this device?
-        for (const auto & entry : guard.storage.interfaces)
+        for (const auto & frame : frames)
         {
-            if (eth.dst_addr() == entry.first.hw_address())
+            if (!frame.consumed)
             {
-                qInfo("Switching packet to local device on interface %s", entry.first.hw_address().to_string().c_str());
-                send(packet, entry.first, guard);
-                return me.running();
+                xdp_m->umem().release(frame.address);
             }
         }
+        frames.clear();
+        burst.clear();
+        socket->refill();
+    }
+}
 
-        // is destination address known?
-        if (me.macTable().count(eth.dst_addr()) == 1)
+bool NetworkThreadHandle::processBurst(const vector<FrameView> & burst, Worker & worker)
+{
+    // the frames are parsed first, then switched
+    worker.received.clear();
+    for (uint32_t i = 0; i < burst.size(); i++)
+    {
+        if (burst[i].size < ETHERNET_HEADER_SIZE)
         {
-            // did we get this packet on the same interface that we need to send
-            // it to?
-            if (me.macTable()[eth.dst_addr()].interface == interface_m)
-            {
-                qInfo("The recipient of the packet has already received it, skipping");
-                return me.running();
-            }
-            qInfo("Switching packet using MAC entry");
-            send(packet, me.macTable()[eth.dst_addr()].interface, guard);
-            return me.running();
+            qDebug("Non-EthernetII packet");
+            continue;
         }
+        worker.received.emplace_back(burst[i], worker.origins == nullptr ? nullptr : &worker.origins[i],
+                                     worker.pooled == nullptr ? FramePool::INVALID : worker.pooled[i]);
+    }
+    classify(worker);
 
-        // broadcasting
-        broadcast(packet, guard);
+    // no lock is held while switching, the MAC table and the interface table are read without one
+    for (uint32_t i = 0; i < worker.received.size(); i++)
+    {
+        process(i, worker);
+    }
 
-        return me.running();
-    });
+    transmit(worker);
+    StatisticsTable::recordBurst(*worker.statistics, port_m, burst.size());
+    return running();
+}
 
-    auto guard = storageHandle_m.guard();
-    guard.storage.interfaces[interface_m].control.finished = true;
-    qInfo("Thread %s is down", interface_m.hw_address().to_string().c_str());
+bool NetworkThreadHandle::running() const
+{
+    return entry_m->control.running;
 }
 
-void NetworkThreadHandle::send(Tins::PDU & packet, interface destination, storage_guard & guard)
+// the switching logic, shared by all the backends
+// only the Ethernet header and the VLAN tag are read, the hosts are learned and looked up within the VLAN
+void NetworkThreadHandle::process(uint32_t index, Worker & worker)
 {
-    Tins::PacketSender sender;
-    outputStatistics(packet, destination, guard);
-    guard.storage.sentPackets.insert(packet);
-    if (packet.size() > 1500)
-    {
-        qDebug("Sending a big chungus!");
-        auto eth = packet.rfind_pdu<Tins::EthernetII>();
-        qDebug("%s -> %s", eth.src_addr().to_string().c_str(), eth.dst_addr().to_string().c_str());
-        if (destination.name().find("wlo") != string::npos)
+    auto & received = worker.received[index];
+    auto & macTable = storageHandle_m.macTable();
+    const auto & ports = storageHandle_m.ports();
+
+    // is this interface up?
+    if (!entry_m->up)
+    {
+        qDebug("The interface %s is down, skipping", name_m.c_str());
+        return;
+    }
+
+    // record the packet as input
+    inputStatistics(received, worker);
+
+    // which VLAN is it in?
+    received.vlan = ports.ingressVlan(port_m, received.tagged ? received.tci & VLAN_ID_MASK : PortTable::NO_VLAN);
+    if (received.vlan == PortTable::NO_VLAN)
+    {
+        qDebug("The interface %s doesn't take frames of VLAN %u, skipping", name_m.c_str(), received.tci & VLAN_ID_MASK);
+        return;
+    }
+    StatisticsTable::countVlan(*worker.statistics, ports.vlanIndex(received.vlan), Direction::Input,
+                               received.segments, received.frame.size);
+    if (ports.lags() != 0)
+    {
+        received.flow = flowHash(received.frame.data, received.frame.size, received.vlan);
+    }
+
+    // did our device send this?
+    uint64_t source = macKey(received.frame.data + ETHERNET_SOURCE_OFFSET);
+    uint64_t destination = macKey(received.frame.data + ETHERNET_DESTINATION_OFFSET);
+    if (source == address_m)
+    {
+        qDebug("The packet on interface %s was sent by that interface, skipping", name_m.c_str());
+        return;
+    }
+
+    // is it a request for a host we know? it doesn't have to go to everyone then
+    if (config_m.neighborSuppression && suppress(index, destination, worker))
+    {
+        return;
+    }
+
+    // is it for a multicast group? the broadcast address is one too, it goes everywhere
+    if ((destination >> 40) & 1)
+    {
+        if (config_m.multicastSnooping && destination != BROADCAST_KEY)
         {
-            qDebug("Cannot send jumbo to wifi!");
-            return;
+            multicast(index, destination, worker);
+        }
+        else
+        {
+            broadcast(index, worker);
         }
+        return;
+    }
+
+    // update MAC table
+    updateMac(received.source, received.vlan);
+
+    // is the destination on this device?
+    uint32_t local = ports.local(destination);
+    if (local == port_m)
+    {
+        qDebug("The packet on interface %s was meant for that interface, skipping", name_m.c_str());
+        return;
     }
-    if (packet.rfind_pdu<Tins::EthernetII>().dst_addr().is_broadcast())
+    if (local != PortTable::NO_PORT)
     {
-        qDebug("Sending a broadcast packet!");
+        send(index, local, worker);
+        return;
+    }
+
+    // is destination address known?
+    uint32_t port = macTable.lookup(vlanKey(received.vlan, destination));
+    if (port != MacTable::NO_PORT)
+    {
+        // did we get this packet on the same interface that we need to send
+        // it to? a LAG counts as one interface
+        if (port == ports.logical(port_m))
+        {
+            return;
+        }
+        send(index, port, worker);
+        return;
     }
-    sender.send(packet, destination);
+
+    // broadcasting
+    broadcast(index, worker);
 }
 
-void NetworkThreadHandle::broadcast(Tins::PDU & packet, storage_guard & guard)
+// a LAG is sent to through the member the flow hash picks, which is counted as the output port
+void NetworkThreadHandle::send(uint32_t index, uint32_t port, Worker & worker)
 {
-    Tins::PacketSender sender;
-    guard.storage.sentPackets.insert(packet);
-    for (const auto & entry : guard.storage.interfaces)
+    auto & received = worker.received[index];
+    if (!storageHandle_m.ports().member(port, received.vlan))
+    {
+        qDebug("Port %u is not in VLAN %u, skipping", port, received.vlan);
+        return;
+    }
+    port = storageHandle_m.ports().pick(port, received.flow);
+    if (port == PortTable::NO_PORT)
     {
-        if (entry.first == interface_m)
+        qDebug("Every link of the LAG is down, skipping");
+        return;
+    }
+    outputStatistics(received, port, worker);
+
+    // GSO super-frames are cut into segments by the egress kernel, they aren't jumbo frames
+    if (received.frame.size > 1500 && !isSuperFrame(received.frame))
+    {
+        if (storageHandle_m.ports()[port].name().find("wlo") != string::npos)
         {
-            continue;
+            qDebug("Cannot send jumbo to wifi!");
+            return;
         }
-        auto eth = packet.rfind_pdu<Tins::EthernetII>();
-        qInfo("Broadcasting the packet (src: %s, dst: %s) to interface %s", eth.src_addr().to_string().c_str(), eth.dst_addr().to_string().c_str(), entry.first.hw_address().to_string().c_str());
-        outputStatistics(packet, entry.first, guard);
-        sender.send(packet, entry.first);
     }
+    worker.forwards.push_back({index, PortTable::PortMask(1) << port});
+}
+
+void NetworkThreadHandle::broadcast(uint32_t index, Worker & worker, PortTable::PortMask targets)
+{
+    auto & received = worker.received[index];
+    const auto & table = storageHandle_m.ports();
+    PortTable::PortMask ports = table.pickMembers(table.flood(port_m, received.vlan) & targets, received.flow);
+    if (ports == 0)
+    {
+        return;
+    }
+
+    for (PortTable::PortMask left = ports; left != 0; left &= left - 1)
+    {
+        outputStatistics(received, __builtin_ctz(left), worker);
+    }
+    worker.forwards.push_back({index, ports});
 }
 
-void NetworkThreadHandle::inputStatistics(Tins::PDU & packet, interface net, storage_guard & guard)
+// queries go to every port, reports only to the multicast routers, which are all that need to hear them,
+// and data to the ports with members of the group and the routers
+// a group nobody joined is flooded, as are the link-local ones and reports while no router is known
+void NetworkThreadHandle::multicast(uint32_t index, uint64_t destination, Worker & worker)
 {
-    if (packet.find_pdu<Tins::EthernetII>())
+    auto & received = worker.received[index];
+    auto & groups = storageHandle_m.multicastTable();
+    uint32_t ingress = storageHandle_m.ports().logical(port_m);
+    auto message = groups.snoop(received.frame.data, received.frame.size, received.vlan, ingress);
+
+    PortTable::PortMask routers = groups.routers();
+    if (message == MulticastMessage::Report && routers != 0)
     {
-        guard.storage.statisticsTable[{Protocol::EthernetII, net}].input++;
+        broadcast(index, worker, routers);
+        return;
     }
-    if (packet.find_pdu<Tins::ARP>())
+    if (message != MulticastMessage::None || MulticastTable::reserved(destination))
+    {
+        broadcast(index, worker);
+        return;
+    }
+
+    uint32_t group = MulticastTable::NO_GROUP;
+    PortTable::PortMask members = groups.lookup(vlanKey(received.vlan, destination), group);
+    if (group == MulticastTable::NO_GROUP)
     {
-        guard.storage.statisticsTable[{Protocol::ARP, net}].input++;
+        broadcast(index, worker);
+        return;
     }
-    if (packet.find_pdu<Tins::IP>())
+    groups.count(group, received.segments, received.frame.size);
+    broadcast(index, worker, members | routers);
+}
+
+// replies and unicast requests are only learned from, a request that went to everyone is answered
+// for a target the MAC table knows in the VLAN too, so a host that went away is asked by everyone again,
+// a target on the port the request came in on has already heard it and answers itself
+// the reply is queued to the ingress port right away, the burst notifies the TX threads once it is switched
+bool NetworkThreadHandle::suppress(uint32_t index, uint64_t destination, Worker & worker)
+{
+    auto & received = worker.received[index];
+    auto & neighbors = storageHandle_m.neighborTable();
+    const auto & ports = storageHandle_m.ports();
+    NeighborQuery query{};
+    if (!neighbors.snoop(received.frame.data, received.frame.size, received.vlan, query) ||
+        ((destination >> 40) & 1) == 0)
     {
-        guard.storage.statisticsTable[{Protocol::IP, net}].input++;
+        return false;
     }
-    if (packet.find_pdu<Tins::TCP>())
+
+    uint64_t mac = 0;
+    bool router = false;
+    uint32_t port = MacTable::NO_PORT;
+    if (neighbors.resolve(query, mac, router))
     {
-        guard.storage.statisticsTable[{Protocol::TCP, net}].input++;
+        port = storageHandle_m.macTable().lookup(vlanKey(received.vlan, mac));
     }
-    if (packet.find_pdu<Tins::UDP>())
+    if (port == MacTable::NO_PORT)
     {
-        guard.storage.statisticsTable[{Protocol::UDP, net}].input++;
+        StatisticsTable::countNeighbor(*worker.statistics, query.ipv6, false);
+        return false;
     }
-    if (packet.find_pdu<Tins::ICMP>())
+    if (port == ports.logical(port_m))
     {
-        guard.storage.statisticsTable[{Protocol::ICMP, net}].input++;
+        qDebug("The target of the request is on interface %s already, skipping", name_m.c_str());
+        StatisticsTable::countNeighbor(*worker.statistics, query.ipv6, true);
+        return true;
     }
 
-    try
+    auto & pool = tx_m->pool();
+    uint32_t pooled = pool.allocate();
+    if (pooled == FramePool::INVALID)
+    {
+        StatisticsTable::countNeighbor(*worker.statistics, query.ipv6, false);
+        return false; // the pool is exhausted, the target answers instead
+    }
+    uint8_t *data = pool.data(pooled);
+    uint32_t size = NeighborTable::reply(query, mac, router, address_m, data);
+    if (ports.tagged(received.vlan) & (PortTable::PortMask(1) << port_m))
     {
-        auto tcp = packet.rfind_pdu<Tins::TCP>();
-        if (tcp.sport() == 80 || tcp.dport() == 80 || tcp.sport() == 443 || tcp.dport() == 443)
+        retagFrame(data, size, nullptr, true, (received.tci & ~VLAN_ID_MASK) | received.vlan);
+    }
+    if (!tx_m->enqueue(port_m, FrameView{data, size, nullptr}, pooled, nullptr))
+    {
+        pool.release(pooled);
+    }
+    StatisticsTable::countNeighbor(*worker.statistics, query.ipv6, true);
+    return true;
+}
+
+// carries out the decisions of a burst by queueing the frames to the TX threads of the ports
+// the ports that send the frame untagged and the ones that send it tagged get it in a form of their own,
+// the ones that take it as it came in go first, so its buffer can be retagged in place if nobody else sends it
+void NetworkThreadHandle::transmit(Worker & worker)
+{
+    auto & pool = tx_m->pool();
+    const auto & ports = storageHandle_m.ports();
+    for (const auto & forward : worker.forwards)
+    {
+        auto & received = worker.received[forward.received];
+        PortTable::PortMask tagged = forward.ports & ports.tagged(received.vlan);
+        uint16_t tci = (received.tci & ~VLAN_ID_MASK) | received.vlan;
+        bool inFrame = received.tagged && !received.frame.stripped; // a stripped tag has to be pushed again
+        Egress egress[2] = {
+            {forward.ports & ~tagged, inFrame, false, 0, false},
+            {tagged, !inFrame || received.tci != tci, true, tci, false},
+        };
+        if (egress[0].retag)
         {
-            guard.storage.statisticsTable[{Protocol::HTTP, net}].input++;
+            std::swap(egress[0], egress[1]);
+        }
+
+        bool single = __builtin_popcount(forward.ports) == 1;
+        bool shared = false;
+        for (auto & group : egress)
+        {
+            if (group.ports == 0)
+            {
+                continue;
+            }
+            group.copy = group.retag && (shared || (&group == &egress[0] && egress[1].ports != 0));
+            shared = shared || !group.retag;
+            enqueue(received, group, single, worker);
         }
     }
-    catch (Tins::pdu_not_found & e)
+    worker.forwards.clear();
+    tx_m->notify();
+
+    for (auto & received : worker.received)
     {
+        if (received.owned)
+        {
+            pool.release(received.pooled);
+        }
     }
 }
 
-void NetworkThreadHandle::outputStatistics(Tins::PDU & packet, interface net, storage_guard & guard)
+// the TX threads send asynchronously, so a UMEM frame is only handed over when a single port
+// takes it as it is, a flooded frame could otherwise be overwritten while another port still copies it
+// everything else goes out of one frame pool copy, which every port it is queued to holds a reference to
+void NetworkThreadHandle::enqueue(Received & received, const Egress & egress, bool single, Worker & worker)
 {
-    if (packet.find_pdu<Tins::EthernetII>())
+    auto & pool = tx_m->pool();
+    XdpFrame *origin = single && !egress.retag ? received.origin : nullptr;
+    uint32_t pooled = FramePool::INVALID;
+    bool copied = false; // pooled is this group's own copy, its allocation reference goes once it is queued
+    if (origin == nullptr || !tx_m->zeroCopy(__builtin_ctz(egress.ports)))
     {
-        guard.storage.statisticsTable[{Protocol::EthernetII, net}].output++;
+        if (egress.copy && received.frame.size <= pool.frameSize())
+        {
+            pooled = pool.allocate();
+            copied = pooled != FramePool::INVALID;
+            if (copied)
+            {
+                std::memcpy(pool.data(pooled), received.frame.data, received.frame.size);
+            }
+        }
+        else
+        {
+            pooled = poolCopy(received);
+        }
+        if (pooled == FramePool::INVALID && received.frame.size <= pool.frameSize())
+        {
+            return; // the pool is exhausted
+        }
     }
-    if (packet.find_pdu<Tins::ARP>())
+
+    FrameView frame = received.frame;
+    if (pooled != FramePool::INVALID)
     {
-        guard.storage.statisticsTable[{Protocol::ARP, net}].output++;
+        frame.data = pool.data(pooled);
     }
-    if (packet.find_pdu<Tins::IP>())
+    VnetHeader vnet{};
+    if (egress.retag)
     {
-        guard.storage.statisticsTable[{Protocol::IP, net}].output++;
+        uint8_t *data = nullptr;
+        if (pooled != FramePool::INVALID)
+        {
+            data = pool.data(pooled);
+        }
+        else
+        {
+            worker.retagged.resize(VLAN_TAG_SIZE + received.frame.size);
+            std::memcpy(worker.retagged.data() + VLAN_TAG_SIZE, received.frame.data, received.frame.size);
+            data = worker.retagged.data() + VLAN_TAG_SIZE;
+        }
+        if (frame.vnet != nullptr)
+        {
+            vnet = *frame.vnet;
+            frame.vnet = &vnet;
+        }
+        retagFrame(data, frame.size, frame.vnet == nullptr ? nullptr : &vnet, egress.tagged, egress.tci);
+        frame.data = data;
     }
-    if (packet.find_pdu<Tins::TCP>())
+
+    // the references for all the ports are taken at once, a port that doesn't queue it drops its own
+    if (pooled != FramePool::INVALID)
     {
-        guard.storage.statisticsTable[{Protocol::TCP, net}].output++;
+        pool.retain(pooled, __builtin_popcount(egress.ports));
+    }
+    for (PortTable::PortMask left = egress.ports; left != 0; left &= left - 1)
+    {
+        if (!tx_m->enqueue(__builtin_ctz(left), frame, pooled, origin) && pooled != FramePool::INVALID)
+        {
+            pool.release(pooled);
+        }
     }
-    if (packet.find_pdu<Tins::UDP>())
+    if (copied)
     {
-        guard.storage.statisticsTable[{Protocol::UDP, net}].output++;
+        pool.release(pooled);
     }
-    if (packet.find_pdu<Tins::ICMP>())
+}
+
+uint32_t NetworkThreadHandle::poolCopy(Received & received)
+{
+    if (received.copied)
     {
-        guard.storage.statisticsTable[{Protocol::ICMP, net}].output++;
+        return received.pooled;
     }
+    received.copied = true;
 
-    try
+    auto & pool = tx_m->pool();
+    if (received.frame.size > pool.frameSize())
     {
-        auto tcp = packet.rfind_pdu<Tins::TCP>();
-        if (tcp.sport() == 80 || tcp.dport() == 80)
-        {
-            guard.storage.statisticsTable[{Protocol::HTTP, net}].output++;
-        }
+        pool.countOversize();
+        return FramePool::INVALID;
     }
-    catch (Tins::pdu_not_found & e)
+    received.pooled = pool.allocate();
+    if (received.pooled != FramePool::INVALID)
     {
+        std::memcpy(pool.data(received.pooled), received.frame.data, received.frame.size);
+        received.owned = true;
     }
+    return received.pooled;
+}
+
+milliseconds NetworkThreadHandle::pollTimeout() const
+{
+    return config_m.latency.busyPoll ? 0ms : RX_POLL_TIMEOUT;
+}
+
+void NetworkThreadHandle::joinFanout(RxRing & ring)
+{
+    std::lock_guard<std::mutex> lock(fanoutLock_m);
+    fanoutGroup_m = ring.joinFanout(fanoutGroup_m);
+}
+
+// the protocols are found once, a flooded frame is counted as output on every port with them
+// the headers of the whole burst are walked in one go, before any of the frames is switched
+void NetworkThreadHandle::classify(Worker & worker)
+{
+    for (auto & received : worker.received)
+    {
+        received.protocols = config_m.protocolStatistics
+                                 ? classifier_m.classify(received.frame.data, received.frame.size)
+                                 : protocolBit(Protocol::EthernetII);
+    }
+}
+
+void NetworkThreadHandle::inputStatistics(Received & received, Worker & worker)
+{
+    StatisticsTable::count(*worker.statistics, port_m, received.protocols, Direction::Input, received.segments,
+                           received.frame.size);
+}
+
+void NetworkThreadHandle::outputStatistics(Received & received, uint32_t port, Worker & worker)
+{
+    StatisticsTable::count(*worker.statistics, port, received.protocols, Direction::Output, received.segments,
+                           received.frame.size);
+    StatisticsTable::countVlan(*worker.statistics, storageHandle_m.ports().vlanIndex(received.vlan),
+                               Direction::Output, received.segments, received.frame.size);
 }
 
-void NetworkThreadHandle::updateMac(mac_address mac, storage_guard & guard)
+void NetworkThreadHandle::updateMac(mac_address mac, uint16_t vlan)
 {
-    guard.storage.macTable[mac] = {interface_m, guard.storage.deviceInfo.defaultMacTimeout};
+    // a host behind a LAG is learned on the port standing for it, whichever member its frames came in on
+    uint32_t port = storageHandle_m.ports().logical(port_m);
+    bool moved = storageHandle_m.macTable().learn(vlanKey(vlan, macKey(mac)), port);
+
+    // the fast path only needs to hear about new or moved hosts, the hit bit is set here
+    if (fastPath_m != nullptr && moved)
+    {
+        fastPath_m->learn(mac, interface_m);
+    }
 }
 
-NetworkThreadHandle::NetworkThreadHandle(SharedStorageHandle storageHandle, interface acceptingInterface)
+NetworkThreadHandle::NetworkThreadHandle(SharedStorageHandle storageHandle, interface acceptingInterface,
+                                         DataplaneConfig config, TxEngine *tx, XdpFabric *xdp,
+                                         XdpFastPath *fastPath)
     : storageHandle_m(storageHandle),
       interface_m(acceptingInterface),
-      thread_m{}
+      config_m(config),
+      classifier_m(),
+      xdp_m(xdp),
+      fastPath_m(fastPath),
+      tx_m(tx),
+      threads_m{},
+      workers_m{},
+      workerCount_m(config.rxWorkers == 0 ? rxQueueCount(acceptingInterface.name()) : config.rxWorkers),
+      entry_m(nullptr),
+      name_m(acceptingInterface.name()),
+      port_m(PortTable::NO_PORT),
+      address_m(0),
+      fanoutLock_m{},
+      fanoutGroup_m(-1),
+      wakeup_m(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (wakeup_m < 0)
+    {
+        throw std::runtime_error("Cannot create the wakeup event of " + interface_m.name());
+    }
+
+    // the egress sockets take the header on every backend, only the ring can receive it
+    config_m.ring.vnetHeader = config_m.gsoPassthrough && config_m.rxBackend == RxBackend::PacketMmap;
+    if (config_m.gsoPassthrough && !config_m.ring.vnetHeader)
+    {
+        qWarning("GSO passthrough needs the PACKET_MMAP backend, %s receives segmented frames",
+                 interface_m.name().c_str());
+    }
+
+    if (config_m.rxBackend == RxBackend::Sniffer && workerCount_m > 1)
+    {
+        qWarning("The sniffer backend cannot fan out, %s gets a single worker", interface_m.name().c_str());
+        workerCount_m = 1;
+    }
+
+    config_m.burstSize = std::clamp<uint32_t>(config_m.burstSize, 1, MAX_BURST_SIZE);
+}
+
+NetworkThreadHandle::Worker::Worker(uint32_t index, const string & name)
+    : index(index),
+      latency(name),
+      received{},
+      forwards{},
+      origins(nullptr),
+      pooled(nullptr),
+      statistics(nullptr)
+{
+}
+
+NetworkThreadHandle::Received::Received(const FrameView & frame, XdpFrame *origin, uint32_t pooled)
+    : frame(frame),
+      origin(origin),
+      pooled(pooled),
+      copied(pooled != FramePool::INVALID),
+      owned(false),
+      source(frame.data + ETHERNET_SOURCE_OFFSET),
+      segments(gsoSegments(frame)),
+      protocols(0),
+      tci(0),
+      tagged(vlanTag(frame, tci)),
+      vlan(PortTable::NO_VLAN),
+      flow(0)
 {
 }
 
 string NetworkThreadHandle::interfaceName() const
 {
-    return interface_m.name();
+    return name_m;
 }
 
 interface NetworkThreadHandle::getInterface() const
@@ -283,11 +811,20 @@ int32_t NetworkThreadHandle::id() const
     return interface_m.id();
 }
 
+uint32_t NetworkThreadHandle::workerCount() const
+{
+    return workerCount_m;
+}
+
 NetworkThreadHandle::~NetworkThreadHandle()
 {
-    if (thread_m.joinable())
+    for (auto & thread : threads_m)
     {
-        qDebug("Joining the network thread...");
-        thread_m.join();
+        if (thread.joinable())
+        {
+            qDebug("Joining the network thread...");
+            thread.join();
+        }
     }
+    close(wakeup_m);
 }
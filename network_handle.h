@@ -1,23 +1,33 @@
 #pragma once
 
+#include "dataplane_config.h"
+#include "low_latency.h"
+#include "packet_ring.h"
+#include "protocol_classifier.h"
 #include "shared_storage.h"
 #include "shared_storage_handle.h"
+#include "tx_engine.h"
+#include "xdp_fastpath.h"
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <tins/hw_address.h>
 #include <tins/network_interface.h>
-#include <tins/pdu.h>
 
 using interface = Tins::NetworkInterface;
 using mac_address = Tins::HWAddress<6>;
+using std::unique_ptr;
 
-// this class contains code to affect the running underlying thread
-// the only method that runs in the separate thread is thread()
+// this class contains code to affect the running underlying threads
+// every port runs one or more RX workers, joined into a PACKET_FANOUT group
+// the only method that runs in the separate threads is thread()
 // the other methods remain inside the main thread
 struct NetworkThreadHandle
 {
 public:
-    NetworkThreadHandle(SharedStorageHandle storageHandle, interface acceptingInterface);
-    NetworkThreadHandle(NetworkThreadHandle &&) = default;
+    NetworkThreadHandle(SharedStorageHandle storageHandle, interface acceptingInterface, DataplaneConfig config,
+                        TxEngine *tx, XdpFabric *xdp = nullptr, XdpFastPath *fastPath = nullptr);
+    NetworkThreadHandle(NetworkThreadHandle &&) = delete;
     NetworkThreadHandle(const NetworkThreadHandle &) = delete;
     NetworkThreadHandle & operator=(NetworkThreadHandle &&) = delete;
     NetworkThreadHandle & operator=(const NetworkThreadHandle &) = delete;
@@ -25,53 +35,107 @@ public:
 
 public:
     void start();      // non-blocking
-    void signalStop(); // doesn't *actually* stop the thread
+    void signalStop(); // doesn't *actually* stop the thread, but wakes it up so it notices within milliseconds
 
 public:
     string interfaceName() const;
     interface getInterface() const;
     int32_t id() const;
+    uint32_t workerCount() const;
 
 private:
-    struct SnifferHelper
+    // the frame being switched, it is only ever looked at raw
+    struct Received
     {
-        SnifferHelper(storage_guard & guard, interface & myInt)
-            : guard(guard),
-              myInterface(myInt)
-        {
-        }
-        storage_guard & guard;
-        interface & myInterface;
-        bool & up()
-        {
-            return guard.storage.interfaces[myInterface].up;
-        }
+        Received(const FrameView & frame, XdpFrame *origin, uint32_t pooled);
+        const FrameView & frame;
+        XdpFrame *origin; // the UMEM frame, AF_XDP backend only
+        uint32_t pooled;  // the frame pool copy, FramePool::INVALID until it is made
+        bool copied;      // whether the pool copy was attempted, it is only made once per frame
+        bool owned;       // the copy was made for the TX threads, its reference is dropped after the burst
+        mac_address source;
+        uint32_t segments; // frames on the wire this one stands for
+        uint32_t protocols; // protocolBit()s, classified once per burst and counted in both directions
+        uint16_t tci;       // of the 802.1Q tag it came in with, in the frame or stripped by the kernel
+        bool tagged;
+        uint16_t vlan;      // the one it was admitted to on ingress
+        uint64_t flow;      // flowHash(), picks the member of a LAG, only computed when there are LAGs
+    };
 
-        bool & running()
-        {
-            return guard.storage.interfaces[myInterface].control.running;
-        }
+    // a switching decision, carried out once the whole burst is switched
+    // a flooded frame is a single decision, it is copied once and queued to every port of the mask
+    struct Forward
+    {
+        uint32_t received; // index into Worker::received
+        PortTable::PortMask ports;
+    };
 
-        bool & finished()
-        {
-            return guard.storage.interfaces[myInterface].control.finished;
-        }
+    // the ports of a forward that get the frame in the same form, tagged or not
+    struct Egress
+    {
+        PortTable::PortMask ports;
+        bool retag;  // the frame came in the other form, or with another VLAN ID
+        bool tagged;
+        uint16_t tci;
+        bool copy;   // the retagged frame needs a copy of its own, others send the frame as it came in
+    };
 
-        MacTable & macTable()
-        {
-            return guard.storage.macTable;
-        }
+    // the state private to one RX worker thread
+    struct Worker
+    {
+        Worker(uint32_t index, const string & name);
+        uint32_t index;
+        LatencyReport latency;
+        vector<Received> received;
+        vector<Forward> forwards;
+        XdpFrame *origins; // the UMEM frames of the burst, AF_XDP backend only
+        uint32_t *pooled;  // the frame pool frames the burst was captured into, sniffer backend only
+        StatisticsTable::Shard *statistics; // claimed when the worker starts, only this worker counts into it
+        vector<uint8_t> retagged; // a frame too large for the pool, with room for a tag in front
     };
 
-    void thread(); // blocking!
-    void inputStatistics(Tins::PDU & packet, interface net, storage_guard & guard);
-    void outputStatistics(Tins::PDU & packet, interface net, storage_guard & guard);
-    void updateMac(mac_address mac, storage_guard & guard);
-    void send(Tins::PDU & packet, interface destination, storage_guard & guard);
-    void broadcast(Tins::PDU & packet, storage_guard & guard);
+    void thread(Worker & worker); // blocking!
+    void sniffLoop(Worker & worker);
+    void ringLoop(Worker & worker);
+    void xdpLoop(Worker & worker);
+
+    // switches a whole burst without locking the shared storage, then hands it to the TX threads
+    // returns whether the thread should keep running
+    bool processBurst(const vector<FrameView> & burst, Worker & worker);
+    bool running() const; // lock-free, the workers check it after every burst and every empty poll
+    milliseconds pollTimeout() const; // zero while spinning
+    void process(uint32_t index, Worker & worker);
+    void transmit(Worker & worker);
+    void enqueue(Received & received, const Egress & egress, bool single, Worker & worker);
+    uint32_t poolCopy(Received & received); // FramePool::INVALID if the frame can't be pooled
+    void classify(Worker & worker); // the protocols of every received frame of the burst
+    void inputStatistics(Received & received, Worker & worker); // always on this interface
+    void outputStatistics(Received & received, uint32_t port, Worker & worker);
+    void updateMac(mac_address mac, uint16_t vlan);
+    void send(uint32_t index, uint32_t port, Worker & worker);
+    // to the flood mask of this port within the VLAN, only to the targets of those
+    void broadcast(uint32_t index, Worker & worker, PortTable::PortMask targets = ~PortTable::PortMask(0));
+    void multicast(uint32_t index, uint64_t destination, Worker & worker);
+    // snoops ARP and neighbor discovery, returns whether the frame was a request the switch answered itself
+    bool suppress(uint32_t index, uint64_t destination, Worker & worker);
+    void joinFanout(RxRing & ring); // the first ring of the interface creates the group
 
 private:
-    std::thread thread_m;
+    vector<std::thread> threads_m;
+    vector<unique_ptr<Worker>> workers_m;
     SharedStorageHandle storageHandle_m;
     interface interface_m;
+    DataplaneConfig config_m;
+    ProtocolClassifier classifier_m;
+    XdpFabric *xdp_m;
+    XdpFastPath *fastPath_m; // learned addresses are mirrored into it
+    TxEngine *tx_m;
+    uint32_t workerCount_m;
+    InterfaceEntry *entry_m; // only the atomic flags are read by the workers
+    string name_m;           // asking the interface for its name or address is a system call
+    uint32_t port_m;         // the index of the interface in the port table
+    uint64_t address_m;      // the address of the interface, see macKey()
+    std::mutex fanoutLock_m;
+    int fanoutGroup_m;       // the PACKET_FANOUT group of the rings, -1 until the first one joined
+    int wakeup_m;            // eventfd, readable once the workers have to stop
 };
@@ -1,7 +1,9 @@
 
 #include "network_switch.h"
+#include "low_latency.h"
 #include "network_handle.h"
 #include "shared_storage.h"
+#include <algorithm>
 #include <qlogging.h>
 #include <tins/network_interface.h>
 
@@ -9,36 +11,216 @@ using std::chrono::duration_cast, std::chrono::seconds;
 
 NetworkSwitch::NetworkSwitch()
     : storage_m{},
-      storageMutex_m{},
-      interface1_m(nullptr),
-      interface2_m(nullptr),
+      locks_m{},
+      dataplane_m{},
+      fastPath_m(nullptr),
+      xdp_m(nullptr),
+      pool_m(nullptr),
+      tx_m(nullptr),
+      ports_m{},
       restThread_m(nullptr),
       state_m(SwitchState::Idle)
 {
+    // nothing walks the tables on a timer of the GUI, the expiries are driven by the housekeeping wheel
+    storage_m.housekeeping.start();
+    storage_m.housekeeping.every(MAC_UPDATE_TIMER, [this]() { synchronize(); });
+    storage_m.housekeeping.every(LINK_POLL_TIMER, [this]() { pollLinks(); });
+    storage_m.housekeeping.every(MULTICAST_SWEEP_TIMER, [this]() {
+        storage_m.multicastTable.sweep(steady_clock::now());
+    });
+    storage_m.housekeeping.every(NEIGHBOR_SWEEP_TIMER, [this]() {
+        storage_m.neighborTable.sweep(steady_clock::now());
+    });
+    storage_m.housekeeping.schedule(DEFAULT_MAC_TIMEOUT / MAC_AGING_EPOCHS, [this]() { sweepMac(); });
 }
 
 NetworkSwitch::~NetworkSwitch()
 {
+    // the callbacks use the dataplane, which goes away before the storage does
+    storage_m.housekeeping.stop();
 }
 
-void NetworkSwitch::startNetwork(string interface1, string interface2)
+void NetworkSwitch::startNetwork(string interface1, string interface2, DataplaneConfig config)
+{
+    startNetwork(vector<string>{interface1, interface2}, config);
+}
+
+void NetworkSwitch::startNetwork(const vector<string> & interfaces, DataplaneConfig config)
 {
     if (state() != SwitchState::Idle)
     {
         qDebug("Network threads are already running!");
         return;
     }
+    if (interfaces.empty() || interfaces.size() > MAX_SWITCH_PORTS)
+    {
+        qWarning("Cannot switch between %zu ports, at most %u are supported", interfaces.size(), MAX_SWITCH_PORTS);
+        return;
+    }
+    for (size_t port = 0; port < interfaces.size(); port++)
+    {
+        if (std::find(interfaces.begin(), interfaces.begin() + port, interfaces[port]) != interfaces.begin() + port)
+        {
+            qWarning("The interface %s is given twice", interfaces[port].c_str());
+            return;
+        }
+    }
+    lock_guard<mutex> dataplane(dataplane_m);
 
-    interface1_m.reset(new NetworkThreadHandle(getStorage(), Tins::NetworkInterface(interface1)));
-    interface2_m.reset(new NetworkThreadHandle(getStorage(), Tins::NetworkInterface(interface2)));
+    // the CPU list is handed out in order, the workers of the first port come first
+    // one worker per RX queue is resolved to a count here, so the ports don't share the start of the list
+    vector<DataplaneConfig> configs(interfaces.size(), config);
+    bool xdp = false;
+    uint32_t xdpSockets = 0;
+    size_t cpu = 0;
+    for (size_t port = 0; port < interfaces.size(); port++)
+    {
+        auto & portConfig = configs[port];
+        portConfig.rxBackend = config.backendFor(interfaces[port]);
+        xdp = xdp || portConfig.rxBackend == RxBackend::Xdp;
+        if (portConfig.rxWorkers == 0)
+        {
+            portConfig.rxWorkers = rxQueueCount(interfaces[port]);
+        }
+        xdpSockets += portConfig.rxBackend == RxBackend::Xdp ? portConfig.rxWorkers : 0;
+        if (!config.rxCpus.empty())
+        {
+            uint32_t workers = portConfig.rxBackend == RxBackend::Sniffer ? 1 : portConfig.rxWorkers;
+            portConfig.rxCpus.clear();
+            for (uint32_t i = 0; i < workers; i++, cpu++)
+            {
+                portConfig.rxCpus.push_back(config.rxCpus[cpu % config.rxCpus.size()]);
+            }
+        }
+    }
 
+    // the old threads are done, they can let go of the old AF_XDP sockets
+    ports_m.clear();
+    tx_m.reset();
+    pool_m.reset();
+    xdp_m.reset();
+    fastPath_m.reset();
+
+    // before anything new is mapped, so the rings, the UMEM and the egress queues come in populated
+    qInfo("Memory locking %s", lockMemory(config.latency) ? "active" : "inactive");
+    if (xdp)
     {
-        lock_guard<mutex> lock(storageMutex_m);
+        // the fast path goes first, the AF_XDP sockets then bind without the default program of libxdp
+        // it switches by the MAC address alone, so it is left out as soon as a port is in another VLAN or a LAG
+        if (config.xdp.fastPath && (!config.vlans.empty() || !config.lags.empty()))
+        {
+            qInfo("The XDP fast path doesn't know about VLANs and LAGs, every frame goes through userspace");
+        }
+        else if (config.xdp.fastPath)
+        {
+            try
+            {
+                vector<interface> ports(interfaces.begin(), interfaces.end());
+                fastPath_m.reset(new XdpFastPath(ports, config.xdp));
+            }
+            catch (std::runtime_error & e)
+            {
+                qWarning("The XDP fast path is not available, every frame goes through userspace: %s", e.what());
+            }
+        }
+
+        // every socket keeps its fill ring full and can have a TX ring of frames out, they all share the UMEM
+        config.xdp.frameCount = std::max(config.xdp.frameCount, xdpSockets * config.xdp.ringSize * 2);
+        try
+        {
+            xdp_m.reset(new XdpFabric(config.xdp, fastPath_m.get()));
+        }
+        catch (std::runtime_error & e)
+        {
+            qWarning("AF_XDP is not available, falling back to the TPACKET_V3 ring: %s", e.what());
+            fastPath_m.reset();
+            for (auto & portConfig : configs)
+            {
+                portConfig.rxBackend = portConfig.rxBackend == RxBackend::Xdp ? RxBackend::PacketMmap
+                                                                              : portConfig.rxBackend;
+            }
+        }
+    }
+
+    // the egress sockets take the header on every backend, only the ring can receive it
+    TxConfig txConfig = config.tx;
+    txConfig.vnetHeader = config.gsoPassthrough;
+    pool_m.reset(new FramePool(config.pool));
+    tx_m.reset(new TxEngine(txConfig, config.latency, *pool_m, xdp_m.get()));
+
+    for (uint32_t port = 0; port < interfaces.size(); port++)
+    {
+        ports_m.emplace_back(new NetworkThreadHandle(getStorage(), Tins::NetworkInterface(interfaces[port]),
+                                                     configs[port], tx_m.get(), xdp_m.get(), fastPath_m.get()));
+    }
+
+    // every AF_XDP socket and every egress port exists before any worker starts forwarding
+    try
+    {
+        for (uint32_t port = 0; port < ports_m.size(); port++)
+        {
+            if (configs[port].rxBackend == RxBackend::Xdp)
+            {
+                xdp_m->addPort(ports_m[port]->getInterface(), ports_m[port]->workerCount());
+            }
+        }
+    }
+    catch (std::runtime_error & e)
+    {
+        qWarning("Cannot set up the AF_XDP sockets: %s", e.what());
+        ports_m.clear();
+        tx_m.reset();
+        pool_m.reset();
+        xdp_m.reset();
+        fastPath_m.reset();
+        return;
+    }
+    for (uint32_t port = 0; port < ports_m.size(); port++)
+    {
+        int cpu = config.txCpus.empty() ? -1 : config.txCpus[port % config.txCpus.size()];
+        try
+        {
+            tx_m->addPort(port, ports_m[port]->getInterface(), cpu);
+        }
+        catch (std::runtime_error & e)
+        {
+            qWarning("Cannot set up the egress port %s: %s", ports_m[port]->interfaceName().c_str(), e.what());
+        }
+    }
+    tx_m->start();
+
+    {
+        std::scoped_lock lock(locks_m.storage, locks_m.statistics, locks_m.sessions, locks_m.device);
         storage_m.reset();
+
+        // the workers walk the port and interface tables without the lock, so they are complete before any of
+        // them starts, the ports are added in the order of the handles, their indices match
+        for (const auto & port : ports_m)
+        {
+            storage_m.ports.add(port->getInterface(), config.vlansFor(port->interfaceName()));
+            storage_m.interfaces[port->getInterface()];
+        }
+        for (const auto & lag : config.lags)
+        {
+            PortTable::PortMask members = 0;
+            for (const auto & member : lag.members)
+            {
+                auto it = std::find(interfaces.begin(), interfaces.end(), member);
+                if (it == interfaces.end())
+                {
+                    qWarning("The LAG %s has the interface %s, which isn't a port", lag.name.c_str(), member.c_str());
+                    continue;
+                }
+                members |= PortTable::PortMask(1) << (it - interfaces.begin());
+            }
+            storage_m.ports.addLag(lag.name, members);
+        }
     }
 
-    interface1_m->start();
-    interface2_m->start();
+    for (auto & port : ports_m)
+    {
+        port->start();
+    }
 }
 
 void NetworkSwitch::startRest(int16_t port)
@@ -54,8 +236,17 @@ void NetworkSwitch::startRest(int16_t port)
 
 void NetworkSwitch::stopNetwork()
 {
-    interface1_m->signalStop();
-    interface2_m->signalStop();
+    lock_guard<mutex> dataplane(dataplane_m);
+
+    // the kernel stops switching behind the back of the stopped threads
+    if (fastPath_m)
+    {
+        fastPath_m->detach();
+    }
+    for (auto & port : ports_m)
+    {
+        port->signalStop();
+    }
 }
 
 void NetworkSwitch::stopRest()
@@ -68,55 +259,46 @@ void NetworkSwitch::stopRest()
 
 void NetworkSwitch::clearMac()
 {
-    lock_guard<mutex> lock(storageMutex_m);
+    lock_guard<mutex> dataplane(dataplane_m);
     storage_m.macTable.clear();
+    if (fastPath_m)
+    {
+        fastPath_m->clear();
+    }
 }
 
 void NetworkSwitch::clearStats()
 {
-    lock_guard<mutex> lock(storageMutex_m);
+    lock_guard<mutex> lock(locks_m.statistics);
     storage_m.statisticsTable.clear();
 }
 
 void NetworkSwitch::clearStats(interface requiredInterface)
 {
-    lock_guard<mutex> lock(storageMutex_m);
-    for (auto it = storage_m.statisticsTable.begin(); it != storage_m.statisticsTable.end();)
-    {
-        if (it->first.target != requiredInterface)
-        {
-            it++;
-            continue;
-        }
-
-        it = storage_m.statisticsTable.erase(it);
-    }
+    lock_guard<mutex> lock(locks_m.statistics);
+    storage_m.statisticsTable.clear(storage_m.ports.index(requiredInterface));
 }
 
 void NetworkSwitch::clearSessions()
 {
-    lock_guard<mutex> lock(storageMutex_m);
-    storage_m.sessions.clear();
+    lock_guard<mutex> lock(locks_m.sessions);
+    storage_m.clearSessions();
 }
 
 void NetworkSwitch::resetMac()
 {
-    lock_guard<mutex> lock(storageMutex_m);
-    for (auto & entry : storage_m.macTable)
-    {
-        entry.second.expiration.reset();
-    }
+    storage_m.macTable.refresh();
 }
 
 void NetworkSwitch::applyMac(milliseconds newTimeout)
 {
-    lock_guard<mutex> lock(storageMutex_m);
+    lock_guard<mutex> lock(locks_m.device);
     storage_m.deviceInfo.defaultMacTimeout = newTimeout;
 }
 
 NetworkSwitch::SwitchState NetworkSwitch::state() const
 {
-    lock_guard<mutex> lock(storageMutex_m);
+    lock_guard<mutex> lock(locks_m.storage);
 
     if (storage_m.restThread.running == true)
     {
@@ -145,84 +327,129 @@ NetworkSwitch::SwitchState NetworkSwitch::state() const
     return SwitchState::Idle;
 }
 
-pair<NetworkSwitch::InterfaceData, NetworkSwitch::InterfaceData> NetworkSwitch::interfaces()
+vector<NetworkSwitch::InterfaceData> NetworkSwitch::interfaces()
 {
-    if (interface1_m.get() == nullptr || interface2_m.get() == nullptr)
+    if (ports_m.empty())
     {
         qDebug("Interface names are being requested, but the threads are down");
-        return {{}, {}};
+        return {};
     }
-    lock_guard<mutex> lock(storageMutex_m);
+    lock_guard<mutex> lock(locks_m.storage);
+    lock_guard<mutex> statistics(locks_m.statistics);
 
-    return {
-        {
-            storage_m.interfaces[interface1_m->getInterface()].name,
-            interface1_m->interfaceName(),
-            interface1_m->id(),
-            storage_m.interfaces[interface1_m->getInterface()].up,
-            interface1_m->getInterface(),
-        },
-        {
-            storage_m.interfaces[interface2_m->getInterface()].name,
-            interface2_m->interfaceName(),
-            interface2_m->id(),
-            storage_m.interfaces[interface2_m->getInterface()].up,
-            interface2_m->getInterface(),
-        },
-    };
+    vector<InterfaceData> interfaces;
+    interfaces.reserve(ports_m.size());
+    for (const auto & port : ports_m)
+    {
+        const auto & entry = storage_m.interfaces[port->getInterface()];
+        interfaces.push_back({
+            entry.name,
+            port->interfaceName(),
+            port->id(),
+            entry.up,
+            port->getInterface(),
+            entry.rx,
+            entry.tx,
+        });
+    }
+    return interfaces;
 }
 
-void NetworkSwitch::updateMac()
+void NetworkSwitch::synchronize()
 {
-    lock_guard guard(storageMutex_m);
-    for (auto it = storage_m.macTable.begin(); it != storage_m.macTable.end();)
+    lock_guard<mutex> dataplane(dataplane_m);
+    lock_guard<mutex> lock(locks_m.storage);
+    lock_guard<mutex> statistics(locks_m.statistics);
+    if (fastPath_m)
     {
-        if (it->second.expiration.expired())
-        {
-            it = storage_m.macTable.erase(it);
-        }
-        else
-        {
-            it++;
-        }
+        fastPath_m->synchronize(storage_m);
+    }
+    if (tx_m)
+    {
+        tx_m->synchronize(storage_m);
+    }
+    if (pool_m)
+    {
+        storage_m.pool = pool_m->statistics();
+    }
+    for (auto & entry : storage_m.interfaces)
+    {
+        entry.second.rx = storage_m.statisticsTable.bursts(storage_m.ports.index(entry.first));
     }
 }
 
-void NetworkSwitch::updatePackets()
+// a member of a LAG stops being picked once its link goes down or it is turned off, and is picked again
+// once it comes back, the MAC entries point at the LAG, so they stay as they are
+void NetworkSwitch::pollLinks()
 {
-    lock_guard guard(storageMutex_m);
-    for (auto it = storage_m.sentPackets.begin(); it != storage_m.sentPackets.end();)
+    lock_guard<mutex> dataplane(dataplane_m);
+    if (storage_m.ports.lags() == 0)
+    {
+        return; // the port table is fixed while the dataplane lock is held, nothing to poll without LAGs
+    }
+    PortTable::PortMask carrier = 0;
+    for (uint32_t port = 0; port < ports_m.size(); port++)
+    {
+        carrier |= linkUp(ports_m[port]->interfaceName()) ? PortTable::PortMask(1) << port : 0;
+    }
+
+    lock_guard<mutex> lock(locks_m.storage);
+    auto & ports = storage_m.ports;
+    PortTable::PortMask up = 0;
+    for (uint32_t port = 0; port < ports_m.size(); port++)
     {
-        if (it->expiration.expired())
+        auto it = storage_m.interfaces.find(ports_m[port]->getInterface());
+        if (it != storage_m.interfaces.end() && it->second.up && (carrier & (PortTable::PortMask(1) << port)))
         {
-            it = storage_m.sentPackets.erase(it);
+            up |= PortTable::PortMask(1) << port;
         }
-        else
+    }
+
+    for (uint32_t lag = 0; lag < ports.lags(); lag++)
+    {
+        PortTable::PortMask active = ports.lagMembers(lag) & up;
+        if (active != ports.lagActive(lag))
         {
-            it++;
+            qInfo("The LAG %s has %d of its %d links up", ports.lagName(lag).c_str(), __builtin_popcount(active),
+                  __builtin_popcount(ports.lagMembers(lag)));
         }
     }
+    ports.setLinks(up);
 }
 
-void NetworkSwitch::updateSessions()
+// learning only sets the hit bit, the entries are aged here once per epoch
+// the table has its own lock, the workers keep switching meanwhile
+// a changed timeout is picked up from the next sweep on
+void NetworkSwitch::sweepMac()
 {
-    lock_guard guard(storageMutex_m);
-    for (auto it = storage_m.sessions.begin(); it != storage_m.sessions.end();)
+    milliseconds timeout;
     {
-        if (it->expiration.expired())
-        {
-            it = storage_m.sessions.erase(it);
-        }
-        else
+        lock_guard<mutex> lock(locks_m.device);
+        timeout = storage_m.deviceInfo.defaultMacTimeout;
+    }
+
+    {
+        lock_guard<mutex> dataplane(dataplane_m);
+
+        // hits in the fast path only matter for aging, so they are collected right before it
+        if (fastPath_m)
         {
-            it++;
+            fastPath_m->refresh(storage_m.macTable);
         }
+        storage_m.macTable.sweep(steady_clock::now(), timeout, [&](uint64_t key) {
+            if (fastPath_m)
+            {
+                fastPath_m->forget(keyMac(key));
+            }
+        });
     }
+
+    storage_m.housekeeping.schedule(std::max<milliseconds>(timeout / MAC_AGING_EPOCHS, 1ms), [this]() { sweepMac(); });
 }
 
 void NetworkSwitch::setMacTimeout(int32_t newTimeout)
 {
-    lock_guard guard(storageMutex_m);
+    lock_guard guard(locks_m.device);
     storage_m.deviceInfo.defaultMacTimeout = duration_cast<milliseconds>(
         seconds{newTimeout}
     );
@@ -1,15 +1,20 @@
 #pragma once
 
+#include "dataplane_config.h"
 #include "network_handle.h"
 #include "rest_handle.h"
 #include "shared_storage.h"
 #include "shared_storage_handle.h"
+#include "tx_engine.h"
+#include "xdp_fastpath.h"
+#include "xdp_socket.h"
 #include <memory>
 #include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
 
-using std::string, std::pair, std::mutex, std::lock_guard, std::unique_ptr;
+using std::string, std::pair, std::mutex, std::lock_guard, std::unique_ptr, std::vector;
 
 struct NetworkSwitch
 {
@@ -28,6 +33,8 @@ public:
         int32_t id;
         bool up;
         interface networkInterface;
+        BurstStatistics rx;
+        TxStatistics tx;
     };
 public:
     NetworkSwitch();
@@ -38,13 +45,12 @@ public:
     ~NetworkSwitch();
 
 public:
-    void startNetwork(string interface1, string interface2);
+    // the ports get their indices in the order they are given, at most MAX_SWITCH_PORTS of them
+    void startNetwork(const vector<string> & interfaces, DataplaneConfig config = DataplaneConfig());
+    void startNetwork(string interface1, string interface2, DataplaneConfig config = DataplaneConfig());
     void startRest(int16_t port);
     void stopNetwork();
     void stopRest();
-    void updateMac();
-    void updatePackets();
-    void updateSessions();
 
     void setMacTimeout(int32_t newTimeout);
 
@@ -57,13 +63,24 @@ public:
     void applyMac(milliseconds newTimeout);
 
     SharedStorageHandle getStorage();
-    pair<InterfaceData, InterfaceData> interfaces();
+    vector<InterfaceData> interfaces(); // in the order of the port indices
     SwitchState state() const;
 
+private:
+    // both run on the housekeeping thread
+    void synchronize(); // the statistics of the dataplane and the interface state of the fast path
+    void sweepMac();    // ages the MAC table by an epoch, then schedules itself for the next one
+    void pollLinks();   // the members of the LAGs that are picked
+
 private:
     SharedStorage storage_m;
-    mutable mutex storageMutex_m;
-    unique_ptr<NetworkThreadHandle> interface1_m, interface2_m;
+    mutable StorageLocks locks_m;
+    mutex dataplane_m; // the dataplane objects are replaced under it, the housekeeping thread uses them under it
+    unique_ptr<XdpFastPath> fastPath_m; // must outlive the AF_XDP sockets
+    unique_ptr<XdpFabric> xdp_m;        // must outlive the network threads
+    unique_ptr<FramePool> pool_m;       // must outlive the network and TX threads
+    unique_ptr<TxEngine> tx_m;          // must outlive the network threads
+    vector<unique_ptr<NetworkThreadHandle>> ports_m; // indexed by the port table
     unique_ptr<RestThreadHandle> restThread_m;
 
     SwitchState state_m;
@@ -71,6 +88,6 @@ private:
 
 inline SharedStorageHandle NetworkSwitch::getStorage()
 {
-    return SharedStorageHandle(storageMutex_m, storage_m);
+    return SharedStorageHandle(locks_m, storage_m);
 }
 
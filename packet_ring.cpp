@@ -0,0 +1,333 @@
+#include "packet_ring.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/ethtool.h>
+#include <linux/if_ether.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <poll.h>
+#include <qlogging.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::runtime_error ringError(int fd, const string & what)
+{
+    auto error = std::runtime_error(what + ": " + std::strerror(errno));
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return error;
+}
+
+RxRing::RxRing(const string & interfaceName, const RingConfig & config)
+    : fd_m(-1),
+      map_m(nullptr),
+      mapSize_m(0),
+      config_m(config),
+      current_m(0),
+      burst_m{}
+{
+    int index = if_nametoindex(interfaceName.c_str());
+    if (index == 0)
+    {
+        throw ringError(-1, "No interface named " + interfaceName);
+    }
+
+    fd_m = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd_m < 0)
+    {
+        throw ringError(-1, "Cannot open a packet socket on " + interfaceName);
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd_m, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+    {
+        throw ringError(fd_m, "TPACKET_V3 is not supported");
+    }
+
+    // has to come before the ring is set up
+    if (config_m.vnetHeader)
+    {
+        int one = 1;
+        if (setsockopt(fd_m, SOL_PACKET, PACKET_VNET_HDR, &one, sizeof(one)) < 0)
+        {
+            throw ringError(fd_m, "PACKET_VNET_HDR is not supported on " + interfaceName);
+        }
+    }
+
+    tpacket_req3 request{};
+    request.tp_block_size = config_m.blockSize;
+    request.tp_block_nr = config_m.blockCount;
+    request.tp_frame_size = config_m.frameSize;
+    request.tp_frame_nr = (config_m.blockSize / config_m.frameSize) * config_m.blockCount;
+    request.tp_retire_blk_tov = config_m.blockTimeout.count();
+    if (setsockopt(fd_m, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0)
+    {
+        throw ringError(fd_m, "Cannot set up the RX ring on " + interfaceName);
+    }
+
+    mapSize_m = static_cast<size_t>(config_m.blockSize) * config_m.blockCount;
+    void *map = mmap(nullptr, mapSize_m, PROT_READ | PROT_WRITE, MAP_SHARED, fd_m, 0);
+    if (map == MAP_FAILED)
+    {
+        throw ringError(fd_m, "Cannot map the RX ring of " + interfaceName);
+    }
+    map_m = static_cast<uint8_t *>(map);
+
+    sockaddr_ll address{};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = index;
+    if (bind(fd_m, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        munmap(map_m, mapSize_m);
+        throw ringError(fd_m, "Cannot bind the RX ring to " + interfaceName);
+    }
+
+    // the frames the switch sends out itself must not come back in,
+    // older kernels still copy them to the ring and readBlock() skips them by their packet type
+    int one = 1;
+    if (setsockopt(fd_m, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one)) < 0)
+    {
+        qDebug("PACKET_IGNORE_OUTGOING is not available on %s: %s", interfaceName.c_str(), std::strerror(errno));
+    }
+
+    packet_mreq membership{};
+    membership.mr_ifindex = index;
+    membership.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(fd_m, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+    {
+        munmap(map_m, mapSize_m);
+        throw ringError(fd_m, "Cannot enable promiscuous mode on " + interfaceName);
+    }
+}
+
+RxRing::~RxRing()
+{
+    if (map_m != nullptr)
+    {
+        munmap(map_m, mapSize_m);
+    }
+    if (fd_m >= 0)
+    {
+        close(fd_m);
+    }
+}
+
+bool RxRing::wait(milliseconds timeout, int wakeup)
+{
+    if (blockReady())
+    {
+        return true;
+    }
+
+    pollfd descriptors[2]{};
+    descriptors[0].fd = fd_m;
+    descriptors[0].events = POLLIN | POLLERR;
+    descriptors[1].fd = wakeup; // ignored by poll() if negative
+    descriptors[1].events = POLLIN;
+    poll(descriptors, 2, timeout.count());
+
+    return blockReady();
+}
+
+// the group ids are shared by the whole network namespace, one picked here could belong to another process
+// that fans out the same interface, so a new group gets its id from the kernel
+uint16_t RxRing::joinFanout(int group)
+{
+    int flags = PACKET_FANOUT_FLAG_DEFRAG | (group < 0 ? PACKET_FANOUT_FLAG_UNIQUEID : 0);
+    int fanout = (group < 0 ? 0 : group) | ((PACKET_FANOUT_HASH | flags) << 16);
+    if (setsockopt(fd_m, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+    {
+        throw ringError(-1, group < 0 ? string("Cannot create a fanout group")
+                                      : "Cannot join fanout group " + std::to_string(group));
+    }
+
+    socklen_t length = sizeof(fanout);
+    if (getsockopt(fd_m, SOL_PACKET, PACKET_FANOUT, &fanout, &length) < 0)
+    {
+        throw ringError(-1, "Cannot read the fanout group");
+    }
+    return static_cast<uint16_t>(fanout & 0xffff);
+}
+
+int RxRing::fd() const
+{
+    return fd_m;
+}
+
+uint32_t rxQueueCount(const string & interfaceName)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    ethtool_channels channels{};
+    channels.cmd = ETHTOOL_GCHANNELS;
+    ifreq request{};
+    std::strncpy(request.ifr_name, interfaceName.c_str(), IFNAMSIZ - 1);
+    request.ifr_data = reinterpret_cast<char *>(&channels);
+    int result = ioctl(fd, SIOCETHTOOL, &request);
+    close(fd);
+
+    if (result < 0 || channels.combined_count + channels.rx_count == 0)
+    {
+        return 1;
+    }
+    return channels.combined_count + channels.rx_count;
+}
+
+bool linkUp(const string & interfaceName)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    ifreq request{};
+    std::strncpy(request.ifr_name, interfaceName.c_str(), IFNAMSIZ - 1);
+    int result = ioctl(fd, SIOCGIFFLAGS, &request);
+    close(fd);
+    return result >= 0 && (request.ifr_flags & IFF_UP) && (request.ifr_flags & IFF_RUNNING);
+}
+
+bool isSuperFrame(const FrameView & frame)
+{
+    return frame.vnet != nullptr && frame.vnet->gsoType != VNET_GSO_NONE && frame.vnet->gsoSize != 0;
+}
+
+uint32_t gsoSegments(const FrameView & frame)
+{
+    if (!isSuperFrame(frame))
+    {
+        return 1;
+    }
+
+    // hdr_len is only a hint, the real headers end after the transport header
+    uint32_t headers = frame.vnet->hdrLen;
+    if (frame.vnet->flags & VNET_F_NEEDS_CSUM)
+    {
+        uint32_t transport = frame.vnet->csumStart;
+        switch (frame.vnet->gsoType & ~VNET_GSO_ECN)
+        {
+        case VNET_GSO_TCPV4:
+        case VNET_GSO_TCPV6:
+            if (transport + 12 < frame.size)
+            {
+                headers = transport + (frame.data[transport + 12] >> 4) * 4;
+            }
+            break;
+        case VNET_GSO_UDP:
+            headers = transport + 8;
+            break;
+        }
+    }
+
+    if (headers >= frame.size)
+    {
+        return 1;
+    }
+    return (frame.size - headers + frame.vnet->gsoSize - 1) / frame.vnet->gsoSize;
+}
+
+tpacket_block_desc *RxRing::block(uint32_t index) const
+{
+    return reinterpret_cast<tpacket_block_desc *>(map_m + static_cast<size_t>(index) * config_m.blockSize);
+}
+
+bool RxRing::blockReady() const
+{
+    return (__atomic_load_n(&block(current_m)->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) != 0;
+}
+
+void RxRing::releaseBlock()
+{
+    __atomic_store_n(&block(current_m)->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    current_m = (current_m + 1) % config_m.blockCount;
+}
+
+// the kernel puts the virtio_net_hdr right in front of the MAC header
+// a stripped tag of another TPID, 802.1ad, isn't one of ours, the frame is left as untagged
+FrameView ringFrame(const uint8_t *frame, bool vnetHeader)
+{
+    auto *header = reinterpret_cast<const tpacket3_hdr *>(frame);
+    FrameView view{frame + header->tp_mac, header->tp_snaplen, nullptr};
+    if (vnetHeader)
+    {
+        view.vnet = reinterpret_cast<const VnetHeader *>(frame + header->tp_mac - sizeof(VnetHeader));
+    }
+    if ((header->tp_status & TP_STATUS_VLAN_VALID) &&
+        (!(header->tp_status & TP_STATUS_VLAN_TPID_VALID) || header->hv1.tp_vlan_tpid == ETH_P_8021Q))
+    {
+        view.stripped = true;
+        view.strippedTci = static_cast<uint16_t>(header->hv1.tp_vlan_tci);
+    }
+    return view;
+}
+
+bool vlanTag(const FrameView & frame, uint16_t & tci)
+{
+    if (frame.stripped)
+    {
+        tci = frame.strippedTci;
+        return true;
+    }
+    if (frame.size < ETHERNET_HEADER_SIZE + VLAN_TAG_SIZE ||
+        ((frame.data[ETHERNET_TYPE_OFFSET] << 8) | frame.data[ETHERNET_TYPE_OFFSET + 1]) != ETH_P_8021Q)
+    {
+        return false;
+    }
+    tci = (frame.data[ETHERNET_HEADER_SIZE] << 8) | frame.data[ETHERNET_HEADER_SIZE + 1];
+    return true;
+}
+
+void retagFrame(uint8_t *& data, uint32_t & size, VnetHeader *vnet, bool tagged, uint16_t tci)
+{
+    uint16_t current = 0;
+    bool hasTag = vlanTag({data, size, vnet}, current); // only the one in data
+    int32_t shift = 0;
+    if (hasTag && tagged)
+    {
+        data[ETHERNET_HEADER_SIZE] = tci >> 8;
+        data[ETHERNET_HEADER_SIZE + 1] = tci & 0xff;
+        return;
+    }
+    if (tagged)
+    {
+        std::memmove(data - VLAN_TAG_SIZE, data, ETHERNET_TYPE_OFFSET);
+        data -= VLAN_TAG_SIZE;
+        size += VLAN_TAG_SIZE;
+        data[ETHERNET_TYPE_OFFSET] = ETH_P_8021Q >> 8;
+        data[ETHERNET_TYPE_OFFSET + 1] = ETH_P_8021Q & 0xff;
+        data[ETHERNET_HEADER_SIZE] = tci >> 8;
+        data[ETHERNET_HEADER_SIZE + 1] = tci & 0xff;
+        shift = VLAN_TAG_SIZE;
+    }
+    else if (hasTag)
+    {
+        std::memmove(data + VLAN_TAG_SIZE, data, ETHERNET_TYPE_OFFSET);
+        data += VLAN_TAG_SIZE;
+        size -= VLAN_TAG_SIZE;
+        shift = -static_cast<int32_t>(VLAN_TAG_SIZE);
+    }
+
+    if (vnet != nullptr && shift != 0)
+    {
+        if (vnet->hdrLen != 0)
+        {
+            vnet->hdrLen += shift;
+        }
+        if (vnet->flags & VNET_F_NEEDS_CSUM)
+        {
+            vnet->csumStart += shift;
+        }
+    }
+}
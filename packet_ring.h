@@ -0,0 +1,147 @@
+#pragma once
+
+#include "dataplane_config.h"
+#include <cstdint>
+#include <linux/if_packet.h>
+#include <string>
+#include <vector>
+
+using std::string, std::vector;
+
+// struct virtio_net_hdr, <linux/virtio_net.h> doesn't compile as C++
+// packet sockets use the host byte order for it
+struct VnetHeader
+{
+    uint8_t flags;
+    uint8_t gsoType;
+    uint16_t hdrLen;
+    uint16_t gsoSize;
+    uint16_t csumStart;
+    uint16_t csumOffset;
+};
+
+static constexpr uint8_t VNET_F_NEEDS_CSUM = 1;
+static constexpr uint8_t VNET_GSO_NONE = 0;
+static constexpr uint8_t VNET_GSO_TCPV4 = 1;
+static constexpr uint8_t VNET_GSO_UDP = 3;
+static constexpr uint8_t VNET_GSO_TCPV6 = 4;
+static constexpr uint8_t VNET_GSO_ECN = 0x80;
+
+static constexpr uint32_t ETHERNET_HEADER_SIZE = 14;
+static constexpr uint32_t ETHERNET_DESTINATION_OFFSET = 0;
+static constexpr uint32_t ETHERNET_SOURCE_OFFSET = 6;
+static constexpr uint32_t ETHERNET_TYPE_OFFSET = 12;
+static constexpr uint32_t VLAN_TAG_SIZE = 4; // the TPID and the TCI of an 802.1Q tag
+static constexpr uint16_t VLAN_ID_MASK = 0x0fff; // of the TCI, the priority and DEI bits are above it
+
+// a received frame, only valid until its buffer is handed back to the kernel
+// the ring, the UMEM and libpcap all hand out frames this way
+// the kernel takes the outer 802.1Q tag off before a packet socket sees the frame, the ring reports it aside
+struct FrameView
+{
+    const uint8_t *data;
+    uint32_t size;
+    const VnetHeader *vnet; // nullptr unless the ring uses PACKET_VNET_HDR
+    bool stripped = false;  // the tag isn't in data, strippedTci is its TCI
+    uint16_t strippedTci = 0;
+};
+
+// a GSO frame that the egress kernel still has to cut into segments
+bool isSuperFrame(const FrameView & frame);
+
+// how many frames a GSO super-frame stands for on the wire, 1 for everything else
+uint32_t gsoSegments(const FrameView & frame);
+
+// whether the frame came with an 802.1Q tag, in data or stripped, tci is its tag control information then
+bool vlanTag(const FrameView & frame, uint16_t & tci);
+
+// the frame at a tpacket3_hdr of a ring block, with the tag the kernel stripped
+FrameView ringFrame(const uint8_t *frame, bool vnetHeader);
+
+// gives a frame the tag tci, or takes its tag away if tagged is false, in place
+// a tag is pushed into the VLAN_TAG_SIZE bytes in front of data, which have to be there,
+// only the addresses move, the offsets of vnet are moved along with the headers
+void retagFrame(uint8_t *& data, uint32_t & size, VnetHeader *vnet, bool tagged, uint16_t tci);
+
+// a PACKET_MMAP TPACKET_V3 receive ring bound to one interface
+// the kernel fills whole blocks of frames, which are then read in place
+struct RxRing
+{
+public:
+    RxRing(const string & interfaceName, const RingConfig & config);
+    RxRing(RxRing &&) = delete;
+    RxRing(const RxRing &) = delete;
+    RxRing & operator=(RxRing &&) = delete;
+    RxRing & operator=(const RxRing &) = delete;
+    ~RxRing();
+
+public:
+    // true if the current block can be read, also returns early once wakeup becomes readable
+    bool wait(milliseconds timeout, int wakeup = -1);
+
+    // spreads the traffic of the interface over all the rings in the group,
+    // frames of one flow always land in the same ring
+    // a negative group creates a new one, with an id no other socket of the network namespace uses,
+    // returns the id of the group for the other rings to join
+    uint16_t joinFanout(int group);
+
+    // calls handler(const vector<FrameView> &) with up to burstSize frames at a time
+    // until the current block is exhausted, then gives the block back to the kernel
+    template <typename Handler> void readBlock(uint32_t burstSize, Handler && handler);
+
+    int fd() const;
+
+private:
+    tpacket_block_desc *block(uint32_t index) const;
+    bool blockReady() const;
+    void releaseBlock();
+
+private:
+    int fd_m;
+    uint8_t *map_m;
+    size_t mapSize_m;
+    RingConfig config_m;
+    uint32_t current_m;
+    vector<FrameView> burst_m;
+};
+
+// the number of RX queues of an interface, 1 if the driver doesn't say
+uint32_t rxQueueCount(const string & interfaceName);
+
+// whether the interface is up and has a carrier, IFF_RUNNING
+bool linkUp(const string & interfaceName);
+
+template <typename Handler> void RxRing::readBlock(uint32_t burstSize, Handler && handler)
+{
+    auto *desc = block(current_m);
+    auto *frame = reinterpret_cast<uint8_t *>(desc) + desc->hdr.bh1.offset_to_first_pkt;
+
+    for (uint32_t i = 0; i < desc->hdr.bh1.num_pkts; i++)
+    {
+        auto *header = reinterpret_cast<tpacket3_hdr *>(frame);
+        auto *address = reinterpret_cast<const sockaddr_ll *>(frame + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+        if (address->sll_pkttype == PACKET_OUTGOING)
+        {
+            frame += header->tp_next_offset;
+            continue;
+        }
+
+        burst_m.push_back(ringFrame(frame, config_m.vnetHeader));
+        frame += header->tp_next_offset;
+
+        if (burst_m.size() == burstSize)
+        {
+            handler(burst_m);
+            burst_m.clear();
+        }
+    }
+
+    // the frames only live as long as the block
+    if (!burst_m.empty())
+    {
+        handler(burst_m);
+        burst_m.clear();
+    }
+
+    releaseBlock();
+}
@@ -0,0 +1,187 @@
+#include "port_table.h"
+#include "mac_table.h"
+#include <qlogging.h>
+
+PortTable::PortTable()
+    : ports_m{},
+      addresses_m{},
+      flood_m{},
+      local_m{},
+      pvids_m{},
+      modes_m{},
+      members_m{},
+      tagged_m{},
+      vlanIndices_m{},
+      vlans_m{},
+      lags_m{},
+      lagOf_m{},
+      logical_m{},
+      lagPorts_m(0),
+      hidden_m(0),
+      lagCount_m(0),
+      size_m(0)
+{
+    clear();
+}
+
+// two ports with the same address, bonded ones for example, keep the first one as the local port
+uint32_t PortTable::add(const interface & port, const VlanPortConfig & vlans)
+{
+    return add(port, macKey(port.hw_address()), vlans);
+}
+
+uint32_t PortTable::add(const interface & port, uint64_t address, const VlanPortConfig & vlans)
+{
+    uint32_t index = this->index(port);
+    if (index != NO_PORT || size_m >= MAX_PORTS)
+    {
+        return index;
+    }
+
+    index = size_m++;
+    ports_m[index] = port;
+    addresses_m[index] = address;
+    for (uint32_t slot = hash(addresses_m[index]);; slot = (slot + 1) % LOCAL_SLOTS)
+    {
+        auto & entry = local_m[slot];
+        if (entry.port == NO_PORT)
+        {
+            entry = {addresses_m[index], index};
+            break;
+        }
+        if (entry.key == addresses_m[index])
+        {
+            break;
+        }
+    }
+
+    updateFlood();
+
+    // the port VLAN always leaves untagged, even if a trunk lists it as allowed too
+    modes_m[index] = vlans.mode;
+    pvids_m[index] = vlans.pvid;
+    join(index, vlans.pvid, false);
+    if (vlans.mode == VlanMode::Trunk)
+    {
+        for (uint16_t vlan : vlans.allowed)
+        {
+            if (vlan != vlans.pvid)
+            {
+                join(index, vlan, true);
+            }
+        }
+    }
+    return index;
+}
+
+// a frame never goes back to the LAG it came from, and only to the port standing for any other
+void PortTable::updateFlood()
+{
+    PortMask all = size_m == sizeof(PortMask) * 8 ? ~PortMask(0) : (PortMask(1) << size_m) - 1;
+    for (uint32_t i = 0; i < size_m; i++)
+    {
+        flood_m[i] = all & ~hidden_m & ~(PortMask(1) << logical_m[i]);
+    }
+}
+
+uint32_t PortTable::addLag(const std::string & name, PortMask members)
+{
+    PortMask all = size_m == sizeof(PortMask) * 8 ? ~PortMask(0) : (PortMask(1) << size_m) - 1;
+    members &= all & ~(lagPorts_m | hidden_m);
+    if (members == 0 || lagCount_m >= MAX_LAGS)
+    {
+        qWarning("The LAG %s has no ports left or there are too many LAGs, it is left out", name.c_str());
+        return NO_LAG;
+    }
+
+    uint32_t lag = lagCount_m++;
+    lags_m[lag].name = name;
+    lags_m[lag].members = members;
+    lags_m[lag].active.store(members, std::memory_order_relaxed);
+    uint32_t primary = __builtin_ctz(members);
+    for (PortMask left = members; left != 0; left &= left - 1)
+    {
+        lagOf_m[__builtin_ctz(left)] = lag;
+        logical_m[__builtin_ctz(left)] = primary;
+    }
+    lagPorts_m |= PortMask(1) << primary;
+    hidden_m |= members & ~(PortMask(1) << primary);
+    updateFlood();
+    return lag;
+}
+
+void PortTable::setLinks(PortMask up)
+{
+    for (uint32_t lag = 0; lag < lagCount_m; lag++)
+    {
+        lags_m[lag].active.store(lags_m[lag].members & up, std::memory_order_relaxed);
+    }
+}
+
+void PortTable::join(uint32_t port, uint16_t vlan, bool tagged)
+{
+    if (vlan == NO_VLAN || vlan >= VLANS - 1)
+    {
+        qWarning("VLAN %u is not a valid VLAN, port %u doesn't join it", vlan, port);
+        return;
+    }
+    if (vlanIndices_m[vlan] == NO_VLAN_INDEX)
+    {
+        if (vlans_m.size() >= MAX_VLANS)
+        {
+            qWarning("Too many VLANs, port %u doesn't join VLAN %u", port, vlan);
+            return;
+        }
+        vlanIndices_m[vlan] = vlans_m.size();
+        vlans_m.push_back(vlan);
+    }
+
+    members_m[vlan] |= PortMask(1) << port;
+    if (tagged)
+    {
+        tagged_m[vlan] |= PortMask(1) << port;
+    }
+}
+
+void PortTable::clear()
+{
+    for (auto & entry : local_m)
+    {
+        entry = {0, NO_PORT};
+    }
+    flood_m.fill(0);
+    addresses_m.fill(0);
+    pvids_m.fill(DEFAULT_VLAN);
+    modes_m.fill(VlanMode::Access);
+    members_m.fill(0);
+    tagged_m.fill(0);
+    vlanIndices_m.fill(NO_VLAN_INDEX);
+    vlans_m.clear();
+    for (auto & lag : lags_m)
+    {
+        lag.name.clear();
+        lag.members = 0;
+        lag.active.store(0, std::memory_order_relaxed);
+    }
+    lagOf_m.fill(NO_LAG);
+    for (uint32_t i = 0; i < MAX_PORTS; i++)
+    {
+        logical_m[i] = i;
+    }
+    lagPorts_m = 0;
+    hidden_m = 0;
+    lagCount_m = 0;
+    size_m = 0;
+}
+
+uint32_t PortTable::index(const interface & port) const
+{
+    for (uint32_t i = 0; i < size_m; i++)
+    {
+        if (ports_m[i] == port)
+        {
+            return i;
+        }
+    }
+    return NO_PORT;
+}
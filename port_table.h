@@ -0,0 +1,277 @@
+#pragma once
+
+#include "dataplane_config.h"
+#include "settings.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <tins/network_interface.h>
+#include <vector>
+
+using interface = Tins::NetworkInterface;
+
+// the ports of the switch, each with a dense index in the order they were added
+// the table is filled before the workers start and doesn't change while they run, so they read it without a lock
+// the addresses of the ports are kept in a small hash table, so telling whether a frame is meant for the switch
+// takes a probe or two, and the ports a frame is flooded to are worked out once per ingress port
+// every VLAN has the mask of its member ports and of the ones it leaves tagged, a flood domain is the intersection
+// of the ingress flood mask and the members, VLANs with ports in them also get a dense index for the statistics
+//
+// the members of a LAG act as one port, its lowest member, which the MAC table points at and the flood masks
+// contain, the flow hash of a frame then picks one of the members with their link up
+// the links are the only thing that changes while the workers run, they are a word per LAG set at once
+struct PortTable
+{
+public:
+    using PortMask = uint32_t;
+    static constexpr uint32_t MAX_PORTS = MAX_SWITCH_PORTS;
+    static constexpr uint32_t NO_PORT = UINT32_MAX;
+    static constexpr uint16_t VLANS = 4096;
+    static constexpr uint16_t NO_VLAN = 0; // VLAN 0 only marks a priority tag
+    static constexpr uint32_t NO_VLAN_INDEX = UINT32_MAX;
+    static constexpr uint32_t NO_LAG = UINT32_MAX;
+    static_assert(MAX_PORTS <= sizeof(PortMask) * 8, "every port needs a bit in the flood mask");
+
+    PortTable();
+    PortTable(PortTable &&) = delete;
+    PortTable(const PortTable &) = delete;
+    PortTable & operator=(PortTable &&) = delete;
+    PortTable & operator=(const PortTable &) = delete;
+
+public:
+    // the index it already has if it was added before, NO_PORT if full
+    // VLANs past MAX_VLANS and invalid ones are left out of the membership
+    uint32_t add(const interface & port, const VlanPortConfig & vlans = VlanPortConfig());
+    // with the address of the port as a key, the interface isn't asked for it
+    uint32_t add(const interface & port, uint64_t address, const VlanPortConfig & vlans);
+    // after all the ports, members already in a LAG are left out, NO_LAG if no member is left or the LAGs are full
+    uint32_t addLag(const std::string & name, PortMask members);
+    void clear();
+
+    uint32_t size() const;
+    const interface & operator[](uint32_t index) const;
+    uint32_t index(const interface & port) const; // NO_PORT if it isn't a port of the switch
+    uint32_t local(uint64_t key) const;           // the port with the address, see macKey(), NO_PORT for other hosts
+    uint64_t address(uint32_t index) const;       // the address of the port as a key
+    PortMask flood(uint32_t ingress, uint16_t vlan) const; // the members of the VLAN but the ingress port
+
+    // the VLAN of a frame that came in on the port, tag is the VLAN ID of its 802.1Q tag, NO_VLAN if it has none
+    // NO_VLAN as well if the port doesn't take the frame
+    uint16_t ingressVlan(uint32_t port, uint16_t tag) const;
+    bool member(uint32_t port, uint16_t vlan) const;
+    PortMask members(uint16_t vlan) const;
+    PortMask tagged(uint16_t vlan) const; // the members that send the frames of the VLAN tagged
+    uint16_t pvid(uint32_t port) const;
+    VlanMode mode(uint32_t port) const;
+    uint32_t vlanIndex(uint16_t vlan) const; // NO_VLAN_INDEX if no port is in the VLAN
+    const std::vector<uint16_t> & vlans() const; // in the order of their indices
+
+    uint32_t logical(uint32_t port) const; // the port that stands for its LAG, the port itself outside of LAGs
+    uint32_t pick(uint32_t port, uint64_t flow) const; // the member to send a flow to, NO_PORT if all are down
+    PortMask pickMembers(PortMask ports, uint64_t flow) const; // every LAG in the mask replaced by one of its members
+    void setLinks(PortMask up); // the members of the LAGs that may be picked from now on
+    uint32_t lags() const;
+    uint32_t lag(uint32_t port) const; // NO_LAG if it isn't in one
+    const std::string & lagName(uint32_t lag) const;
+    PortMask lagMembers(uint32_t lag) const;
+    PortMask lagActive(uint32_t lag) const;
+
+private:
+    static constexpr uint32_t LOCAL_BITS = 6;
+    static constexpr uint32_t LOCAL_SLOTS = 1 << LOCAL_BITS; // at most half full
+    static_assert(LOCAL_SLOTS >= 2 * MAX_PORTS, "the address table has to stay sparse");
+
+    struct Local
+    {
+        uint64_t key;
+        uint32_t port; // NO_PORT for an empty slot
+    };
+
+    struct Lag
+    {
+        std::string name;
+        PortMask members;
+        std::atomic<PortMask> active; // the members with their link up
+    };
+
+    static uint32_t hash(uint64_t key);
+    void join(uint32_t port, uint16_t vlan, bool tagged);
+    void updateFlood();
+
+private:
+    std::array<interface, MAX_PORTS> ports_m;
+    std::array<uint64_t, MAX_PORTS> addresses_m;
+    std::array<PortMask, MAX_PORTS> flood_m;
+    std::array<Local, LOCAL_SLOTS> local_m;
+    std::array<uint16_t, MAX_PORTS> pvids_m;
+    std::array<VlanMode, MAX_PORTS> modes_m;
+    std::array<PortMask, VLANS> members_m;
+    std::array<PortMask, VLANS> tagged_m;
+    std::array<uint32_t, VLANS> vlanIndices_m;
+    std::vector<uint16_t> vlans_m;
+    std::array<Lag, MAX_LAGS> lags_m;
+    std::array<uint32_t, MAX_PORTS> lagOf_m;
+    std::array<uint32_t, MAX_PORTS> logical_m;
+    PortMask lagPorts_m; // the ports that stand for a LAG
+    PortMask hidden_m;   // the other members, left out of the flood masks
+    uint32_t lagCount_m;
+    uint32_t size_m;
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline uint32_t PortTable::hash(uint64_t key)
+{
+    return static_cast<uint32_t>((key * 0x9e3779b97f4a7c15) >> (64 - LOCAL_BITS));
+}
+
+inline uint32_t PortTable::size() const
+{
+    return size_m;
+}
+
+inline const interface & PortTable::operator[](uint32_t index) const
+{
+    return ports_m[index];
+}
+
+inline uint32_t PortTable::local(uint64_t key) const
+{
+    for (uint32_t slot = hash(key);; slot = (slot + 1) % LOCAL_SLOTS)
+    {
+        const auto & entry = local_m[slot];
+        if (entry.port == NO_PORT || entry.key == key)
+        {
+            return entry.port;
+        }
+    }
+}
+
+inline uint64_t PortTable::address(uint32_t index) const
+{
+    return addresses_m[index];
+}
+
+inline PortTable::PortMask PortTable::flood(uint32_t ingress, uint16_t vlan) const
+{
+    if (ingress >= size_m)
+    {
+        return 0;
+    }
+    return flood_m[ingress] & members_m[vlan % VLANS];
+}
+
+// a priority tag doesn't pick a VLAN, the frame belongs to the port VLAN like an untagged one
+inline uint16_t PortTable::ingressVlan(uint32_t port, uint16_t tag) const
+{
+    if (port >= size_m)
+    {
+        return NO_VLAN;
+    }
+    if (tag == NO_VLAN)
+    {
+        return pvids_m[port];
+    }
+    return modes_m[port] == VlanMode::Trunk && member(port, tag) ? tag : NO_VLAN;
+}
+
+inline bool PortTable::member(uint32_t port, uint16_t vlan) const
+{
+    return port < MAX_PORTS && (members_m[vlan % VLANS] & (PortMask(1) << port)) != 0;
+}
+
+inline PortTable::PortMask PortTable::members(uint16_t vlan) const
+{
+    return members_m[vlan % VLANS];
+}
+
+inline PortTable::PortMask PortTable::tagged(uint16_t vlan) const
+{
+    return tagged_m[vlan % VLANS];
+}
+
+inline uint16_t PortTable::pvid(uint32_t port) const
+{
+    return pvids_m[port];
+}
+
+inline VlanMode PortTable::mode(uint32_t port) const
+{
+    return modes_m[port];
+}
+
+inline uint32_t PortTable::vlanIndex(uint16_t vlan) const
+{
+    return vlanIndices_m[vlan % VLANS];
+}
+
+inline const std::vector<uint16_t> & PortTable::vlans() const
+{
+    return vlans_m;
+}
+
+inline uint32_t PortTable::logical(uint32_t port) const
+{
+    return port < MAX_PORTS ? logical_m[port] : port;
+}
+
+// the same flow keeps its member as long as the set of active members stays the same
+inline uint32_t PortTable::pick(uint32_t port, uint64_t flow) const
+{
+    if (port >= MAX_PORTS || lagOf_m[port] == NO_LAG)
+    {
+        return port;
+    }
+
+    PortMask active = lags_m[lagOf_m[port]].active.load(std::memory_order_relaxed);
+    if (active == 0)
+    {
+        return NO_PORT;
+    }
+    auto chosen = static_cast<uint32_t>(((flow >> 32) * __builtin_popcount(active)) >> 32);
+    for (; chosen != 0; chosen--)
+    {
+        active &= active - 1;
+    }
+    return __builtin_ctz(active);
+}
+
+inline PortTable::PortMask PortTable::pickMembers(PortMask ports, uint64_t flow) const
+{
+    for (PortMask lags = ports & lagPorts_m; lags != 0; lags &= lags - 1)
+    {
+        uint32_t port = __builtin_ctz(lags);
+        uint32_t member = pick(port, flow);
+        ports &= ~(PortMask(1) << port);
+        ports |= member == NO_PORT ? 0 : PortMask(1) << member;
+    }
+    return ports;
+}
+
+inline uint32_t PortTable::lags() const
+{
+    return lagCount_m;
+}
+
+inline uint32_t PortTable::lag(uint32_t port) const
+{
+    return port < MAX_PORTS ? lagOf_m[port] : NO_LAG;
+}
+
+inline const std::string & PortTable::lagName(uint32_t lag) const
+{
+    return lags_m[lag].name;
+}
+
+inline PortTable::PortMask PortTable::lagMembers(uint32_t lag) const
+{
+    return lags_m[lag].members;
+}
+
+inline PortTable::PortMask PortTable::lagActive(uint32_t lag) const
+{
+    return lags_m[lag].active.load(std::memory_order_relaxed);
+}
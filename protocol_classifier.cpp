@@ -0,0 +1,84 @@
+#include "protocol_classifier.h"
+#include <stdexcept>
+
+// the protocols of the statistics and how to recognize them, the first row of a protocol names it
+static const ProtocolRule PROTOCOL_RULES[] = {
+    {Protocol::EthernetII, "EthernetII", ProtocolMatch::Always, 0},
+    {Protocol::ARP, "ARP", ProtocolMatch::EtherType, 0x0806},
+    {Protocol::IP, "IP", ProtocolMatch::EtherType, ProtocolClassifier::ETHERTYPE_IPV4},
+    {Protocol::IPv6, "IPv6", ProtocolMatch::EtherType, ProtocolClassifier::ETHERTYPE_IPV6},
+    {Protocol::TCP, "TCP", ProtocolMatch::IpProtocol, ProtocolClassifier::IP_PROTOCOL_TCP},
+    {Protocol::UDP, "UDP", ProtocolMatch::IpProtocol, ProtocolClassifier::IP_PROTOCOL_UDP},
+    {Protocol::ICMP, "ICMP", ProtocolMatch::IpProtocol, 1},
+    {Protocol::ICMPv6, "ICMPv6", ProtocolMatch::IpProtocol, 58},
+    {Protocol::HTTP, "HTTP", ProtocolMatch::TcpPort, 80},
+    {Protocol::HTTP, "HTTP", ProtocolMatch::TcpPort, 443},
+};
+
+ProtocolClassifier::ProtocolClassifier()
+    : always_m(0),
+      etherTypes_m{},
+      tcpPorts_m{},
+      udpPorts_m{},
+      ipProtocols_m{}
+{
+    for (const auto & rule : PROTOCOL_RULES)
+    {
+        uint32_t bit = protocolBit(rule.protocol);
+        switch (rule.match)
+        {
+        case ProtocolMatch::Always:
+            always_m |= bit;
+            break;
+        case ProtocolMatch::EtherType:
+            etherTypes_m.add(rule.value, bit);
+            break;
+        case ProtocolMatch::IpProtocol:
+            ipProtocols_m[rule.value & 0xff] |= bit;
+            break;
+        case ProtocolMatch::TcpPort:
+            tcpPorts_m.add(rule.value, bit);
+            break;
+        case ProtocolMatch::UdpPort:
+            udpPorts_m.add(rule.value, bit);
+            break;
+        }
+    }
+}
+
+// a value that is already in the set only gets another protocol
+void ProtocolClassifier::ValueSet::add(uint16_t value, uint32_t protocols)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (values[i] == value)
+        {
+            this->protocols[i] |= protocols;
+            return;
+        }
+    }
+    if (size >= SIZE)
+    {
+        throw std::runtime_error("Too many protocol rules match the same header field");
+    }
+    values[size] = value;
+    this->protocols[size] = protocols;
+    size++;
+}
+
+const char *ProtocolClassifier::name(Protocol protocol)
+{
+    for (const auto & rule : PROTOCOL_RULES)
+    {
+        if (rule.protocol == protocol)
+        {
+            return rule.name;
+        }
+    }
+    return "Unknown";
+}
+
+string protocolToString(Protocol protocol)
+{
+    return ProtocolClassifier::name(protocol);
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "packet_ring.h"
+#include "statistics_table.h"
+#include <array>
+#include <cstdint>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string;
+
+// how a protocol is recognized, by a value of one header field
+enum class ProtocolMatch
+{
+    Always,     // every Ethernet frame
+    EtherType,  // after any VLAN tags
+    IpProtocol, // IPv4 protocol or the last IPv6 next header
+    TcpPort,    // either the source or the destination port
+    UdpPort
+};
+
+// one row of the protocol table, a protocol can have several of them
+struct ProtocolRule
+{
+    Protocol protocol;
+    const char *name;
+    ProtocolMatch match;
+    uint16_t value;
+};
+
+// finds every protocol of the statistics in a raw frame in a single pass over its headers,
+// without building the PDU chain
+// the rules are compiled into small lookup tables once, a frame then costs a table lookup per header
+// adding a protocol takes a value of the Protocol enum and a row of the rule table
+struct ProtocolClassifier
+{
+public:
+    static constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+    static constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+    static constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+    static constexpr uint16_t ETHERTYPE_QINQ = 0x88a8;
+    static constexpr uint8_t IP_PROTOCOL_TCP = 6;
+    static constexpr uint8_t IP_PROTOCOL_UDP = 17;
+
+    ProtocolClassifier();
+    ProtocolClassifier(ProtocolClassifier &&) = delete;
+    ProtocolClassifier(const ProtocolClassifier &) = delete;
+    ProtocolClassifier & operator=(ProtocolClassifier &&) = delete;
+    ProtocolClassifier & operator=(const ProtocolClassifier &) = delete;
+
+public:
+    uint32_t classify(const uint8_t *frame, uint32_t size) const; // a set of protocolBit()s
+    static const char *name(Protocol protocol);
+
+private:
+    // up to 8 values of a 16 bit field, compared all at once
+    struct ValueSet
+    {
+        static constexpr uint32_t SIZE = 8;
+
+        alignas(16) std::array<uint16_t, SIZE> values;
+        std::array<uint32_t, SIZE> protocols;
+        uint32_t size;
+
+    public:
+        void add(uint16_t value, uint32_t protocols);
+        uint32_t match(uint16_t value) const;
+    };
+
+    // the IPv6 extension headers that have a next header field, they are skipped
+    static bool extensionHeader(uint8_t nextHeader);
+    static uint16_t read16(const uint8_t *data);
+
+private:
+    uint32_t always_m;
+    ValueSet etherTypes_m;
+    ValueSet tcpPorts_m;
+    ValueSet udpPorts_m;
+    std::array<uint32_t, 256> ipProtocols_m;
+};
+
+string protocolToString(Protocol protocol);
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline uint16_t ProtocolClassifier::read16(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+inline bool ProtocolClassifier::extensionHeader(uint8_t nextHeader)
+{
+    // hop-by-hop, routing, fragment and destination options
+    return nextHeader == 0 || nextHeader == 43 || nextHeader == 44 || nextHeader == 60;
+}
+
+// the compare gives two mask bits per value, the even ones are enough
+inline uint32_t ProtocolClassifier::ValueSet::match(uint16_t value) const
+{
+#ifdef __SSE2__
+    __m128i set = _mm_load_si128(reinterpret_cast<const __m128i *>(values.data()));
+    uint32_t lanes = _mm_movemask_epi8(_mm_cmpeq_epi16(set, _mm_set1_epi16(static_cast<short>(value))));
+    lanes &= 0x5555 & ((1u << (2 * size)) - 1);
+
+    uint32_t matched = 0;
+    for (; lanes != 0; lanes &= lanes - 1)
+    {
+        matched |= protocols[__builtin_ctz(lanes) / 2];
+    }
+    return matched;
+#else
+    uint32_t matched = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        matched |= values[i] == value ? protocols[i] : 0;
+    }
+    return matched;
+#endif
+}
+
+// a non-first fragment carries no transport header, it only counts as IP
+inline uint32_t ProtocolClassifier::classify(const uint8_t *frame, uint32_t size) const
+{
+    uint32_t protocols = always_m;
+    uint32_t offset = ETHERNET_TYPE_OFFSET;
+    if (size < offset + 2)
+    {
+        return protocols;
+    }
+
+    uint16_t etherType = read16(frame + offset);
+    while ((etherType == ETHERTYPE_VLAN || etherType == ETHERTYPE_QINQ) && offset + 6 <= size)
+    {
+        offset += 4;
+        etherType = read16(frame + offset);
+    }
+    offset += 2;
+    protocols |= etherTypes_m.match(etherType);
+
+    uint8_t ipProtocol = 0;
+    bool first = true;
+    if (etherType == ETHERTYPE_IPV4)
+    {
+        if (size < offset + 20 || (frame[offset] & 0x0f) < 5)
+        {
+            return protocols;
+        }
+        ipProtocol = frame[offset + 9];
+        first = (read16(frame + offset + 6) & 0x1fff) == 0;
+        offset += (frame[offset] & 0x0f) * 4;
+    }
+    else if (etherType == ETHERTYPE_IPV6)
+    {
+        if (size < offset + 40)
+        {
+            return protocols;
+        }
+        ipProtocol = frame[offset + 6];
+        offset += 40;
+        for (int skipped = 0; extensionHeader(ipProtocol) && skipped < 4; skipped++)
+        {
+            if (size < offset + 8)
+            {
+                return protocols;
+            }
+            if (ipProtocol == 44)
+            {
+                first = first && (read16(frame + offset + 2) & 0xfff8) == 0;
+                ipProtocol = frame[offset];
+                offset += 8;
+                continue;
+            }
+            ipProtocol = frame[offset];
+            offset += (frame[offset + 1] + 1) * 8;
+        }
+    }
+    else
+    {
+        return protocols;
+    }
+
+    if (!first)
+    {
+        return protocols;
+    }
+    protocols |= ipProtocols_m[ipProtocol];
+
+    if (size < offset + 4)
+    {
+        return protocols;
+    }
+    uint16_t source = read16(frame + offset);
+    uint16_t destination = read16(frame + offset + 2);
+    if (ipProtocol == IP_PROTOCOL_TCP)
+    {
+        protocols |= tcpPorts_m.match(source) | tcpPorts_m.match(destination);
+    }
+    else if (ipProtocol == IP_PROTOCOL_UDP)
+    {
+        protocols |= udpPorts_m.match(source) | udpPorts_m.match(destination);
+    }
+    return protocols;
+}
@@ -1,6 +1,7 @@
 #include "rest_handle.h"
 #include "settings.h"
 #include "symbols.hh"
+#include <arpa/inet.h>
 #include <chrono>
 #include <lithium_http_server.hh>
 #include <lithium_json.hh>
@@ -32,9 +33,16 @@ void RestThreadHandle::thread()
         {
             throw li::http_error::forbidden("Invalid username or password.");
         }
-        auto guard = storageHandle_m.guard();
+        auto guard = storageHandle_m.sessions();
         guard->sessions.push_back({});
 
+        // the session is dropped by the housekeeping thread, nothing polls the sessions for expiry
+        string token{guard->sessions.back().getToken()};
+        SharedStorageHandle handle = storageHandle_m;
+        guard->sessions.back().expiration.arm(storageHandle_m.housekeeping(), [handle, token]() mutable {
+            handle.sessions()->eraseSession(token);
+        });
+
         response.write(encodeJsonObject({
             {"token", encodeJson(guard->sessions.back().token)}
         }));
@@ -50,7 +58,7 @@ void RestThreadHandle::thread()
         qInfo("Auth check on token: %s", string{token}.c_str());
         response.set_header("Content-Type", "application/json");
         {
-            auto guard = storageHandle_m.guard();
+            auto guard = storageHandle_m.sessions();
             for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
             {
                 if (it->getToken() == token)
@@ -80,17 +88,13 @@ void RestThreadHandle::thread()
         string_view token = bearerToken.substr(7, string::npos);
         response.set_header("Content-Type", "application/json");
         {
-            auto guard = storageHandle_m.guard();
-            for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
+            auto guard = storageHandle_m.sessions();
+            if (guard->eraseSession(token))
             {
-                if (it->getToken() == token)
-                {
-                    guard->sessions.erase(it);
-                    response.write(
-                        encodeJsonObject({})
-                    );
-                    return;
-                }
+                response.write(
+                    encodeJsonObject({})
+                );
+                return;
             }
         }
         throw li::http_error::forbidden("Invalid auth token.");
@@ -104,21 +108,13 @@ void RestThreadHandle::thread()
         }
         string_view token = bearerToken.substr(7, string::npos);
         response.set_header("Content-Type", "application/json");
-        bool auth = false;
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
         {
             auto guard = storageHandle_m.guard();
-            for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
-            {
-                if (it->getToken() == token)
-                {
-                    auth = true;
-                    break;
-                }
-            }
-            if (!auth)
-            {
-                throw li::http_error::forbidden("Invalid auth token.");
-            }
+            auto statistics = storageHandle_m.statistics();
 
             vector<string> interfaces;
             for (auto it = guard->interfaces.begin(); it != guard->interfaces.end(); it++)
@@ -127,7 +123,10 @@ void RestThreadHandle::thread()
                     { "id", encodeJson(static_cast<int>(it->first.id())) },
                     { "name", encodeJson(it->second.name) },
                     { "up", encodeJson(it->second.up) },
-                    { "address", encodeJson(it->first.hw_address().to_string()) }
+                    { "address", encodeJson(it->first.hw_address().to_string()) },
+                    { "rx", encodeBurstStatistics(it->second.rx) },
+                    { "tx", encodeTxStatistics(it->second.tx) },
+                    { "statistics", encodeProtocolStatistics(guard->statisticsTable, guard->ports.index(it->first)) }
                 }));
             }
 
@@ -147,21 +146,13 @@ void RestThreadHandle::thread()
         }
         string_view token = bearerToken.substr(7, string::npos);
         response.set_header("Content-Type", "application/json");
-        bool auth = false;
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
         {
             auto guard = storageHandle_m.guard();
-            for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
-            {
-                if (it->getToken() == token)
-                {
-                    auth = true;
-                    break;
-                }
-            }
-            if (!auth)
-            {
-                throw li::http_error::forbidden("Invalid auth token.");
-            }
+            auto statistics = storageHandle_m.statistics();
             auto params = request.url_parameters(s::id = Tins::NetworkInterface::id_type());
             for (auto it = guard->interfaces.begin(); it != guard->interfaces.end(); it++)
             {
@@ -171,7 +162,10 @@ void RestThreadHandle::thread()
                         { "id", encodeJson(static_cast<int>(it->first.id())) },
                         { "name", encodeJson(it->second.name) },
                         { "up", encodeJson(it->second.up) },
-                        { "address", encodeJson(it->first.hw_address().to_string()) }
+                        { "address", encodeJson(it->first.hw_address().to_string()) },
+                        { "rx", encodeBurstStatistics(it->second.rx) },
+                        { "tx", encodeTxStatistics(it->second.tx) },
+                        { "statistics", encodeProtocolStatistics(guard->statisticsTable, guard->ports.index(it->first)) }
                     }));
                     return;
                 }
@@ -188,21 +182,13 @@ void RestThreadHandle::thread()
         }
         string_view token = bearerToken.substr(7, string::npos);
         response.set_header("Content-Type", "application/json");
-        bool auth = false;
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
         {
             auto guard = storageHandle_m.guard();
-            for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
-            {
-                if (it->getToken() == token)
-                {
-                    auth = true;
-                    break;
-                }
-            }
-            if (!auth)
-            {
-                throw li::http_error::forbidden("Invalid auth token.");
-            }
+            auto statistics = storageHandle_m.statistics();
             auto params = request.url_parameters(s::id = Tins::NetworkInterface::id_type());
             auto config = request.post_parameters(s::name = optional<string>(), s::up = optional<int>());
             for (auto it = guard->interfaces.begin(); it != guard->interfaces.end(); it++)
@@ -213,7 +199,7 @@ void RestThreadHandle::thread()
                     {
                         it->second.name = *config.name;
                     }
-                    qInfo("interface configuration, up:\nhas value?: %d\ncurrent value: %d\nnext value: %d", config.up.has_value(), it->second.up, config.up.has_value() ? *(config.up) : it->second.up);
+                    qInfo("interface configuration, up:\nhas value?: %d\ncurrent value: %d\nnext value: %d", config.up.has_value(), static_cast<bool>(it->second.up), config.up.has_value() ? *(config.up) : static_cast<bool>(it->second.up));
                     if (config.up.has_value())
                     {
                         it->second.up = *config.up;
@@ -223,7 +209,10 @@ void RestThreadHandle::thread()
                         { "id", encodeJson(static_cast<int>(it->first.id())) },
                         { "name", encodeJson(it->second.name) },
                         { "up", encodeJson(it->second.up) },
-                        { "address", encodeJson(it->first.hw_address().to_string()) }
+                        { "address", encodeJson(it->first.hw_address().to_string()) },
+                        { "rx", encodeBurstStatistics(it->second.rx) },
+                        { "tx", encodeTxStatistics(it->second.tx) },
+                        { "statistics", encodeProtocolStatistics(guard->statisticsTable, guard->ports.index(it->first)) }
                     }));
                     return;
                 }
@@ -240,32 +229,134 @@ void RestThreadHandle::thread()
         }
         string_view token = bearerToken.substr(7, string::npos);
         response.set_header("Content-Type", "application/json");
-        bool auth = false;
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
         {
             auto guard = storageHandle_m.guard();
-            for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
+            auto device = storageHandle_m.device();
+
+            response.write(
+                encodeJsonObject({
+                    { "hostname", encodeJson(device->deviceInfo.hostname) },
+                    { "timeout", encodeJson(duration_cast<seconds>(device->deviceInfo.defaultMacTimeout).count()) },
+                    { "framePool", encodePoolStatistics(guard->pool) }
+                })
+            );
+        }
+    };
+
+    api.get("/vlan") = [&](li::http_request & request, li::http_response & response) {
+        string_view bearerToken = request.header("Authorization");
+        if (bearerToken.substr(0, 6) != "Bearer")
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        string_view token = bearerToken.substr(7, string::npos);
+        response.set_header("Content-Type", "application/json");
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        {
+            auto guard = storageHandle_m.guard();
+            auto statistics = storageHandle_m.statistics();
+            const auto & ports = guard->ports;
+
+            vector<string> vlans;
+            for (uint16_t vlan : ports.vlans())
             {
-                if (it->getToken() == token)
+                vector<string> members;
+                for (PortTable::PortMask left = ports.members(vlan); left != 0; left &= left - 1)
                 {
-                    auth = true;
-                    break;
+                    uint32_t port = __builtin_ctz(left);
+                    auto entry = guard->interfaces.find(ports[port]);
+                    members.push_back(encodeJsonObject({
+                        { "id", encodeJson(static_cast<int>(ports[port].id())) },
+                        { "name", encodeJson(entry == guard->interfaces.end() ? string() : entry->second.name) },
+                        { "tagged", encodeJson((ports.tagged(vlan) & (PortTable::PortMask(1) << port)) != 0) }
+                    }));
                 }
+
+                auto entry = guard->statisticsTable.readVlan(ports.vlanIndex(vlan));
+                vlans.push_back(encodeJsonObject({
+                    { "id", encodeJson(static_cast<int>(vlan)) },
+                    { "ports", encodeJsonList(members) },
+                    { "input", encodeJson(static_cast<long>(entry.input)) },
+                    { "output", encodeJson(static_cast<long>(entry.output)) },
+                    { "inputBytes", encodeJson(static_cast<long>(entry.inputBytes)) },
+                    { "outputBytes", encodeJson(static_cast<long>(entry.outputBytes)) }
+                }));
             }
-            if (!auth)
+
+            response.write(
+                encodeJsonObject({
+                    { "vlans", encodeJsonList(vlans) }
+                })
+            );
+        }
+    };
+
+    api.get("/lag") = [&](li::http_request & request, li::http_response & response) {
+        string_view bearerToken = request.header("Authorization");
+        if (bearerToken.substr(0, 6) != "Bearer")
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        string_view token = bearerToken.substr(7, string::npos);
+        response.set_header("Content-Type", "application/json");
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        {
+            auto guard = storageHandle_m.guard();
+            auto statistics = storageHandle_m.statistics();
+            const auto & ports = guard->ports;
+
+            // the share of every member in the frames sent to the LAG shows how well the flows hash
+            vector<string> lags;
+            for (uint32_t lag = 0; lag < ports.lags(); lag++)
             {
-                throw li::http_error::forbidden("Invalid auth token.");
+                uint64_t total = 0;
+                for (PortTable::PortMask left = ports.lagMembers(lag); left != 0; left &= left - 1)
+                {
+                    total += guard->statisticsTable.read(__builtin_ctz(left), Protocol::EthernetII).output;
+                }
+
+                vector<string> members;
+                for (PortTable::PortMask left = ports.lagMembers(lag); left != 0; left &= left - 1)
+                {
+                    uint32_t port = __builtin_ctz(left);
+                    auto entry = guard->statisticsTable.read(port, Protocol::EthernetII);
+                    auto interface = guard->interfaces.find(ports[port]);
+                    members.push_back(encodeJsonObject({
+                        { "id", encodeJson(static_cast<int>(ports[port].id())) },
+                        { "name", encodeJson(interface == guard->interfaces.end() ? string()
+                                                                                   : interface->second.name) },
+                        { "active", encodeJson((ports.lagActive(lag) & (PortTable::PortMask(1) << port)) != 0) },
+                        { "output", encodeJson(static_cast<long>(entry.output)) },
+                        { "outputBytes", encodeJson(static_cast<long>(entry.outputBytes)) },
+                        { "share", encodeJson(total == 0 ? 0.0 : static_cast<double>(entry.output) / total) }
+                    }));
+                }
+
+                lags.push_back(encodeJsonObject({
+                    { "name", encodeJson(ports.lagName(lag)) },
+                    { "members", encodeJsonList(members) }
+                }));
             }
 
             response.write(
                 encodeJsonObject({
-                    { "hostname", encodeJson(guard->deviceInfo.hostname) },
-                    { "timeout", encodeJson(duration_cast<seconds>(guard->deviceInfo.defaultMacTimeout).count()) }
+                    { "lags", encodeJsonList(lags) }
                 })
             );
         }
     };
 
-    api.put("/device/edit") = [&](li::http_request & request, li::http_response & response) {
+    api.get("/multicast") = [&](li::http_request & request, li::http_response & response) {
         string_view bearerToken = request.header("Authorization");
         if (bearerToken.substr(0, 6) != "Bearer")
         {
@@ -273,22 +364,117 @@ void RestThreadHandle::thread()
         }
         string_view token = bearerToken.substr(7, string::npos);
         response.set_header("Content-Type", "application/json");
-        bool auth = false;
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
         {
             auto guard = storageHandle_m.guard();
-            for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
+            const auto & ports = guard->ports;
+            auto & table = guard->multicastTable;
+
+            vector<string> groups;
+            for (const auto & group : table.groups())
             {
-                if (it->getToken() == token)
+                char address[INET6_ADDRSTRLEN] = {};
+                inet_ntop(group.ipv6 ? AF_INET6 : AF_INET, group.address, address, sizeof(address));
+                uint8_t mac[6];
+                for (int byte = 0; byte < 6; byte++)
                 {
-                    auth = true;
-                    break;
+                    mac[byte] = (group.mac >> (40 - 8 * byte)) & 0xff;
                 }
+
+                groups.push_back(encodeJsonObject({
+                    { "vlan", encodeJson(static_cast<int>(group.vlan)) },
+                    { "group", encodeJson(string(address)) },
+                    { "address", encodeJson(mac_address(mac).to_string()) },
+                    { "ports", encodePortList(ports, group.members) },
+                    { "frames", encodeJson(static_cast<long>(group.frames)) },
+                    { "bytes", encodeJson(static_cast<long>(group.bytes)) }
+                }));
             }
-            if (!auth)
+
+            response.write(
+                encodeJsonObject({
+                    { "groups", encodeJsonList(groups) },
+                    { "routers", encodePortList(ports, table.routers()) },
+                    { "overflows", encodeJson(static_cast<long>(table.overflows())) }
+                })
+            );
+        }
+    };
+
+    api.get("/neighbor") = [&](li::http_request & request, li::http_response & response) {
+        string_view bearerToken = request.header("Authorization");
+        if (bearerToken.substr(0, 6) != "Bearer")
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        string_view token = bearerToken.substr(7, string::npos);
+        response.set_header("Content-Type", "application/json");
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        {
+            auto guard = storageHandle_m.guard();
+            auto statistics = storageHandle_m.statistics();
+            auto & table = guard->neighborTable;
+
+            vector<string> neighbors;
+            for (const auto & neighbor : table.entries(steady_clock::now()))
             {
-                throw li::http_error::forbidden("Invalid auth token.");
+                char address[INET6_ADDRSTRLEN] = {};
+                inet_ntop(neighbor.ipv6 ? AF_INET6 : AF_INET, neighbor.address, address, sizeof(address));
+                uint8_t mac[6];
+                for (int byte = 0; byte < 6; byte++)
+                {
+                    mac[byte] = (neighbor.mac >> (40 - 8 * byte)) & 0xff;
+                }
+
+                neighbors.push_back(encodeJsonObject({
+                    { "vlan", encodeJson(static_cast<int>(neighbor.vlan)) },
+                    { "ip", encodeJson(string(address)) },
+                    { "address", encodeJson(mac_address(mac).to_string()) },
+                    { "router", encodeJson(neighbor.router) },
+                    { "timeout", encodeJson(duration_cast<seconds>(neighbor.timeLeft).count()) }
+                }));
             }
 
+            // the suppressed requests are the floods the switch saved
+            const auto & counters = guard->statisticsTable;
+            response.write(
+                encodeJsonObject({
+                    { "neighbors", encodeJsonList(neighbors) },
+                    { "arp", encodeJsonObject({
+                        { "suppressed", encodeJson(static_cast<long>(counters.readNeighbors(false, true))) },
+                        { "flooded", encodeJson(static_cast<long>(counters.readNeighbors(false, false))) }
+                    }) },
+                    { "nd", encodeJsonObject({
+                        { "suppressed", encodeJson(static_cast<long>(counters.readNeighbors(true, true))) },
+                        { "flooded", encodeJson(static_cast<long>(counters.readNeighbors(true, false))) }
+                    }) },
+                    { "overflows", encodeJson(static_cast<long>(table.overflows())) }
+                })
+            );
+        }
+    };
+
+    api.put("/device/edit") = [&](li::http_request & request, li::http_response & response) {
+        string_view bearerToken = request.header("Authorization");
+        if (bearerToken.substr(0, 6) != "Bearer")
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        string_view token = bearerToken.substr(7, string::npos);
+        response.set_header("Content-Type", "application/json");
+        if (!authorized(token))
+        {
+            throw li::http_error::forbidden("Invalid auth token.");
+        }
+        {
+            auto guard = storageHandle_m.device();
+
             auto config = request.post_parameters(s::hostname = optional<string>(), s::timeout = optional<seconds::rep>());
 
             if (config.hostname.has_value())
@@ -318,6 +504,19 @@ void RestThreadHandle::thread()
     }
 }
 
+bool RestThreadHandle::authorized(string_view token)
+{
+    auto guard = storageHandle_m.sessions();
+    for (const auto & session : guard->sessions)
+    {
+        if (session.getToken() == token)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 string RestThreadHandle::encodeJsonObject(map<string, string> data) const
 {
     string output = "{";
@@ -382,6 +581,115 @@ string RestThreadHandle::encodeJson(bool data) const
     return data ? "true" : "false";
 }
 
+string RestThreadHandle::encodeJson(double data) const
+{
+    return std::to_string(data);
+}
+
+string RestThreadHandle::encodeBurstStatistics(const BurstStatistics & rx) const
+{
+    vector<string> histogram;
+    for (size_t i = 0; i < BurstStatistics::BUCKETS; i++)
+    {
+        histogram.push_back(encodeJsonObject({
+            { "from", encodeJson(static_cast<long>(BurstStatistics::bucketStart(i))) },
+            { "bursts", encodeJson(static_cast<long>(rx.histogram[i])) }
+        }));
+    }
+
+    return encodeJsonObject({
+        { "bursts", encodeJson(static_cast<long>(rx.bursts)) },
+        { "frames", encodeJson(static_cast<long>(rx.frames)) },
+        { "averageBurst", encodeJson(rx.averageBurst()) },
+        { "histogram", encodeJsonList(histogram) }
+    });
+}
+
+// only the protocols seen since the last clear are listed
+string RestThreadHandle::encodeProtocolStatistics(const StatisticsTable & table, uint32_t port) const
+{
+    vector<string> protocols;
+    for (size_t i = 0; i < StatisticsTable::PROTOCOLS; i++)
+    {
+        auto entry = table.read(port, static_cast<Protocol>(i));
+        if (entry.input == 0 && entry.output == 0)
+        {
+            continue;
+        }
+        protocols.push_back(encodeJsonObject({
+            { "protocol", encodeJson(protocolToString(static_cast<Protocol>(i))) },
+            { "input", encodeJson(static_cast<long>(entry.input)) },
+            { "output", encodeJson(static_cast<long>(entry.output)) },
+            { "inputBytes", encodeJson(static_cast<long>(entry.inputBytes)) },
+            { "outputBytes", encodeJson(static_cast<long>(entry.outputBytes)) }
+        }));
+    }
+    return encodeJsonList(protocols);
+}
+
+// the interfaces by their port indices, a LAG by the name of the group
+string RestThreadHandle::encodePortList(const PortTable & ports, PortTable::PortMask mask) const
+{
+    vector<string> names;
+    for (; mask != 0; mask &= mask - 1)
+    {
+        uint32_t port = __builtin_ctz(mask);
+        if (port >= ports.size())
+        {
+            continue;
+        }
+        uint32_t lag = ports.lag(port);
+        names.push_back(encodeJson(lag == PortTable::NO_LAG ? ports[port].name() : ports.lagName(lag)));
+    }
+    return encodeJsonList(names);
+}
+
+string RestThreadHandle::encodeTxStatistics(const TxStatistics & tx) const
+{
+    vector<string> classes;
+    for (size_t i = 0; i < tx.classes.size(); i++)
+    {
+        const auto & entry = tx.classes[i];
+        classes.push_back(encodeJsonObject({
+            { "class", encodeJson(static_cast<long>(i)) },
+            { "strict", encodeJson(entry.strict) },
+            { "weight", encodeJson(static_cast<long>(entry.weight)) },
+            { "frames", encodeJson(static_cast<long>(entry.frames)) },
+            { "depth", encodeJson(static_cast<long>(entry.depth)) },
+            { "highWater", encodeJson(static_cast<long>(entry.highWater)) },
+            { "enqueueDrops", encodeJson(static_cast<long>(entry.enqueueDrops)) },
+            { "averageLatency", encodeJson(entry.averageLatency()) },
+            { "maxLatency", encodeJson(static_cast<double>(entry.latencyMax) / 1000) }
+        }));
+    }
+
+    return encodeJsonObject({
+        { "batches", encodeJson(static_cast<long>(tx.batches)) },
+        { "frames", encodeJson(static_cast<long>(tx.frames)) },
+        { "dropped", encodeJson(static_cast<long>(tx.dropped)) },
+        { "averageBatch", encodeJson(tx.averageBatch()) },
+        { "lastBatch", encodeJson(static_cast<long>(tx.lastBatch)) },
+        { "maxBatch", encodeJson(static_cast<long>(tx.maxBatch)) },
+        { "depth", encodeJson(static_cast<long>(tx.depth)) },
+        { "highWater", encodeJson(static_cast<long>(tx.highWater)) },
+        { "enqueueDrops", encodeJson(static_cast<long>(tx.enqueueDrops)) },
+        { "classes", encodeJsonList(classes) }
+    });
+}
+
+string RestThreadHandle::encodePoolStatistics(const PoolStatistics & pool) const
+{
+    return encodeJsonObject({
+        { "frames", encodeJson(static_cast<long>(pool.frames)) },
+        { "frameSize", encodeJson(static_cast<long>(pool.frameSize)) },
+        { "inUse", encodeJson(static_cast<long>(pool.inUse)) },
+        { "peak", encodeJson(static_cast<long>(pool.peak)) },
+        { "exhaustions", encodeJson(static_cast<long>(pool.exhaustions)) },
+        { "oversize", encodeJson(static_cast<long>(pool.oversize)) },
+        { "hugePages", encodeJson(pool.hugePages) }
+    });
+}
+
 void RestThreadHandle::start()
 {
     li::quit_signal_catched = 0;
@@ -33,6 +33,7 @@ public:
 
 private:
     void thread(); // blocking!
+    bool authorized(string_view token); // takes the sessions lock on its own
     string encodeJsonObject(map<string, string> data) const;
     string encodeJsonList(vector<string> data) const;
     string encodeJson(int data) const;
@@ -40,6 +41,12 @@ private:
     string encodeJson(string data) const;
     string encodeJson(const char * data) const;
     string encodeJson(bool data) const;
+    string encodeJson(double data) const;
+    string encodeBurstStatistics(const BurstStatistics & rx) const;
+    string encodeProtocolStatistics(const StatisticsTable & table, uint32_t port) const; // statistics lock
+    string encodeTxStatistics(const TxStatistics & tx) const;
+    string encodePoolStatistics(const PoolStatistics & pool) const;
+    string encodePortList(const PortTable & ports, PortTable::PortMask mask) const;
 
 private:
     std::thread thread_m;
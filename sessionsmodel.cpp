@@ -29,7 +29,7 @@ QVariant SessionsModel::headerData(int section, Qt::Orientation orientation, int
 
 int SessionsModel::rowCount(const QModelIndex & parent) const
 {
-    auto guard = storageHandle_m.guard();
+    auto guard = storageHandle_m.sessions();
     return guard->sessions.size();
 }
 
@@ -48,7 +48,7 @@ QVariant SessionsModel::data(const QModelIndex & index, int role) const
         return QVariant();
     }
 
-    auto guard = storageHandle_m.guard();
+    auto guard = storageHandle_m.sessions();
     int currentRow = 0;
     for (auto it = guard->sessions.begin(); it != guard->sessions.end(); it++)
     {
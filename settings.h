@@ -1,22 +1,59 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <string_view>
 using std::chrono::milliseconds;
 using namespace std::chrono_literals;
 
 static constexpr milliseconds DEFAULT_MAC_TIMEOUT = 30'000ms;
-static constexpr milliseconds DEFAULT_SENT_PACKET_TIMEOUT = 300s;
+static constexpr uint32_t MAC_TABLE_CAPACITY = 1 << 20; // hosts, the table takes 16 MiB
+static constexpr uint32_t MAC_AGING_EPOCHS = 8;         // an entry expires this many sweeps after its last hit
+static constexpr uint32_t MAX_SWITCH_PORTS = 32; // a flood mask is a 32 bit word
+static constexpr uint16_t DEFAULT_VLAN = 1;       // every port not configured otherwise is an access port of it
+static constexpr uint32_t MAX_VLANS = 64;         // VLANs with ports in them, each gets its own counters
+static constexpr uint32_t MAX_LAGS = 8;           // link aggregation groups
+static constexpr uint32_t MULTICAST_GROUPS = 1024; // group MAC addresses per VLAN the snooping table holds
+static constexpr milliseconds MULTICAST_MEMBERSHIP_INTERVAL = 260'000ms; // until a querier announces its own
+static constexpr milliseconds MULTICAST_QUERIER_INTERVAL = 255'000ms;    // a port stays a router port this long
+static constexpr milliseconds MULTICAST_LAST_MEMBER_TIME = 2'000ms;      // a membership is left after a leave
+static constexpr uint32_t NEIGHBOR_TABLE_CAPACITY = 4096;      // IP to MAC bindings for ARP and ND suppression
+static constexpr milliseconds NEIGHBOR_TIMEOUT = 300'000ms;    // a binding not seen again is forgotten
+static constexpr uint32_t STATISTICS_SHARDS = 32; // counter sets, one for every RX worker and one for management
 static constexpr milliseconds DEFAULT_SESSION_TIMEOUT = 30'000ms;
 static constexpr std::string_view DEFAULT_HOSTNAME = "Switch";
 
+static constexpr milliseconds TIMER_WHEEL_TICK = 10ms;
 static constexpr milliseconds MAC_UPDATE_TIMER = 200ms;
-static constexpr milliseconds SENT_PACKETS_TIMER = 300ms;
+static constexpr milliseconds LINK_POLL_TIMER = 100ms; // how soon a LAG stops sending to a member that lost its link
+static constexpr milliseconds MULTICAST_SWEEP_TIMER = 1'000ms;
+static constexpr milliseconds NEIGHBOR_SWEEP_TIMER = 10'000ms;
 static constexpr milliseconds INTERFACE_UPDATE_TIMER = 1'000ms;
-static constexpr milliseconds SESSION_UPDATE_TIMER = 1'000ms;
 static constexpr milliseconds UI_REFRESH_TIMER = 500ms;
 static constexpr milliseconds STATS_REFRESH_TIMER = 500ms;
 
+static constexpr uint32_t DEFAULT_RING_BLOCK_SIZE = 1 << 20; // holds a GSO super-frame with room to spare
+static constexpr uint32_t DEFAULT_RING_BLOCK_COUNT = 8;      // 8 MiB per worker, it is locked with the rest
+static constexpr uint32_t DEFAULT_RING_FRAME_SIZE = 1 << 11;
+static constexpr milliseconds DEFAULT_RING_BLOCK_TIMEOUT = 10ms;
+static constexpr milliseconds RX_POLL_TIMEOUT = 500ms;
+static constexpr uint32_t DEFAULT_RX_WORKERS = 1;
+static constexpr uint32_t DEFAULT_BURST_SIZE = 64;
+static constexpr uint32_t MAX_BURST_SIZE = 256;
+static constexpr uint32_t DEFAULT_TX_BATCH_SIZE = 64;
+static constexpr uint32_t DEFAULT_TX_QUEUE_SIZE = 4096;
+static constexpr uint32_t DEFAULT_TX_RING_FRAME_SIZE = 1 << 11;
+static constexpr uint32_t DEFAULT_TX_RING_FRAME_COUNT = 256;
+static constexpr uint32_t DEFAULT_XDP_FRAME_SIZE = 1 << 12;
+static constexpr uint32_t DEFAULT_XDP_FRAME_COUNT = 1 << 14;
+static constexpr uint32_t DEFAULT_XDP_RING_SIZE = 1 << 11;
+static constexpr uint32_t DEFAULT_POOL_FRAME_SIZE = 1 << 11;
+static constexpr uint32_t DEFAULT_POOL_FRAME_COUNT = 1 << 15;
+static constexpr uint32_t POOL_CACHE_BATCH = 64; // frames moved between a thread cache and the shared free list at once
+static constexpr uint32_t DEFAULT_BUSY_POLL_TIME = 50; // microseconds
+static constexpr int DEFAULT_REALTIME_PRIORITY = 50;
+static constexpr milliseconds LOW_LATENCY_BLOCK_TIMEOUT = 1ms;
+
 static constexpr std::string_view REST_USERNAME = "root";
 static constexpr std::string_view REST_PASSWORD = "root";
 static constexpr int32_t TOKEN_LENGTH = 32;
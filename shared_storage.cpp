@@ -1,11 +1,11 @@
 #include "shared_storage.h"
+#include "frame_hash.h"
 #include "settings.h"
 #include <cstdint>
 #include <random>
 
 Packet::Packet(vector<uint8_t> && data)
-    : data(std::move(data)),
-      expiration(DEFAULT_SENT_PACKET_TIMEOUT)
+    : data(std::move(data))
 {
 }
 
@@ -24,50 +24,44 @@ bool Packet::operator==(const Packet & other) const
     return this->data == other.data;
 }
 
+// a word or more at a time, see frameHash()
 std::size_t Packet::Hash::operator()(const Packet & packet) const noexcept
 {
-    std::size_t hash = packet.data.size();
+    return static_cast<std::size_t>(frameHash(packet.data.data(), packet.data.size()));
+}
 
-    for (int i = 0; i < packet.data.size(); i++)
+InterfaceEntry & SharedStorage::getInterface(mac_address address)
+{
+    uint32_t port = ports.local(macKey(address));
+    auto it = port == PortTable::NO_PORT ? interfaces.end() : interfaces.find(ports[port]);
+    if (it != interfaces.end())
     {
-        auto byte = packet.data[i];
-        hash ^= byte + 73 + (hash >> 1) + (hash << 3);
+        return it->second;
     }
-
-    return hash;
+    throw std::runtime_error("No interface with the following MAC: " + address.to_string());
 }
 
-string protocolToString(Protocol protocol)
+bool SharedStorage::eraseSession(string_view token)
 {
-    switch (protocol)
+    for (auto it = sessions.begin(); it != sessions.end(); it++)
     {
-    case Protocol::EthernetII:
-        return "EthernetII";
-    case Protocol::ARP:
-        return "ARP";
-    case Protocol::IP:
-        return "IP";
-    case Protocol::TCP:
-        return "TCP";
-    case Protocol::UDP:
-        return "UDP";
-    case Protocol::ICMP:
-        return "ICMP";
-    case Protocol::HTTP:
-        return "HTTP";
+        if (it->getToken() == token)
+        {
+            it->expiration.disarm();
+            sessions.erase(it);
+            return true;
+        }
     }
+    return false;
 }
 
-InterfaceEntry & SharedStorage::getInterface(mac_address address)
+void SharedStorage::clearSessions()
 {
-    for (auto & interface : interfaces)
+    for (auto & session : sessions)
     {
-        if (interface.first.hw_address() == address)
-        {
-            return interface.second;
-        }
+        session.expiration.disarm();
     }
-    throw std::runtime_error("No interface with the following MAC: " + address.to_string());
+    sessions.clear();
 }
 
 Session::Session()
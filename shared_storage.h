@@ -1,6 +1,16 @@
 #pragma once
 
+#include "mac_table.h"
+#include "multicast_table.h"
+#include "neighbor_table.h"
+#include "port_table.h"
+#include "protocol_classifier.h"
 #include "settings.h"
+#include "statistics_table.h"
+#include "timer_wheel.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <map>
@@ -9,6 +19,7 @@
 #include <string_view>
 #include <tins/tins.h>
 #include <unordered_set>
+#include <vector>
 
 using mac_address = Tins::HWAddress<6>;
 using interface = Tins::NetworkInterface;
@@ -19,63 +30,28 @@ using std::chrono::time_point, std::chrono::steady_clock, std::chrono::milliseco
 using namespace std::chrono_literals;
 using std::vector, std::map, std::string, std::string_view;
 
-enum class Protocol
-{
-    EthernetII,
-    ARP,
-    IP,
-    TCP,
-    UDP,
-    ICMP,
-    HTTP
-};
-
-// One statistic entry
-struct StatisticEntry
-{
-    int32_t input;
-    int32_t output;
-};
-
-struct StatisticKey
-{
-    Protocol protocol;
-    interface target;
-
-    struct StatisticKeyComparator
-    {
-        bool operator()(const StatisticKey & lhs, const StatisticKey & rhs) const
-        {
-            return lhs.value() < rhs.value();
-        }
-    };
-
-    int32_t value() const
-    {
-        return target.id() + static_cast<int>(protocol);
-    }
-};
-
-using StatisticsTable = map<StatisticKey, StatisticEntry, StatisticKey::StatisticKeyComparator>;
-
-string protocolToString(Protocol protocol);
 
 // ============================================================================
 // = Sessions =================================================================
 // ============================================================================
 
+// once armed, the timeout doesn't have to be polled, the housekeeping wheel calls back when it expires
 struct timeout
 {
     timeout();
     timeout(milliseconds duration);
     time_point<steady_clock> start;
     milliseconds duration;
+    TimerWheel *wheel;
+    TimerWheel::TimerId timer;
 
 public:
     bool expired() const;
-    void reset();
+    void reset(); // an armed timer is pushed back as well
     void setDuration(milliseconds newTimeout);
     milliseconds timeLeft() const;
+    void arm(TimerWheel & housekeeping, TimerWheel::Callback expire); // expire runs on the housekeeping thread
+    void disarm();
 
     static constexpr milliseconds DEFAULT_DURATION = 5s;
 };
@@ -91,39 +67,92 @@ public:
 };
 
 // ============================================================================
-// = MAC Table ================================================================
+// = Device Info ==============================================================
 // ============================================================================
 
-struct MacEntry
+struct DeviceInfo
 {
-    MacEntry & operator=(const MacEntry &) = default;
-    MacEntry & operator=(MacEntry &&) = default;
+    DeviceInfo();
+    string hostname;
+    milliseconds defaultMacTimeout;
+};
 
-    interface interface;
-    timeout expiration;
+// ============================================================================
+// = Thread Control ===========================================================
+// ============================================================================
+
+// a flag the network threads read without the storage lock
+// copying it copies the current value, so the structs holding it stay copyable
+struct AtomicFlag
+{
+    AtomicFlag();
+    AtomicFlag(bool value);
+    AtomicFlag(const AtomicFlag & other);
+    AtomicFlag & operator=(const AtomicFlag & other);
+    AtomicFlag & operator=(bool value);
+
+    operator bool() const;
+
+private:
+    std::atomic<bool> value_m;
 };
 
-using MacTable = map<mac_address, MacEntry>;
+struct ThreadControl
+{
+    AtomicFlag running;
+    AtomicFlag finished;
+};
 
 // ============================================================================
-// = Device Info ==============================================================
+// = Transmit Statistics ======================================================
 // ============================================================================
 
-struct DeviceInfo
+// one class of the egress scheduler of an interface
+struct EgressClassStatistics
 {
-    DeviceInfo();
-    string hostname;
-    milliseconds defaultMacTimeout;
+    bool strict;
+    uint32_t weight;
+    int64_t frames;       // taken off the queue
+    uint32_t depth;
+    uint32_t highWater;
+    int64_t enqueueDrops;
+    int64_t latencyTotal; // nanoseconds from the enqueue to the hand off to the socket
+    int64_t latencyMax;
+
+public:
+    double averageLatency() const; // microseconds
+};
+
+// how well the TX thread of an interface keeps up and manages to batch frames
+struct TxStatistics
+{
+    int64_t batches;
+    int64_t frames;
+    int64_t dropped;      // refused by the socket
+    uint32_t lastBatch;
+    uint32_t maxBatch;
+    uint32_t depth;       // frames waiting in the egress queues
+    uint32_t highWater;   // the deepest any egress queue has been
+    int64_t enqueueDrops; // an egress queue was full
+    vector<EgressClassStatistics> classes;
+
+public:
+    double averageBatch() const;
 };
 
 // ============================================================================
-// = Thread Control ===========================================================
+// = Frame Pool Statistics ====================================================
 // ============================================================================
 
-struct ThreadControl
+struct PoolStatistics
 {
-    bool running;
-    bool finished;
+    uint32_t frames;
+    uint32_t frameSize;
+    uint32_t inUse;       // including the frames held in the per-thread caches
+    uint32_t peak;
+    int64_t exhaustions;  // a frame was needed, but the pool was empty
+    int64_t oversize;     // frames too large for the pool, copied to the heap
+    bool hugePages;
 };
 
 // ============================================================================
@@ -134,8 +163,11 @@ struct InterfaceEntry
 {
 public:
     ThreadControl control;
-    bool up;
+    int32_t workers; // RX workers that haven't finished yet
+    AtomicFlag up;
     string name;
+    BurstStatistics rx; // summed from the statistics table whenever the MAC table is updated
+    TxStatistics tx;
 };
 
 struct NetworkInterfaceComparator
@@ -163,7 +195,6 @@ struct Packet
     Packet(Tins::PDU *pdu);
 
     vector<uint8_t> data;
-    timeout expiration;
 
     bool operator==(const Packet &) const;
 
@@ -182,16 +213,22 @@ using PacketTable = std::unordered_set<Packet, Packet::Hash>;
 struct SharedStorage
 {
     SharedStorage();
+    PortTable ports; // fixed while the network threads run
     MacTable macTable;
+    MulticastTable multicastTable;
+    NeighborTable neighborTable;
     StatisticsTable statisticsTable;
     vector<Session> sessions;
     DeviceInfo deviceInfo;
     ThreadControl restThread;
     InterfaceTable interfaces;
-    PacketTable sentPackets;
+    PoolStatistics pool;
+    TimerWheel housekeeping; // synchronizes itself, the expiries run on its thread
 
     void reset();
-    InterfaceEntry & getInterface(mac_address address);
+    InterfaceEntry & getInterface(mac_address address); // under the storage lock
+    bool eraseSession(string_view token); // under the sessions lock, disarms its timeout
+    void clearSessions();                 // under the sessions lock
 };
 
 // ============================================================================
@@ -205,37 +242,79 @@ inline DeviceInfo::DeviceInfo()
 }
 
 inline SharedStorage::SharedStorage()
-    : macTable{},
+    : ports{},
+      macTable{},
+      multicastTable{},
+      neighborTable{},
       statisticsTable{},
       sessions{},
       deviceInfo{},
       restThread{},
-      sentPackets{},
-      interfaces{}
+      interfaces{},
+      pool{},
+      housekeeping{}
 {
     reset();
 }
 
+inline AtomicFlag::AtomicFlag()
+    : value_m(false)
+{
+}
+
+inline AtomicFlag::AtomicFlag(bool value)
+    : value_m(value)
+{
+}
+
+inline AtomicFlag::AtomicFlag(const AtomicFlag & other)
+    : value_m(other.value_m.load(std::memory_order_acquire))
+{
+}
+
+inline AtomicFlag & AtomicFlag::operator=(const AtomicFlag & other)
+{
+    value_m.store(other.value_m.load(std::memory_order_acquire), std::memory_order_release);
+    return *this;
+}
+
+inline AtomicFlag & AtomicFlag::operator=(bool value)
+{
+    value_m.store(value, std::memory_order_release);
+    return *this;
+}
+
+inline AtomicFlag::operator bool() const
+{
+    return value_m.load(std::memory_order_acquire);
+}
+
 inline void SharedStorage::reset()
 {
+    ports.clear();
     macTable.clear();
-    statisticsTable.clear();
-    sessions.clear();
+    multicastTable.clear();
+    neighborTable.clear();
+    statisticsTable.reset();
+    clearSessions();
     deviceInfo.hostname = DEFAULT_HOSTNAME;
     deviceInfo.defaultMacTimeout = DEFAULT_MAC_TIMEOUT;
-    sentPackets.clear();
     interfaces.clear();
 }
 
 inline timeout::timeout()
     : start(steady_clock::now()),
-      duration{5s}
+      duration{5s},
+      wheel(nullptr),
+      timer(TimerWheel::NO_TIMER)
 {
 }
 
 inline timeout::timeout(milliseconds duration)
     : start(steady_clock::now()),
-      duration{duration}
+      duration{duration},
+      wheel(nullptr),
+      timer(TimerWheel::NO_TIMER)
 {
 }
 
@@ -247,11 +326,19 @@ inline bool timeout::expired() const
 inline void timeout::reset()
 {
     start = steady_clock::now();
+    if (wheel != nullptr)
+    {
+        wheel->reschedule(timer, duration);
+    }
 }
 
 inline void timeout::setDuration(milliseconds newTimeout)
 {
     duration = newTimeout;
+    if (wheel != nullptr)
+    {
+        wheel->reschedule(timer, std::max(timeLeft(), 0ms));
+    }
 }
 
 inline milliseconds timeout::timeLeft() const
@@ -259,6 +346,33 @@ inline milliseconds timeout::timeLeft() const
     return duration_cast<milliseconds>(duration + start - steady_clock::now());
 }
 
+inline void timeout::arm(TimerWheel & housekeeping, TimerWheel::Callback expire)
+{
+    disarm();
+    wheel = &housekeeping;
+    timer = wheel->schedule(std::max(timeLeft(), 0ms), std::move(expire));
+}
+
+inline void timeout::disarm()
+{
+    if (wheel != nullptr)
+    {
+        wheel->cancel(timer);
+    }
+    wheel = nullptr;
+    timer = TimerWheel::NO_TIMER;
+}
+
+inline double EgressClassStatistics::averageLatency() const
+{
+    return frames == 0 ? 0.0 : static_cast<double>(latencyTotal) / frames / 1000;
+}
+
+inline double TxStatistics::averageBatch() const
+{
+    return batches == 0 ? 0.0 : static_cast<double>(frames) / batches;
+}
+
 inline string_view Session::getToken() const
 {
     return string_view{token};
@@ -5,14 +5,72 @@
 storage_guard SharedStorageHandle::guard()
 {
     return {
-        std::lock_guard<std::mutex>(access_m),
+        std::lock_guard<std::mutex>(locks_m.storage),
         storage_m
     };
 }
 
-SharedStorageHandle::SharedStorageHandle(std::mutex & mutex, SharedStorage & storage)
-    : access_m(mutex),
-    storage_m(storage)
+storage_guard SharedStorageHandle::statistics()
+{
+    return {
+        std::lock_guard<std::mutex>(locks_m.statistics),
+        storage_m
+    };
+}
+
+storage_guard SharedStorageHandle::sessions()
+{
+    return {
+        std::lock_guard<std::mutex>(locks_m.sessions),
+        storage_m
+    };
+}
+
+storage_guard SharedStorageHandle::device()
+{
+    return {
+        std::lock_guard<std::mutex>(locks_m.device),
+        storage_m
+    };
+}
+
+const PortTable & SharedStorageHandle::ports()
+{
+    return storage_m.ports;
+}
+
+MacTable & SharedStorageHandle::macTable()
+{
+    return storage_m.macTable;
+}
+
+MulticastTable & SharedStorageHandle::multicastTable()
+{
+    return storage_m.multicastTable;
+}
+
+NeighborTable & SharedStorageHandle::neighborTable()
+{
+    return storage_m.neighborTable;
+}
+
+StatisticsTable & SharedStorageHandle::statisticsTable()
+{
+    return storage_m.statisticsTable;
+}
+
+TimerWheel & SharedStorageHandle::housekeeping()
+{
+    return storage_m.housekeeping;
+}
+
+const InterfaceTable & SharedStorageHandle::interfaces()
 {
+    return storage_m.interfaces;
 }
 
+SharedStorageHandle::SharedStorageHandle(StorageLocks & locks, SharedStorage & storage)
+    : locks_m(locks),
+    storage_m(storage)
+{
+}
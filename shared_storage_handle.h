@@ -3,6 +3,17 @@
 #include "shared_storage.h"
 #include <mutex>
 
+// the shared storage is split into sections, each with its own lock, so that polling one of them
+// doesn't stall the others, a thread that needs more than one takes them in the order below
+// the MAC, multicast and neighbor tables synchronize themselves, the RX workers look hosts up in them without any lock
+struct StorageLocks
+{
+    std::mutex storage;    // the interface entries, thread control and the frame pool statistics
+    std::mutex statistics; // reading and clearing the statistics table, the burst statistics of the interfaces
+    std::mutex sessions;
+    std::mutex device;     // the device info
+};
+
 // a container for accessing the storage, while also keeping the lock guard
 struct storage_guard
 {
@@ -19,17 +30,29 @@ struct storage_guard
 struct SharedStorageHandle
 {
 public:
-    SharedStorageHandle(std::mutex & mutex, SharedStorage & storage);
+    SharedStorageHandle(StorageLocks & locks, SharedStorage & storage);
     SharedStorageHandle() = delete;
     SharedStorageHandle(const SharedStorageHandle &) = default;
     SharedStorageHandle(SharedStorageHandle &&) = default;
     SharedStorageHandle & operator=(SharedStorageHandle &&) = delete;
 
 public:
-    storage_guard guard();
+    storage_guard guard(); // the storage section
+    storage_guard statistics();
+    storage_guard sessions();
+    storage_guard device();
+
+    const PortTable & ports(); // no lock needed while the network threads run
+    MacTable & macTable();     // no lock needed
+    MulticastTable & multicastTable(); // no lock needed
+    NeighborTable & neighborTable();   // no lock needed
+    StatisticsTable & statisticsTable(); // no lock needed to count, reading and clearing need statistics()
+    TimerWheel & housekeeping();         // no lock needed
+    // no lock needed to walk it while the network threads run, the set of interfaces is fixed then
+    // and only the atomic flags of the entries may be read without the storage section
+    const InterfaceTable & interfaces();
 
 private:
-    std::mutex & access_m;
+    StorageLocks & locks_m;
     SharedStorage & storage_m;
 };
-
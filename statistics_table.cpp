@@ -0,0 +1,212 @@
+#include "statistics_table.h"
+#include <algorithm>
+
+StatisticsTable::StatisticsTable()
+    : shards_m(new Shard[SHARDS]()),
+      claimed_m(0),
+      baseline_m{},
+      vlanBaseline_m{},
+      neighborBaseline_m{}
+{
+}
+
+// once every shard is taken, the workers start sharing them
+StatisticsTable::Shard & StatisticsTable::claim()
+{
+    uint32_t claimed = claimed_m.fetch_add(1, std::memory_order_relaxed);
+    return shards_m[1 + claimed % (SHARDS - 1)];
+}
+
+StatisticsTable::Shard & StatisticsTable::management()
+{
+    return shards_m[0];
+}
+
+uint32_t StatisticsTable::shards() const
+{
+    return 1 + std::min(claimed_m.load(std::memory_order_relaxed), SHARDS - 1);
+}
+
+uint64_t StatisticsTable::sum(uint32_t port, size_t protocol, size_t direction, size_t kind) const
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0, count = shards(); i < count; i++)
+    {
+        total += shards_m[i].counters[port][protocol][direction][kind].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t StatisticsTable::sumVlan(uint32_t vlan, size_t direction, size_t kind) const
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0, count = shards(); i < count; i++)
+    {
+        total += shards_m[i].vlans[vlan][direction][kind].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t StatisticsTable::sumNeighbors(size_t family, size_t kind) const
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0, count = shards(); i < count; i++)
+    {
+        total += shards_m[i].neighbors[family][kind].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+StatisticEntry StatisticsTable::read(uint32_t port, Protocol protocol) const
+{
+    if (port >= MAX_PORTS)
+    {
+        return {};
+    }
+
+    auto index = static_cast<size_t>(protocol);
+    const auto & baseline = baseline_m[port][index];
+    return {
+        sum(port, index, 0, 0) - baseline[0][0],
+        sum(port, index, 1, 0) - baseline[1][0],
+        sum(port, index, 0, 1) - baseline[0][1],
+        sum(port, index, 1, 1) - baseline[1][1],
+    };
+}
+
+StatisticEntry StatisticsTable::readVlan(uint32_t vlan) const
+{
+    if (vlan >= MAX_VLANS)
+    {
+        return {};
+    }
+
+    const auto & baseline = vlanBaseline_m[vlan];
+    return {
+        sumVlan(vlan, 0, 0) - baseline[0][0],
+        sumVlan(vlan, 1, 0) - baseline[1][0],
+        sumVlan(vlan, 0, 1) - baseline[0][1],
+        sumVlan(vlan, 1, 1) - baseline[1][1],
+    };
+}
+
+uint64_t StatisticsTable::readNeighbors(bool ipv6, bool suppressed) const
+{
+    size_t family = ipv6 ? 1 : 0;
+    size_t kind = suppressed ? 0 : 1;
+    return sumNeighbors(family, kind) - neighborBaseline_m[family][kind];
+}
+
+BurstStatistics StatisticsTable::bursts(uint32_t port) const
+{
+    BurstStatistics statistics{};
+    if (port >= MAX_PORTS)
+    {
+        return statistics;
+    }
+
+    for (uint32_t i = 0, count = shards(); i < count; i++)
+    {
+        const auto & bursts = shards_m[i].bursts[port];
+        statistics.bursts += bursts[0].load(std::memory_order_relaxed);
+        statistics.frames += bursts[1].load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < BurstStatistics::BUCKETS; bucket++)
+        {
+            statistics.histogram[bucket] += bursts[2 + bucket].load(std::memory_order_relaxed);
+        }
+    }
+    return statistics;
+}
+
+void StatisticsTable::clear()
+{
+    for (uint32_t port = 0; port < MAX_PORTS; port++)
+    {
+        clear(port);
+    }
+    for (uint32_t vlan = 0; vlan < MAX_VLANS; vlan++)
+    {
+        for (size_t direction = 0; direction < 2; direction++)
+        {
+            for (size_t kind = 0; kind < 2; kind++)
+            {
+                vlanBaseline_m[vlan][direction][kind] = sumVlan(vlan, direction, kind);
+            }
+        }
+    }
+    for (size_t family = 0; family < 2; family++)
+    {
+        for (size_t kind = 0; kind < 2; kind++)
+        {
+            neighborBaseline_m[family][kind] = sumNeighbors(family, kind);
+        }
+    }
+}
+
+void StatisticsTable::clear(uint32_t port)
+{
+    if (port >= MAX_PORTS)
+    {
+        return;
+    }
+
+    for (size_t protocol = 0; protocol < PROTOCOLS; protocol++)
+    {
+        for (size_t direction = 0; direction < 2; direction++)
+        {
+            for (size_t kind = 0; kind < 2; kind++)
+            {
+                baseline_m[port][protocol][direction][kind] = sum(port, protocol, direction, kind);
+            }
+        }
+    }
+}
+
+void StatisticsTable::reset()
+{
+    for (uint32_t i = 0; i < SHARDS; i++)
+    {
+        auto & shard = shards_m[i];
+        for (auto & port : shard.counters)
+        {
+            for (auto & protocol : port)
+            {
+                for (auto & direction : protocol)
+                {
+                    for (auto & counter : direction)
+                    {
+                        counter.store(0, std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+        for (auto & port : shard.bursts)
+        {
+            for (auto & counter : port)
+            {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto & vlan : shard.vlans)
+        {
+            for (auto & direction : vlan)
+            {
+                for (auto & counter : direction)
+                {
+                    counter.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+        for (auto & family : shard.neighbors)
+        {
+            for (auto & counter : family)
+            {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+    std::fill_n(&baseline_m[0][0][0][0], sizeof(baseline_m) / sizeof(uint64_t), 0);
+    std::fill_n(&vlanBaseline_m[0][0][0], sizeof(vlanBaseline_m) / sizeof(uint64_t), 0);
+    std::fill_n(&neighborBaseline_m[0][0], sizeof(neighborBaseline_m) / sizeof(uint64_t), 0);
+    claimed_m.store(0, std::memory_order_relaxed);
+}
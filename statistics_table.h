@@ -0,0 +1,212 @@
+#pragma once
+
+#include "settings.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using std::unique_ptr;
+
+enum class Protocol
+{
+    EthernetII,
+    ARP,
+    IP,
+    TCP,
+    UDP,
+    ICMP,
+    HTTP,
+    IPv6,
+    ICMPv6
+};
+
+enum class Direction
+{
+    Input,
+    Output
+};
+
+// One statistic entry
+struct StatisticEntry
+{
+    uint64_t input;
+    uint64_t output;
+    uint64_t inputBytes;
+    uint64_t outputBytes;
+};
+
+// how many frames the network threads of an interface get to switch at once
+struct BurstStatistics
+{
+    static constexpr size_t BUCKETS = 9; // 1, 2-3, 4-7, ..., 256 and more
+
+    int64_t bursts;
+    int64_t frames;
+    std::array<int64_t, BUCKETS> histogram;
+
+public:
+    void record(uint32_t burst);
+    double averageBurst() const;
+    static uint32_t bucketStart(size_t bucket);
+    static size_t bucket(uint32_t burst);
+};
+
+uint32_t protocolBit(Protocol protocol);
+
+// the frame and byte counters of every port, protocol and direction, as a dense matrix
+// the ports are the indices of the port table, the VLANs have counters of their own by their index there
+// every RX worker counts into a shard of its own, aligned to cache lines, so the workers never lock
+// and never write to a line another core writes to, the shards are only summed up when read
+// the shards of running workers can't be zeroed, clearing remembers the sums instead
+// and reading subtracts them
+//
+// counting is lock-free, everything else needs the statistics lock
+struct StatisticsTable
+{
+public:
+    static constexpr uint32_t MAX_PORTS = MAX_SWITCH_PORTS;
+    static constexpr uint32_t SHARDS = STATISTICS_SHARDS;
+    static constexpr uint32_t NO_PORT = UINT32_MAX;
+    static constexpr size_t PROTOCOLS = static_cast<size_t>(Protocol::ICMPv6) + 1;
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> counters[MAX_PORTS][PROTOCOLS][2][2]; // [port][protocol][direction][frames, bytes]
+        std::atomic<int64_t> bursts[MAX_PORTS][2 + BurstStatistics::BUCKETS]; // bursts, frames, histogram
+        std::atomic<uint64_t> vlans[MAX_VLANS][2][2]; // [VLAN index][direction][frames, bytes]
+        std::atomic<uint64_t> neighbors[2][2];        // [ARP, neighbor discovery][suppressed, flooded]
+    };
+
+    StatisticsTable();
+    StatisticsTable(StatisticsTable &&) = delete;
+    StatisticsTable(const StatisticsTable &) = delete;
+    StatisticsTable & operator=(StatisticsTable &&) = delete;
+    StatisticsTable & operator=(const StatisticsTable &) = delete;
+
+public:
+    // protocols is a set of protocolBit()s, the frame counts once for each of them
+    static void count(Shard & shard, uint32_t port, uint32_t protocols, Direction direction, uint64_t frames,
+                      uint64_t bytes);
+    static void recordBurst(Shard & shard, uint32_t port, uint32_t burst);
+    static void countVlan(Shard & shard, uint32_t vlan, Direction direction, uint64_t frames, uint64_t bytes);
+    // a request the switch answered itself, or one it had to flood
+    static void countNeighbor(Shard & shard, bool ipv6, bool suppressed);
+
+    Shard & claim();      // a shard for a new RX worker
+    Shard & management(); // only written under the statistics lock, by the fast path
+
+    StatisticEntry read(uint32_t port, Protocol protocol) const;
+    BurstStatistics bursts(uint32_t port) const;
+    StatisticEntry readVlan(uint32_t vlan) const; // by the index of the VLAN
+    uint64_t readNeighbors(bool ipv6, bool suppressed) const;
+    void clear();
+    void clear(uint32_t port);
+    void reset(); // only while no worker counts
+
+private:
+    uint64_t sum(uint32_t port, size_t protocol, size_t direction, size_t kind) const;
+    uint64_t sumVlan(uint32_t vlan, size_t direction, size_t kind) const;
+    uint64_t sumNeighbors(size_t family, size_t kind) const;
+    uint32_t shards() const; // the ones claimed so far, only they have to be summed
+
+private:
+    unique_ptr<Shard[]> shards_m; // shard 0 is the management one
+    std::atomic<uint32_t> claimed_m;
+    uint64_t baseline_m[MAX_PORTS][PROTOCOLS][2][2]; // the sums at the last clear
+    uint64_t vlanBaseline_m[MAX_VLANS][2][2];
+    uint64_t neighborBaseline_m[2][2];
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+inline uint32_t protocolBit(Protocol protocol)
+{
+    return 1u << static_cast<uint32_t>(protocol);
+}
+
+inline void BurstStatistics::record(uint32_t burst)
+{
+    if (burst == 0)
+    {
+        return;
+    }
+
+    histogram[bucket(burst)]++;
+    bursts++;
+    frames += burst;
+}
+
+inline double BurstStatistics::averageBurst() const
+{
+    return bursts == 0 ? 0.0 : static_cast<double>(frames) / bursts;
+}
+
+inline uint32_t BurstStatistics::bucketStart(size_t bucket)
+{
+    return 1u << bucket;
+}
+
+inline size_t BurstStatistics::bucket(uint32_t burst)
+{
+    size_t bucket = 0;
+    while (bucket + 1 < BUCKETS && bucketStart(bucket + 1) <= burst)
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+// a shard has a single writer as long as there are fewer workers than shards,
+// the increments are atomic all the same, uncontended they stay on the core that owns the line
+inline void StatisticsTable::count(Shard & shard, uint32_t port, uint32_t protocols, Direction direction,
+                                   uint64_t frames, uint64_t bytes)
+{
+    if (port >= MAX_PORTS)
+    {
+        return;
+    }
+
+    auto & counters = shard.counters[port];
+    size_t way = static_cast<size_t>(direction);
+    for (; protocols != 0; protocols &= protocols - 1)
+    {
+        size_t protocol = __builtin_ctz(protocols);
+        counters[protocol][way][0].fetch_add(frames, std::memory_order_relaxed);
+        counters[protocol][way][1].fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+inline void StatisticsTable::recordBurst(Shard & shard, uint32_t port, uint32_t burst)
+{
+    if (port >= MAX_PORTS || burst == 0)
+    {
+        return;
+    }
+
+    auto & bursts = shard.bursts[port];
+    bursts[0].fetch_add(1, std::memory_order_relaxed);
+    bursts[1].fetch_add(burst, std::memory_order_relaxed);
+    bursts[2 + BurstStatistics::bucket(burst)].fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void StatisticsTable::countVlan(Shard & shard, uint32_t vlan, Direction direction, uint64_t frames,
+                                       uint64_t bytes)
+{
+    if (vlan >= MAX_VLANS)
+    {
+        return;
+    }
+
+    auto & counters = shard.vlans[vlan][static_cast<size_t>(direction)];
+    counters[0].fetch_add(frames, std::memory_order_relaxed);
+    counters[1].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void StatisticsTable::countNeighbor(Shard & shard, bool ipv6, bool suppressed)
+{
+    shard.neighbors[ipv6 ? 1 : 0][suppressed ? 0 : 1].fetch_add(1, std::memory_order_relaxed);
+}
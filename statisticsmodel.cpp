@@ -6,7 +6,8 @@ StatisticsModel::StatisticsModel(const SharedStorageHandle & handle, interface c
     : QAbstractTableModel(parent),
       storageHandle_m{handle},
       currentInterface_m{currentInterface},
-      timer_m{this}
+      timer_m{this},
+      rows_m{}
 {
     timer_m.setInterval(STATS_REFRESH_TIMER.count());
     connect(&timer_m, &QTimer::timeout, this, &StatisticsModel::updateStats);
@@ -25,6 +26,10 @@ QVariant StatisticsModel::headerData(int section, Qt::Orientation orientation, i
             return QString("in");
         case 2:
             return QString("out");
+        case 3:
+            return QString("in bytes");
+        case 4:
+            return QString("out bytes");
         }
     }
     return QVariant();
@@ -32,22 +37,12 @@ QVariant StatisticsModel::headerData(int section, Qt::Orientation orientation, i
 
 int StatisticsModel::rowCount(const QModelIndex & parent) const
 {
-    auto guard = storageHandle_m.guard();
-    int count = 0;
-    for (auto it = guard->statisticsTable.begin(); it != guard->statisticsTable.end(); it++)
-    {
-        if (it->first.target == currentInterface_m)
-        {
-            count++;
-        }
-    }
-
-    return count;
+    return rows_m.size();
 }
 
 int StatisticsModel::columnCount(const QModelIndex & parent) const
 {
-    return 3;
+    return 5;
 }
 
 QVariant StatisticsModel::data(const QModelIndex & index, int role) const
@@ -58,39 +53,44 @@ QVariant StatisticsModel::data(const QModelIndex & index, int role) const
     if (role != Qt::DisplayRole)
         return QVariant();
 
-    int currentStat = 0;
-    auto guard = storageHandle_m.guard();
-    for (auto it = guard->statisticsTable.begin(); it != guard->statisticsTable.end(); it++)
-    {
-        if (it->first.target != currentInterface_m)
-        {
-            continue;
-        }
-
-        if (currentStat != index.row())
-        {
-            currentStat++;
-            continue;
-        }
+    if (index.row() >= static_cast<int>(rows_m.size()))
+        return QVariant();
 
-        switch (index.column())
-        {
-        case 0:
-            return QVariant(QString("%1").arg(protocolToString(it->first.protocol).c_str()));
-        case 1:
-            return QVariant(QString("%1").arg(it->second.input));
-        case 2:
-            return QVariant(QString("%1").arg(it->second.output));
-        default:
-            qDebug("Unknown column! %d", index.column());
-            return QVariant();
-        }
+    const auto & row = rows_m[index.row()];
+    switch (index.column())
+    {
+    case 0:
+        return QVariant(QString("%1").arg(protocolToString(row.first).c_str()));
+    case 1:
+        return QVariant(QString("%1").arg(row.second.input));
+    case 2:
+        return QVariant(QString("%1").arg(row.second.output));
+    case 3:
+        return QVariant(QString("%1").arg(row.second.inputBytes));
+    case 4:
+        return QVariant(QString("%1").arg(row.second.outputBytes));
+    default:
+        qDebug("Unknown column! %d", index.column());
+        return QVariant();
     }
-    return QVariant();
 }
 
+// only the protocols seen since the last clear are listed
 void StatisticsModel::updateStats()
 {
     beginResetModel();
+    rows_m.clear();
+    {
+        auto guard = storageHandle_m.statistics();
+        uint32_t port = storageHandle_m.ports().index(currentInterface_m);
+        for (size_t i = 0; i < StatisticsTable::PROTOCOLS; i++)
+        {
+            auto entry = guard->statisticsTable.read(port, static_cast<Protocol>(i));
+            if (entry.input != 0 || entry.output != 0)
+            {
+                rows_m.push_back({static_cast<Protocol>(i), entry});
+            }
+        }
+    }
     endResetModel();
 }
@@ -5,6 +5,8 @@
 #include <QAbstractItemModel>
 #include <qabstractitemmodel.h>
 #include <qtimer.h>
+#include <utility>
+#include <vector>
 
 class StatisticsModel : public QAbstractTableModel
 {
@@ -28,4 +30,5 @@ private:
     mutable SharedStorageHandle storageHandle_m;
     interface currentInterface_m;
     QTimer timer_m;
+    std::vector<std::pair<Protocol, StatisticEntry>> rows_m; // summed on every update, not for every cell
 };
@@ -1,16 +1,36 @@
 
+#include "bounded_queue.h"
+#include "frame_hash.h"
+#include "frame_pool.h"
+#include "mac_table.h"
+#include "multicast_table.h"
+#include "neighbor_table.h"
 #include "network_switch.h"
+#include "packet_ring.h"
+#include "port_table.h"
+#include "protocol_classifier.h"
 #include "shared_storage.h"
+#include "timer_wheel.h"
+#include "tx_engine.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <linux/if_ether.h>
 #include <memory>
+#include <mutex>
 #include <random>
+#include <thread>
+#include <unordered_set>
 #include <tins/pdu.h>
 #include <tins/rawpdu.h>
 #include <tins/tcp.h>
 
 using std::cout, std::unique_ptr;
+using HashFunction = uint64_t (*)(const uint8_t *, size_t);
+
 
 unique_ptr<Tins::PDU> generatePDU()
 {
@@ -50,6 +70,996 @@ void printPayload(const vector<uint8_t> & payload)
     cout << std::dec;
 }
 
+vector<uint8_t> randomFrame(std::mt19937 & rng, size_t size)
+{
+    std::uniform_int_distribution<int> distByte(0, 255);
+    vector<uint8_t> frame(size);
+    for (auto & byte : frame)
+    {
+        byte = distByte(rng);
+    }
+    return frame;
+}
+
+// frames that differ in a single bit, like retransmissions or frames of one flow, should all hash apart
+// returns the number of full 64 bit collisions
+size_t collisions(HashFunction hash, const vector<uint8_t> & frame)
+{
+    std::unordered_set<uint64_t> seen;
+    auto flipped = frame;
+    for (size_t bit = 0; bit < frame.size() * 8; bit++)
+    {
+        flipped[bit / 8] ^= 1 << (bit % 8);
+        seen.insert(hash(flipped.data(), flipped.size()));
+        flipped[bit / 8] ^= 1 << (bit % 8);
+    }
+    return frame.size() * 8 - seen.size();
+}
+
+// the kernels against hashes they gave before, on a little-endian CPU, for the tail, a single word,
+// the lanes and the blocks, and against frames one bit apart
+// a kernel that is changed on purpose needs new vectors, the hashes never leave the process
+bool testFrameHashes()
+{
+    cout << "Testing frame hashing, frameHash() uses " << frameHashKernel() << "...\n";
+    struct Vector
+    {
+        size_t size;
+        uint64_t portable;
+        uint64_t crc32c;
+    };
+    static constexpr Vector VECTORS[] = {
+        {0, 0x94a30f2d33479cae, 0xb130d61e61d5dffe},
+        {5, 0x761eeeb369206d18, 0x31a25fa4a808a246},
+        {8, 0xa6fe18bde43e5e43, 0x82b8dce9ea6d70fc},
+        {61, 0x9e4bd515c1bd70c8, 0x8e5e39be9ec18ee2},
+        {64, 0x1830227e7347b419, 0x12be14efc8bcb8d3},
+        {1500, 0xb540af2ab612f857, 0xf14c3501e861bd34},
+    };
+    vector<uint8_t> pattern(1500);
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        pattern[i] = static_cast<uint8_t>(i * 7 + 1);
+    }
+
+    vector<std::pair<const char *, HashFunction>> kernels = {{"portable", frameHashPortable}};
+    HashFunction picked = frameHashPortable;
+#ifdef __x86_64__
+    bool crc32c = __builtin_cpu_supports("sse4.2");
+    if (crc32c)
+    {
+        kernels.push_back({"crc32c", frameHashCrc32c});
+        picked = frameHashCrc32c;
+    }
+#endif
+
+    bool ok = true;
+    for (const auto & known : VECTORS)
+    {
+        if (frameHashPortable(pattern.data(), known.size) != known.portable)
+        {
+            cout << "Critical! The portable kernel changed its hash of " << known.size << " bytes!\n";
+            ok = false;
+        }
+#ifdef __x86_64__
+        if (crc32c && frameHashCrc32c(pattern.data(), known.size) != known.crc32c)
+        {
+            cout << "Critical! The crc32c kernel changed its hash of " << known.size << " bytes!\n";
+            ok = false;
+        }
+#endif
+    }
+
+    std::mt19937 rng(1);
+    for (size_t size : {61, 1500})
+    {
+        auto frame = randomFrame(rng, size);
+        for (const auto & kernel : kernels)
+        {
+            if (collisions(kernel.second, frame) != 0)
+            {
+                cout << "Critical! " << kernel.first << " collides on frames of " << size << " bytes one bit apart!\n";
+                ok = false;
+            }
+        }
+        if (frameHash(frame.data(), size) != picked(frame.data(), size))
+        {
+            cout << "Critical! frameHash() doesn't use the " << frameHashKernel() << " kernel!\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// a frame of a ring block whose outer tag the kernel took off, as TPACKET_V3 reports it
+vector<uint8_t> ringBlockFrame(uint32_t status, uint16_t tpid, uint16_t tci)
+{
+    static constexpr uint32_t MAC_OFFSET = 128;
+    vector<uint8_t> block(MAC_OFFSET + 60);
+    auto *header = reinterpret_cast<tpacket3_hdr *>(block.data());
+    header->tp_status = TP_STATUS_USER | status;
+    header->tp_mac = MAC_OFFSET;
+    header->tp_snaplen = 60;
+    header->hv1.tp_vlan_tci = tci;
+    header->hv1.tp_vlan_tpid = tpid;
+    uint8_t *frame = block.data() + MAC_OFFSET;
+    std::fill_n(frame, 6, 0xff);
+    frame[6] = 0x02;
+    frame[ETHERNET_TYPE_OFFSET] = 0x08;
+    return block;
+}
+
+// the VLAN of a ring frame comes from the tag the kernel stripped, the frame itself is untagged
+bool testStrippedVlanTag()
+{
+    cout << "Testing VLAN tags stripped by the kernel...\n";
+    VlanPortConfig trunk;
+    trunk.mode = VlanMode::Trunk;
+    trunk.pvid = 1;
+    trunk.allowed = {20};
+    PortTable ports;
+    uint32_t port = ports.add(Tins::NetworkInterface("lo"), trunk);
+
+    auto vlanOf = [&](const vector<uint8_t> & block) {
+        FrameView frame = ringFrame(block.data(), false);
+        uint16_t tci = 0;
+        bool tagged = vlanTag(frame, tci);
+        return ports.ingressVlan(port, tagged ? tci & VLAN_ID_MASK : PortTable::NO_VLAN);
+    };
+
+    bool ok = true;
+    auto stripped = ringBlockFrame(TP_STATUS_VLAN_VALID | TP_STATUS_VLAN_TPID_VALID, ETH_P_8021Q, (5 << 13) | 20);
+    FrameView frame = ringFrame(stripped.data(), false);
+    uint16_t tci = 0;
+    if (!vlanTag(frame, tci) || tci != ((5 << 13) | 20) || frame.data[ETHERNET_TYPE_OFFSET] != 0x08)
+    {
+        cout << "Critical! The stripped tag of a ring frame is lost!\n";
+        ok = false;
+    }
+    if (vlanOf(stripped) != 20)
+    {
+        cout << "Critical! A stripped tag of VLAN 20 is switched in VLAN " << vlanOf(stripped) << "!\n";
+        ok = false;
+    }
+    if (vlanOf(ringBlockFrame(TP_STATUS_VLAN_VALID, 0, 20)) != 20)
+    {
+        cout << "Critical! A stripped tag without its TPID is lost!\n";
+        ok = false;
+    }
+    if (vlanOf(ringBlockFrame(TP_STATUS_VLAN_VALID | TP_STATUS_VLAN_TPID_VALID, ETH_P_8021Q, 30)) != PortTable::NO_VLAN)
+    {
+        cout << "Critical! A stripped tag of a VLAN the trunk doesn't carry is taken!\n";
+        ok = false;
+    }
+    if (vlanOf(ringBlockFrame(0, 0, 0)) != 1)
+    {
+        cout << "Critical! An untagged ring frame isn't in the port VLAN!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+void writeMac(uint8_t *data, uint64_t mac)
+{
+    for (int byte = 0; byte < 6; byte++)
+    {
+        data[byte] = (mac >> (40 - 8 * byte)) & 0xff;
+    }
+}
+
+// an ARP packet to the broadcast address, the sender hardware address may differ from the Ethernet source
+vector<uint8_t> arpFrame(uint16_t operation, uint64_t source, uint64_t senderMac, const uint8_t *sender,
+                         const uint8_t *target)
+{
+    vector<uint8_t> frame(60);
+    writeMac(frame.data(), BROADCAST_KEY);
+    writeMac(frame.data() + 6, source);
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+    uint8_t *arp = frame.data() + 14;
+    arp[1] = 1;
+    arp[2] = 0x08;
+    arp[4] = 6;
+    arp[5] = 4;
+    arp[7] = operation;
+    writeMac(arp + 8, senderMac);
+    std::memcpy(arp + 14, sender, 4);
+    std::memcpy(arp + 24, target, 4);
+    return frame;
+}
+
+// a neighbor solicitation or advertisement with the link-layer address option
+vector<uint8_t> ndFrame(uint8_t type, uint64_t source, uint64_t option, const uint8_t *sender, const uint8_t *target,
+                        uint8_t flags)
+{
+    vector<uint8_t> frame(14 + 40 + 32);
+    writeMac(frame.data(), 0x3333ff000000 | target[15]);
+    writeMac(frame.data() + 6, source);
+    frame[12] = 0x86;
+    frame[13] = 0xdd;
+    uint8_t *ip = frame.data() + 14;
+    ip[0] = 0x60;
+    ip[5] = 32;
+    ip[6] = 58;
+    ip[7] = 255;
+    std::memcpy(ip + 8, sender, 16);
+    uint8_t *message = ip + 40;
+    message[0] = type;
+    message[4] = flags;
+    std::memcpy(message + 8, target, 16);
+    message[24] = type == 135 ? 1 : 2;
+    message[25] = 1;
+    writeMac(message + 26, option);
+    return frame;
+}
+
+// the one's complement sum of a correct ICMPv6 message and its pseudo-header is all ones
+uint16_t icmpv6Sum(const uint8_t *ip, uint32_t size)
+{
+    uint32_t sum = 58 + size;
+    for (uint32_t i = 8; i < 40 + size; i += 2)
+    {
+        sum += (ip[i] << 8) | ip[i + 1];
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+// the bindings are learned from ARP and neighbor discovery, then known requests are answered by the switch
+bool testNeighborSuppression()
+{
+    cout << "Testing ARP and neighbor discovery suppression...\n";
+    static constexpr uint64_t SWITCH = 0x020000000001;
+    static constexpr uint64_t FIRST = 0x020000000aa0;
+    static constexpr uint64_t SECOND = 0x020000000bb0;
+    NeighborTable table(16);
+    NeighborQuery query{};
+    uint64_t mac = 0;
+    bool router = false;
+    bool ok = true;
+
+    uint8_t first[4] = {10, 0, 0, 1};
+    uint8_t second[4] = {10, 0, 0, 2};
+    auto request = arpFrame(1, FIRST, FIRST, first, second);
+    if (!table.snoop(request.data(), request.size(), 1, query) || table.resolve(query, mac, router))
+    {
+        cout << "Critical! An ARP request for an unknown host isn't left to flood!\n";
+        ok = false;
+    }
+
+    auto reply = arpFrame(2, SECOND, SECOND, second, first);
+    table.snoop(reply.data(), reply.size(), 1, query);
+    auto spoofed = arpFrame(2, FIRST, 0x020000000666, second, first);
+    table.snoop(spoofed.data(), spoofed.size(), 1, query);
+    if (!table.snoop(request.data(), request.size(), 1, query) || !table.resolve(query, mac, router) ||
+        mac != SECOND)
+    {
+        cout << "Critical! An ARP reply isn't learned, or a spoofed one is!\n";
+        ok = false;
+    }
+
+    uint8_t frame[NeighborTable::REPLY_SIZE] = {};
+    uint32_t size = NeighborTable::reply(query, mac, router, SWITCH, frame);
+    uint8_t expected[28] = {0, 1, 8, 0, 6, 4, 0, 2};
+    writeMac(expected + 8, SECOND);
+    std::memcpy(expected + 14, second, 4);
+    writeMac(expected + 18, FIRST);
+    std::memcpy(expected + 24, first, 4);
+    if (size != 60 || macKey(frame) != FIRST || macKey(frame + 6) != SWITCH || frame[12] != 0x08 ||
+        frame[13] != 0x06 || std::memcmp(frame + 14, expected, sizeof(expected)) != 0)
+    {
+        cout << "Critical! The ARP reply is malformed!\n";
+        ok = false;
+    }
+
+    uint8_t host[16] = {0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    uint8_t gateway[16] = {0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2};
+    auto advertisement = ndFrame(136, SECOND, SECOND, gateway, gateway, 0x80);
+    table.snoop(advertisement.data(), advertisement.size(), 1, query);
+    auto solicitation = ndFrame(135, FIRST, FIRST, host, gateway, 0);
+    if (!table.snoop(solicitation.data(), solicitation.size(), 1, query) || !table.resolve(query, mac, router) ||
+        mac != SECOND || !router)
+    {
+        cout << "Critical! A neighbor advertisement of a router isn't learned!\n";
+        ok = false;
+    }
+
+    size = NeighborTable::reply(query, mac, router, SWITCH, frame);
+    const uint8_t *ip = frame + 14;
+    if (size != NeighborTable::REPLY_SIZE || ip[40] != 136 || ip[44] != 0xe0 || icmpv6Sum(ip, 32) != 0xffff ||
+        std::memcmp(ip + 8, gateway, 16) != 0 || std::memcmp(ip + 24, host, 16) != 0 || macKey(ip + 66) != SECOND)
+    {
+        cout << "Critical! The neighbor advertisement is malformed or its checksum is wrong!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// learning, moves, aging by epochs and a full table, the sweeps are one epoch apart
+bool testMacTable()
+{
+    cout << "Testing the MAC table...\n";
+    static constexpr uint64_t FIRST = 0x020000000001;
+    static constexpr uint64_t SECOND = 0x020000000002;
+    static constexpr milliseconds TIMEOUT = MAC_AGING_EPOCHS * 1000ms;
+    MacTable table(16);
+    auto start = steady_clock::now();
+    bool ok = true;
+
+    if (!table.learn(vlanKey(1, FIRST), 1) || table.learn(vlanKey(1, FIRST), 1) ||
+        table.lookup(vlanKey(1, FIRST)) != 1)
+    {
+        cout << "Critical! A new host isn't learned, or a known one counts as new!\n";
+        ok = false;
+    }
+    if (table.lookup(vlanKey(2, FIRST)) != MacTable::NO_PORT || table.lookup(vlanKey(1, SECOND)) != MacTable::NO_PORT)
+    {
+        cout << "Critical! A host is found in another VLAN or under another address!\n";
+        ok = false;
+    }
+    if (!table.learn(vlanKey(1, FIRST), 2) || table.lookup(vlanKey(1, FIRST)) != 2 || table.size() != 1)
+    {
+        cout << "Critical! A host that moved keeps its old port!\n";
+        ok = false;
+    }
+
+    // the first host is seen every epoch, the second one only once
+    table.learn(vlanKey(1, SECOND), 3);
+    vector<uint64_t> forgotten;
+    for (uint32_t epoch = 1; epoch <= MAC_AGING_EPOCHS + 1; epoch++)
+    {
+        table.sweep(start + epoch * (TIMEOUT / MAC_AGING_EPOCHS), TIMEOUT,
+                    [&](uint64_t key) { forgotten.push_back(key); });
+        if (epoch == MAC_AGING_EPOCHS && !forgotten.empty())
+        {
+            cout << "Critical! A host expired before MAC_AGING_EPOCHS epochs!\n";
+            ok = false;
+        }
+        table.touch(vlanKey(1, FIRST));
+    }
+    if (forgotten != vector<uint64_t>{vlanKey(1, SECOND)} || table.lookup(vlanKey(1, SECOND)) != MacTable::NO_PORT)
+    {
+        cout << "Critical! A host that wasn't seen for MAC_AGING_EPOCHS epochs didn't expire!\n";
+        ok = false;
+    }
+    if (table.lookup(vlanKey(1, FIRST)) != 2)
+    {
+        cout << "Critical! A host that was hit every epoch expired!\n";
+        ok = false;
+    }
+
+    for (uint64_t host = 0; table.size() < table.capacity(); host++)
+    {
+        table.learn(vlanKey(3, 0x020000000100 + host), 1);
+    }
+    if (table.learn(vlanKey(1, SECOND), 1) || table.overflows() != 1 ||
+        table.lookup(vlanKey(1, SECOND)) != MacTable::NO_PORT)
+    {
+        cout << "Critical! A host is learned into a full table, or isn't counted as an overflow!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// the wheel runs on its own thread in real time, with a tick of 1 ms the timers above 64 ms start out a level up
+bool testTimerWheel()
+{
+    cout << "Testing the timer wheel...\n";
+    TimerWheel wheel(1ms);
+    std::mutex lock;
+    vector<int> fired;
+    bool early = false;
+    int periodic = 0;
+    auto start = steady_clock::now();
+    auto record = [&](int delay) {
+        return [&, delay]() {
+            std::lock_guard<std::mutex> guard(lock);
+            fired.push_back(delay);
+            early = early || steady_clock::now() - start < milliseconds(delay);
+        };
+    };
+
+    for (int delay : {130, 30, 70, 10})
+    {
+        wheel.schedule(milliseconds(delay), record(delay));
+    }
+    auto cancelled = wheel.schedule(20ms, record(20));
+    auto every = wheel.every(10ms, [&]() {
+        std::lock_guard<std::mutex> guard(lock);
+        periodic++;
+    });
+    wheel.start();
+
+    bool ok = true;
+    if (!wheel.cancel(cancelled) || wheel.cancel(cancelled))
+    {
+        cout << "Critical! A pending timer cannot be cancelled, or can be cancelled twice!\n";
+        ok = false;
+    }
+    std::this_thread::sleep_for(200ms);
+    wheel.cancel(every);
+    wheel.stop();
+
+    if (fired != vector<int>{10, 30, 70, 130} || early)
+    {
+        cout << "Critical! The timers didn't fire once each in the order of their delays, or fired early!\n";
+        ok = false;
+    }
+    if (periodic < 10 || periodic > 21)
+    {
+        cout << "Critical! A periodic timer ran " << periodic << " times in 200 ms instead of about 20!\n";
+        ok = false;
+    }
+    if (wheel.size() != 0)
+    {
+        cout << "Critical! Timers that fired or were cancelled are left on the wheel!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// the capacity is rounded up to a power of two, the elements come out in the order they went in,
+// across the wrap of the positions and with a producer and a consumer on threads of their own
+bool testBoundedQueue()
+{
+    cout << "Testing the bounded queue...\n";
+    BoundedQueue<uint32_t> queue(5);
+    bool ok = true;
+    uint32_t pushed = 0;
+    while (queue.push([&](uint32_t & value) { value = pushed; }))
+    {
+        pushed++;
+    }
+    if (pushed != 8 || queue.size() != 8 || queue.capacity() != 8)
+    {
+        cout << "Critical! A queue of 5 took " << pushed << " elements instead of 8!\n";
+        ok = false;
+    }
+
+    // every pop makes room for one more push, the positions wrap around the cells several times
+    for (uint32_t expected = 0; expected < 40; expected++)
+    {
+        uint32_t popped = UINT32_MAX;
+        if (!queue.pop([&](uint32_t & value) { popped = value; }) || popped != expected ||
+            (expected + 8 < 40 && !queue.push([&](uint32_t & value) { value = expected + 8; })))
+        {
+            cout << "Critical! The queue doesn't keep the order of the elements!\n";
+            ok = false;
+            break;
+        }
+    }
+    if (queue.pop([](uint32_t &) {}) || queue.size() != 0)
+    {
+        cout << "Critical! An empty queue gave out an element!\n";
+        ok = false;
+    }
+
+    static constexpr uint32_t COUNT = 100000;
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < COUNT; i++)
+        {
+            while (!queue.push([&](uint32_t & value) { value = i; }))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t next = 0;
+    while (next < COUNT)
+    {
+        uint32_t popped = 0;
+        if (!queue.pop([&](uint32_t & value) { popped = value; }))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ok = ok && popped == next;
+        next++;
+    }
+    producer.join();
+    if (!ok)
+    {
+        cout << "Critical! The elements of another thread come out of order!\n";
+    }
+    return ok;
+}
+
+// a thread takes a batch of frames into its cache on the first allocation and hands them all back when it exits,
+// so the frames are used on a thread of their own and the pool only read afterwards
+bool testFramePool()
+{
+    cout << "Testing the frame pool...\n";
+    FramePoolConfig config;
+    config.frameCount = 4 * POOL_CACHE_BATCH;
+    config.hugePages = false;
+    FramePool pool(config);
+    bool ok = true;
+
+    std::thread user([&]() {
+        uint32_t shared = pool.allocate();
+        if (shared == FramePool::INVALID || pool.statistics().inUse != POOL_CACHE_BATCH)
+        {
+            cout << "Critical! The first allocation doesn't take a batch into the cache of the thread!\n";
+            ok = false;
+        }
+
+        // three references, the frame only comes back with the last one
+        pool.retain(shared, 2);
+        pool.release(shared);
+        pool.release(shared);
+        vector<uint32_t> frames;
+        for (uint32_t frame = pool.allocate(); frame != FramePool::INVALID; frame = pool.allocate())
+        {
+            ok = ok && frame != shared;
+            frames.push_back(frame);
+        }
+        if (!ok || frames.size() != config.frameCount - 1)
+        {
+            cout << "Critical! A frame still referenced was handed out again, or frames went missing!\n";
+            ok = false;
+        }
+        pool.release(shared);
+        if (pool.allocate() != shared)
+        {
+            cout << "Critical! The last reference of a frame doesn't give it back!\n";
+            ok = false;
+        }
+        frames.push_back(shared);
+        for (auto frame : frames)
+        {
+            pool.release(frame);
+        }
+    });
+    user.join();
+
+    auto statistics = pool.statistics();
+    if (statistics.inUse != 0 || statistics.peak != config.frameCount || statistics.exhaustions != 1)
+    {
+        cout << "Critical! The cache of a thread that exited isn't back in the pool!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// ports that don't exist on the machine, their addresses are given, so the interfaces are never asked
+uint32_t addPort(PortTable & ports, uint32_t id, const VlanPortConfig & vlans = VlanPortConfig())
+{
+    return ports.add(Tins::NetworkInterface(static_cast<Tins::NetworkInterface::id_type>(1000 + id)),
+                     0x020000000f00 + id, vlans);
+}
+
+// two access ports and a third one in VLAN 10, another access port in VLAN 20, a trunk carrying both
+bool testPortTable()
+{
+    cout << "Testing the port table...\n";
+    VlanPortConfig access10;
+    access10.pvid = 10;
+    VlanPortConfig access20;
+    access20.pvid = 20;
+    VlanPortConfig trunk;
+    trunk.mode = VlanMode::Trunk;
+    trunk.pvid = 1;
+    trunk.allowed = {10, 20};
+    PortTable ports;
+    bool ok = true;
+    if (addPort(ports, 0, access10) != 0 || addPort(ports, 1, access10) != 1 || addPort(ports, 2, access20) != 2 ||
+        addPort(ports, 3, trunk) != 3 || addPort(ports, 1, access20) != 1 || ports.size() != 4)
+    {
+        cout << "Critical! The ports don't get dense indices, or a port is added twice!\n";
+        ok = false;
+    }
+
+    if (ports.flood(0, 10) != 0b1010 || ports.flood(3, 10) != 0b0011 || ports.flood(2, 20) != 0b1000 ||
+        ports.flood(3, 20) != 0b0100 || ports.flood(3, 1) != 0)
+    {
+        cout << "Critical! A frame is flooded outside of its VLAN or back to the ingress port!\n";
+        ok = false;
+    }
+    if (ports.members(10) != 0b1011 || ports.tagged(10) != 0b1000 || ports.tagged(1) != 0)
+    {
+        cout << "Critical! Only the trunk should leave its allowed VLANs tagged!\n";
+        ok = false;
+    }
+    if (ports.ingressVlan(0, PortTable::NO_VLAN) != 10 || ports.ingressVlan(0, 20) != PortTable::NO_VLAN ||
+        ports.ingressVlan(3, PortTable::NO_VLAN) != 1 || ports.ingressVlan(3, 20) != 20 ||
+        ports.ingressVlan(3, 30) != PortTable::NO_VLAN)
+    {
+        cout << "Critical! A port takes a frame of the wrong VLAN!\n";
+        ok = false;
+    }
+    if (ports.local(0x020000000f02) != 2 || ports.local(0x020000000f04) != PortTable::NO_PORT)
+    {
+        cout << "Critical! The address of a port isn't found, or another one is taken for it!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// a TCP segment from 10.0.0.1 to 10.0.0.2, tagged with VLAN 10 if tag is set, fill goes into the payload
+vector<uint8_t> tcpFrame(uint16_t sourcePort, bool tag, uint8_t fill)
+{
+    size_t offset = tag ? 16 : 12;
+    vector<uint8_t> frame(offset + 2 + 20 + 20 + 16, fill);
+    writeMac(frame.data(), 0x020000000002);
+    writeMac(frame.data() + 6, 0x020000000001);
+    if (tag)
+    {
+        uint8_t vlan[4] = {0x81, 0x00, 0x00, 10};
+        std::memcpy(frame.data() + 12, vlan, 4);
+    }
+    frame[offset] = 0x08;
+    frame[offset + 1] = 0x00;
+    uint8_t *ip = frame.data() + offset + 2;
+    std::fill_n(ip, 40, 0);
+    ip[0] = 0x45;
+    ip[9] = 6;
+    ip[12] = ip[16] = 10;
+    ip[15] = 1;
+    ip[19] = 2;
+    ip[20] = sourcePort >> 8;
+    ip[21] = sourcePort & 0xff;
+    ip[23] = 80;
+    return frame;
+}
+
+// a LAG of two ports next to two plain ones, it stands in the flood masks as its lowest member
+// and the flow hash of a frame picks one of the members whose link is up
+bool testLinkAggregation()
+{
+    cout << "Testing link aggregation...\n";
+    PortTable ports;
+    for (uint32_t port = 0; port < 4; port++)
+    {
+        addPort(ports, port);
+    }
+    bool ok = true;
+    if (ports.addLag("bond", 0b0110) != 0 || ports.logical(2) != 1 || ports.logical(3) != 3 ||
+        ports.flood(0, DEFAULT_VLAN) != 0b1010 || ports.flood(2, DEFAULT_VLAN) != 0b1001)
+    {
+        cout << "Critical! A LAG doesn't stand in the flood masks as one port!\n";
+        ok = false;
+    }
+
+    // a flow keeps its member whatever its payload and tags, the flows are spread over both members
+    PortTable::PortMask picked = 0;
+    for (uint16_t sourcePort = 1000; sourcePort < 1064; sourcePort++)
+    {
+        auto first = tcpFrame(sourcePort, false, 0x11);
+        auto second = tcpFrame(sourcePort, true, 0x22);
+        uint64_t flow = flowHash(first.data(), first.size(), 10);
+        if (flow != flowHash(second.data(), second.size(), 10) ||
+            ports.pick(1, flow) != ports.pick(1, flowHash(first.data(), first.size(), 10)))
+        {
+            cout << "Critical! The frames of one flow are sent over different members!\n";
+            ok = false;
+            break;
+        }
+        picked |= PortTable::PortMask(1) << ports.pick(1, flow);
+        if (ports.pickMembers(0b1011, flow) != (0b1001 | PortTable::PortMask(1) << ports.pick(1, flow)))
+        {
+            cout << "Critical! A LAG in a flood mask isn't replaced by the member of the flow!\n";
+            ok = false;
+            break;
+        }
+    }
+    if (picked != 0b0110)
+    {
+        cout << "Critical! The flows aren't spread over the members of the LAG!\n";
+        ok = false;
+    }
+
+    auto frame = tcpFrame(1000, false, 0);
+    if (flowHash(frame.data(), frame.size(), 10) == flowHash(frame.data(), frame.size(), 20))
+    {
+        cout << "Critical! The VLAN isn't part of the flow!\n";
+        ok = false;
+    }
+
+    uint64_t flow = flowHash(frame.data(), frame.size(), 10);
+    ports.setLinks(0b1011);
+    if (ports.pick(1, flow) != 1 || ports.pick(2, flow) != 1 || ports.pick(3, flow) != 3)
+    {
+        cout << "Critical! A member whose link is down is picked!\n";
+        ok = false;
+    }
+    ports.setLinks(0b1001);
+    if (ports.pick(1, flow) != PortTable::NO_PORT || ports.pickMembers(0b1011, flow) != 0b1001)
+    {
+        cout << "Critical! A LAG without links is sent to!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// a frame with an 802.1Q tag of VLAN 10 pushed in front of its EtherType
+vector<uint8_t> tagged(vector<uint8_t> frame)
+{
+    frame.insert(frame.begin() + 12, {0x81, 0x00, 0x00, 10});
+    return frame;
+}
+
+// every header is found through the tags, IPv6 extension headers are skipped, a non-first fragment is only IP
+bool testProtocolClassifier()
+{
+    cout << "Testing the protocol classifier...\n";
+    auto bits = [](std::initializer_list<Protocol> protocols) {
+        uint32_t mask = protocolBit(Protocol::EthernetII);
+        for (auto protocol : protocols)
+        {
+            mask |= protocolBit(protocol);
+        }
+        return mask;
+    };
+    ProtocolClassifier classifier;
+    auto classify = [&](const vector<uint8_t> & frame) {
+        return classifier.classify(frame.data(), frame.size());
+    };
+
+    uint8_t first[4] = {10, 0, 0, 1};
+    uint8_t second[4] = {10, 0, 0, 2};
+    uint8_t host[16] = {0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    uint8_t target[16] = {0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2};
+    auto arp = arpFrame(1, 0x020000000001, 0x020000000001, first, second);
+    auto tcp = tcpFrame(1000, false, 0);
+    auto icmpv6 = ndFrame(135, 0x020000000001, 0x020000000001, host, target, 0);
+    bool ok = true;
+    if (classify(arp) != bits({Protocol::ARP}) || classify(tagged(arp)) != bits({Protocol::ARP}))
+    {
+        cout << "Critical! ARP isn't recognized!\n";
+        ok = false;
+    }
+    if (classify(tcp) != bits({Protocol::IP, Protocol::TCP, Protocol::HTTP}) ||
+        classify(tcpFrame(1000, true, 0)) != bits({Protocol::IP, Protocol::TCP, Protocol::HTTP}))
+    {
+        cout << "Critical! A TCP segment to port 80 isn't HTTP, with its tag or without!\n";
+        ok = false;
+    }
+    if (classify(icmpv6) != bits({Protocol::IPv6, Protocol::ICMPv6}) ||
+        classify(tagged(icmpv6)) != bits({Protocol::IPv6, Protocol::ICMPv6}) ||
+        classify(tagged(tagged(icmpv6))) != bits({Protocol::IPv6, Protocol::ICMPv6}))
+    {
+        cout << "Critical! ICMPv6 isn't found behind its VLAN tags!\n";
+        ok = false;
+    }
+
+    // a hop-by-hop options header of 8 bytes in front of the ICMPv6 message
+    auto options = tagged(icmpv6);
+    options[18 + 6] = 0;
+    options.insert(options.begin() + 18 + 40, {58, 0, 5, 2, 0, 0, 1, 0});
+    if (classify(options) != bits({Protocol::IPv6, Protocol::ICMPv6}))
+    {
+        cout << "Critical! An IPv6 extension header isn't skipped!\n";
+        ok = false;
+    }
+
+    auto fragment = tcp;
+    fragment[14 + 7] = 0x10;
+    tcp.resize(14 + 10);
+    if (classify(fragment) != bits({Protocol::IP}) || classify(tcp) != bits({Protocol::IP}))
+    {
+        cout << "Critical! A non-first fragment or a truncated header is looked into!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// an IGMP message in an IPv4 packet to its group, the checksums aren't looked at
+vector<uint8_t> igmpFrame(const vector<uint8_t> & message)
+{
+    vector<uint8_t> frame(14 + 24, 0);
+    writeMac(frame.data(), 0x01005e000016);
+    writeMac(frame.data() + 6, 0x020000000001);
+    frame[12] = 0x08;
+    uint8_t *ip = frame.data() + 14;
+    ip[0] = 0x46;
+    ip[2] = (24 + message.size()) >> 8;
+    ip[3] = (24 + message.size()) & 0xff;
+    ip[8] = 1;
+    ip[9] = 2;
+    ip[12] = 10;
+    ip[15] = 1;
+    ip[16] = 224;
+    ip[19] = 22;
+    ip[20] = 0x94; // the router alert option
+    ip[21] = 4;
+    frame.insert(frame.end(), message.begin(), message.end());
+    return frame;
+}
+
+// an MLD message behind the hop-by-hop header with the router alert option
+vector<uint8_t> mldFrame(const vector<uint8_t> & message)
+{
+    vector<uint8_t> frame(14 + 40 + 8, 0);
+    writeMac(frame.data(), 0x333300000016);
+    writeMac(frame.data() + 6, 0x020000000001);
+    frame[12] = 0x86;
+    frame[13] = 0xdd;
+    uint8_t *ip = frame.data() + 14;
+    ip[0] = 0x60;
+    ip[4] = (8 + message.size()) >> 8;
+    ip[5] = (8 + message.size()) & 0xff;
+    ip[6] = 0;
+    ip[7] = 1;
+    ip[8] = 0xfe;
+    ip[9] = 0x80;
+    ip[23] = 1;
+    ip[24] = 0xff;
+    ip[25] = 0x02;
+    ip[39] = 0x16;
+    uint8_t options[8] = {58, 0, 5, 2, 0, 0, 1, 0};
+    std::memcpy(ip + 40, options, 8);
+    frame.insert(frame.end(), message.begin(), message.end());
+    return frame;
+}
+
+// reports join their ports, leaves and include records without sources drop them after the last member time,
+// queries make router ports, for IGMP and MLD, tagged or not
+bool testMulticastTable()
+{
+    cout << "Testing multicast snooping...\n";
+    MulticastTable table(16);
+    auto snoop = [&](const vector<uint8_t> & frame, uint32_t port) {
+        return table.snoop(frame.data(), frame.size(), 10, port);
+    };
+    uint64_t ipv4Group = vlanKey(10, 0x01005e010101);
+    uint64_t ipv6Group = vlanKey(10, 0x333300010003);
+    uint32_t group = 0;
+    bool ok = true;
+
+    // an IGMPv3 query with a robustness of 2, a query interval of 60 and a response time of 1 second,
+    // a membership lasts 121 seconds, then an MLD query that doesn't announce an interval
+    vector<uint8_t> igmpQuery = {0x11, 10, 0, 0, 0, 0, 0, 0, 2, 60, 0, 0};
+    vector<uint8_t> mldQuery(28, 0);
+    mldQuery[0] = 130;
+    if (snoop(igmpFrame(igmpQuery), 0) != MulticastMessage::Query ||
+        snoop(mldFrame(mldQuery), 4) != MulticastMessage::Query || table.routers() != 0b10001)
+    {
+        cout << "Critical! A query doesn't make a router port!\n";
+        ok = false;
+    }
+
+    // an IGMPv2 report from port 1, an IGMPv3 one excluding no sources from port 2, both for 239.1.1.1
+    vector<uint8_t> v2Report = {0x16, 0, 0, 0, 239, 1, 1, 1};
+    vector<uint8_t> v3Report = {0x22, 0, 0, 0, 0, 0, 0, 1, 4, 0, 0, 0, 239, 1, 1, 1};
+    if (snoop(igmpFrame(v2Report), 1) != MulticastMessage::Report ||
+        snoop(tagged(igmpFrame(v3Report)), 2) != MulticastMessage::Report)
+    {
+        cout << "Critical! An IGMP report isn't taken for one!\n";
+        ok = false;
+    }
+    if (table.lookup(ipv4Group, group) != 0b110 || group == MulticastTable::NO_GROUP)
+    {
+        cout << "Critical! The IGMP reports don't join their ports!\n";
+        ok = false;
+    }
+
+    // 224.0.0.251 always goes to every port
+    vector<uint8_t> reserved = {0x16, 0, 0, 0, 224, 0, 0, 251};
+    snoop(igmpFrame(reserved), 1);
+    if (table.size() != 1)
+    {
+        cout << "Critical! A reserved group is joined!\n";
+        ok = false;
+    }
+
+    // an MLDv1 report for ff0e::1:3 from port 3, then an MLDv2 include record without sources for it
+    vector<uint8_t> mldReport(24, 0);
+    mldReport[0] = 131;
+    mldReport[8] = 0xff;
+    mldReport[9] = 0x0e;
+    mldReport[21] = 1;
+    mldReport[23] = 3;
+    if (snoop(tagged(mldFrame(mldReport)), 3) != MulticastMessage::Report ||
+        table.lookup(ipv6Group, group) != 0b1000)
+    {
+        cout << "Critical! An MLD report doesn't join its port!\n";
+        ok = false;
+    }
+    vector<uint8_t> mldLeave(8 + 20, 0);
+    mldLeave[0] = 143;
+    mldLeave[7] = 1;
+    mldLeave[8] = 3;
+    std::copy(mldReport.begin() + 8, mldReport.end(), mldLeave.begin() + 12);
+    vector<uint8_t> igmpLeave = {0x17, 0, 0, 0, 239, 1, 1, 1};
+    snoop(mldFrame(mldLeave), 3);
+    snoop(igmpFrame(igmpLeave), 1);
+
+    auto now = steady_clock::now();
+    table.sweep(now);
+    if (table.lookup(ipv4Group, group) != 0b110 || table.lookup(ipv6Group, group) != 0b1000)
+    {
+        cout << "Critical! A leave drops its port before the last member time!\n";
+        ok = false;
+    }
+    table.sweep(now + MULTICAST_LAST_MEMBER_TIME + milliseconds(100));
+    if (table.lookup(ipv4Group, group) != 0b100 || table.lookup(ipv6Group, group) != 0 || table.size() != 1)
+    {
+        cout << "Critical! A leave doesn't drop its port after the last member time!\n";
+        ok = false;
+    }
+
+    // the memberships last as the querier announced, the router ports MULTICAST_QUERIER_INTERVAL
+    table.sweep(now + milliseconds(120'000));
+    if (table.lookup(ipv4Group, group) != 0b100)
+    {
+        cout << "Critical! A membership doesn't last the interval the querier announced!\n";
+        ok = false;
+    }
+    table.sweep(now + milliseconds(122'000));
+    if (table.size() != 0 || table.routers() != 0b10001)
+    {
+        cout << "Critical! A membership outlives the interval the querier announced!\n";
+        ok = false;
+    }
+    table.sweep(now + MULTICAST_QUERIER_INTERVAL + milliseconds(1'000));
+    if (table.routers() != 0)
+    {
+        cout << "Critical! A router port doesn't age!\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// two strict classes drain in order before the weighted ones, which share the rest 3 to 1 across batches,
+// an empty class gives up its turn and a pass over empty classes ends the batch
+bool testEgressScheduling()
+{
+    cout << "Testing egress scheduling...\n";
+    EgressScheduler scheduler({{true, 0}, {true, 0}, {false, 3}, {false, 1}});
+    uint32_t queued[4] = {2, 3, 1000, 1000};
+    vector<uint32_t> order;
+    auto take = [&](uint32_t index) {
+        if (queued[index] == 0)
+        {
+            return false;
+        }
+        queued[index]--;
+        order.push_back(index);
+        return true;
+    };
+    bool ok = true;
+
+    if (scheduler.schedule(9, take) != 9 || order != vector<uint32_t>{0, 0, 1, 1, 1, 2, 2, 2, 3})
+    {
+        cout << "Critical! The strict classes don't go first, in order of priority!\n";
+        ok = false;
+    }
+    order.clear();
+    if (scheduler.schedule(8, take) != 8 || order != vector<uint32_t>{2, 2, 2, 3, 2, 2, 2, 3})
+    {
+        cout << "Critical! The round robin doesn't carry over to the next batch!\n";
+        ok = false;
+    }
+
+    // a frame of a strict class comes first in the next batch
+    order.clear();
+    queued[1] = 1;
+    scheduler.schedule(400, take);
+    uint32_t taken[4] = {};
+    for (auto index : order)
+    {
+        taken[index]++;
+    }
+    if (order.front() != 1 || taken[1] != 1 || taken[2] != 300 || taken[3] != 99)
+    {
+        cout << "Critical! The weighted classes don't share by their weights!\n";
+        ok = false;
+    }
+
+    order.clear();
+    queued[2] = 0;
+    queued[3] = 5;
+    if (scheduler.schedule(100, take) != 5 || order != vector<uint32_t>(5, 3))
+    {
+        cout << "Critical! An empty class doesn't give up its turn!\n";
+        ok = false;
+    }
+    return ok;
+}
+
 #define HASH_COUNT 10
 
 int main (int argc, char *argv[]) {
@@ -101,17 +1111,29 @@ int main (int argc, char *argv[]) {
         }
     }
 
-    if (ok)
-    {
-        cout << "---TEST PASS---\n";
-    }
-
     for (int i = 0; i < HASH_COUNT; i++)
     {
         cout << i + 1 << ". " << std::hex << Packet::Hash()(hashes[i]) << "\n";
         printPayload(hashes[i].data);
     }
 
+    ok = testFrameHashes() && ok;
+    ok = testStrippedVlanTag() && ok;
+    ok = testNeighborSuppression() && ok;
+    ok = testMacTable() && ok;
+    ok = testTimerWheel() && ok;
+    ok = testBoundedQueue() && ok;
+    ok = testFramePool() && ok;
+    ok = testPortTable() && ok;
+    ok = testLinkAggregation() && ok;
+    ok = testProtocolClassifier() && ok;
+    ok = testMulticastTable() && ok;
+    ok = testEgressScheduling() && ok;
+    if (ok)
+    {
+        cout << "---TEST PASS---\n";
+    }
+
     return 0;
 }
 
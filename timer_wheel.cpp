@@ -0,0 +1,282 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(milliseconds tick)
+    : tick_m(std::max<milliseconds>(tick, 1ms)),
+      epoch_m(steady_clock::now()),
+      current_m(0),
+      nextId_m(1),
+      slots_m{},
+      timers_m{},
+      running_m(false),
+      thread_m{},
+      mutex_m{},
+      wakeup_m{}
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    stop();
+}
+
+void TimerWheel::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_m);
+        if (running_m)
+        {
+            return;
+        }
+        running_m = true;
+    }
+    thread_m = std::thread(&TimerWheel::thread, this);
+}
+
+void TimerWheel::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_m);
+        running_m = false;
+    }
+    wakeup_m.notify_all();
+    if (thread_m.joinable())
+    {
+        thread_m.join();
+    }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(milliseconds delay, Callback callback)
+{
+    return add(delay, 0, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::every(milliseconds period, Callback callback)
+{
+    return add(period, ticks(period), std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::add(milliseconds delay, uint64_t period, Callback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    // an empty wheel doesn't tick, the thread sleeps until something is scheduled
+    bool idle = timers_m.empty();
+    if (idle)
+    {
+        current_m = std::max(current_m, now());
+    }
+
+    TimerId id = nextId_m++;
+    auto & timer = timers_m[id];
+    timer = {id, deadline(delay), period, std::move(callback), nullptr, nullptr, nullptr};
+    place(timer);
+    if (idle)
+    {
+        wakeup_m.notify_all();
+    }
+    return id;
+}
+
+bool TimerWheel::reschedule(TimerId timer, milliseconds delay)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    auto it = timers_m.find(timer);
+    if (it == timers_m.end())
+    {
+        return false;
+    }
+    unlink(it->second);
+    it->second.expires = deadline(delay);
+    place(it->second);
+    return true;
+}
+
+bool TimerWheel::cancel(TimerId timer)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    auto it = timers_m.find(timer);
+    if (it == timers_m.end())
+    {
+        return false;
+    }
+    unlink(it->second);
+    timers_m.erase(it);
+    return true;
+}
+
+size_t TimerWheel::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    return timers_m.size();
+}
+
+uint64_t TimerWheel::now() const
+{
+    return static_cast<uint64_t>((steady_clock::now() - epoch_m) / tick_m);
+}
+
+// a tick is processed once it has begun, so a timer due within a tick waits for the next one
+uint64_t TimerWheel::deadline(milliseconds delay) const
+{
+    auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - epoch_m + delay);
+    auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_m);
+    return static_cast<uint64_t>((since.count() + tick.count() - 1) / tick.count());
+}
+
+uint64_t TimerWheel::ticks(milliseconds delay) const
+{
+    return static_cast<uint64_t>(std::max<int64_t>((delay.count() + tick_m.count() - 1) / tick_m.count(), 1));
+}
+
+// the slot of level l is picked by bits of the expiry tick, the timer reaches it again before it expires,
+// because it only goes to level l if it expires within SLOTS^(l + 1) ticks
+void TimerWheel::place(Timer & timer)
+{
+    uint64_t delay = std::min(std::max(timer.expires, current_m + 1) - current_m, MAX_DELAY);
+    uint64_t at = current_m + delay;
+    uint32_t level = 0;
+    while (level + 1 < LEVELS && delay >= (uint64_t(1) << (LEVEL_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    Timer *& head = slots_m[level][(at >> (LEVEL_BITS * level)) & SLOT_MASK];
+    timer.previous = nullptr;
+    timer.next = head;
+    if (head != nullptr)
+    {
+        head->previous = &timer;
+    }
+    head = &timer;
+    timer.slot = &head;
+}
+
+void TimerWheel::unlink(Timer & timer)
+{
+    if (timer.slot == nullptr)
+    {
+        return;
+    }
+    if (timer.previous != nullptr)
+    {
+        timer.previous->next = timer.next;
+    }
+    else
+    {
+        *timer.slot = timer.next;
+    }
+    if (timer.next != nullptr)
+    {
+        timer.next->previous = timer.previous;
+    }
+    timer.previous = nullptr;
+    timer.next = nullptr;
+    timer.slot = nullptr;
+}
+
+void TimerWheel::cascade(uint32_t level)
+{
+    Timer *& head = slots_m[level][(current_m >> (LEVEL_BITS * level)) & SLOT_MASK];
+    Timer *timer = head;
+    head = nullptr;
+    while (timer != nullptr)
+    {
+        Timer *next = timer->next;
+        place(*timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::advance(vector<TimerId> & due)
+{
+    current_m++;
+    for (uint32_t level = 1; level < LEVELS; level++)
+    {
+        if ((current_m & ((uint64_t(1) << (LEVEL_BITS * level)) - 1)) != 0)
+        {
+            break;
+        }
+        cascade(level);
+    }
+
+    Timer *& head = slots_m[0][current_m & SLOT_MASK];
+    Timer *timer = head;
+    head = nullptr;
+    while (timer != nullptr)
+    {
+        Timer *next = timer->next;
+        timer->previous = nullptr;
+        timer->next = nullptr;
+        timer->slot = nullptr;
+        if (timer->expires <= current_m)
+        {
+            due.push_back(timer->id);
+        }
+        else
+        {
+            place(*timer); // was further out than the wheel reaches
+        }
+        timer = next;
+    }
+}
+
+void TimerWheel::thread()
+{
+    std::unique_lock<std::mutex> lock(mutex_m);
+    vector<TimerId> due;
+    while (running_m)
+    {
+        // ticks missed while the thread slept are caught up, an empty wheel just jumps ahead
+        uint64_t target = now();
+        if (timers_m.empty())
+        {
+            current_m = std::max(current_m, target);
+        }
+        while (current_m < target)
+        {
+            advance(due);
+        }
+
+        // a timer stays in the table while its callback runs, so cancelling it meanwhile is fine
+        for (TimerId id : due)
+        {
+            auto it = timers_m.find(id);
+            if (it == timers_m.end())
+            {
+                continue; // cancelled by an earlier callback
+            }
+            bool periodic = it->second.period != 0;
+            Callback callback = periodic ? it->second.callback : std::move(it->second.callback);
+            if (!periodic)
+            {
+                timers_m.erase(it);
+            }
+
+            lock.unlock();
+            callback();
+            lock.lock();
+
+            it = timers_m.find(id);
+            if (periodic && it != timers_m.end() && it->second.slot == nullptr)
+            {
+                it->second.expires += it->second.period;
+                place(it->second);
+            }
+        }
+        due.clear();
+
+        if (!running_m)
+        {
+            break;
+        }
+        if (timers_m.empty())
+        {
+            wakeup_m.wait(lock);
+        }
+        else
+        {
+            wakeup_m.wait_until(lock, epoch_m + tick_m * (current_m + 1));
+        }
+    }
+}
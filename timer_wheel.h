@@ -0,0 +1,85 @@
+#pragma once
+
+#include "settings.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using std::chrono::steady_clock, std::chrono::milliseconds;
+using std::vector;
+
+// a hierarchical timing wheel, after Varghese and Lauck, driving every expiry on a housekeeping thread
+// the wheel of level l has SLOTS slots of SLOTS^l ticks each, a timer sits in the lowest level whose slot
+// it doesn't outlive and moves a level down once that slot comes up, so scheduling and cancelling
+// are constant time and a tick only touches the timers that are due
+// the callbacks run on the housekeeping thread without the wheel locked, they may schedule and cancel
+struct TimerWheel
+{
+public:
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t;
+    static constexpr TimerId NO_TIMER = 0;
+
+    TimerWheel(milliseconds tick = TIMER_WHEEL_TICK);
+    TimerWheel(TimerWheel &&) = delete;
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel & operator=(TimerWheel &&) = delete;
+    TimerWheel & operator=(const TimerWheel &) = delete;
+    ~TimerWheel();
+
+public:
+    void start();
+    void stop(); // blocking, waits for a callback that is running, so never from a callback
+
+    TimerId schedule(milliseconds delay, Callback callback);
+    TimerId every(milliseconds period, Callback callback); // the first run is one period from now
+    bool reschedule(TimerId timer, milliseconds delay);    // false if the timer fired or was cancelled
+    bool cancel(TimerId timer);
+    size_t size() const;
+
+private:
+    static constexpr uint32_t LEVEL_BITS = 6;
+    static constexpr uint32_t SLOTS = 1 << LEVEL_BITS;
+    static constexpr uint32_t LEVELS = 4;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELAY = (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1; // in ticks
+
+    struct Timer
+    {
+        TimerId id;
+        uint64_t expires; // tick
+        uint64_t period;  // ticks, 0 for a single run
+        Callback callback;
+        Timer *previous;
+        Timer *next;
+        Timer **slot; // the list it is linked into, nullptr while it runs
+    };
+
+    void thread();
+    TimerId add(milliseconds delay, uint64_t period, Callback callback); // the period in ticks
+    uint64_t now() const;                         // the tick steady_clock is in
+    uint64_t deadline(milliseconds delay) const;  // the first tick that doesn't begin before the delay is over
+    uint64_t ticks(milliseconds delay) const;     // rounded up, at least one
+    void place(Timer & timer);
+    void unlink(Timer & timer);
+    void cascade(uint32_t level); // moves the timers of the current slot of a level down
+    void advance(vector<TimerId> & due);
+
+private:
+    milliseconds tick_m;
+    steady_clock::time_point epoch_m; // tick 0
+    uint64_t current_m;               // the last tick that was processed
+    TimerId nextId_m;
+    Timer *slots_m[LEVELS][SLOTS];
+    std::unordered_map<TimerId, Timer> timers_m; // the nodes never move, the slots link them
+    bool running_m;
+    std::thread thread_m;
+    mutable std::mutex mutex_m;
+    std::condition_variable wakeup_m;
+};
@@ -0,0 +1,809 @@
+#include "tx_engine.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <qlogging.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// where the frame data starts inside a TPACKET_V2 TX ring slot
+static constexpr uint32_t TX_RING_DATA_OFFSET = TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+
+static std::runtime_error socketError(int fd, const string & what)
+{
+    auto error = std::runtime_error(what + ": " + std::strerror(errno));
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return error;
+}
+
+TxPort::TxPort(const string & interfaceName, const TxConfig & config)
+    : fd_m(-1),
+      config_m(config),
+      pending_m(0),
+      headers_m{},
+      vectors_m{},
+      messages_m{},
+      ring_m(nullptr),
+      ringSize_m(0),
+      ringHead_m(0)
+{
+    int index = if_nametoindex(interfaceName.c_str());
+    if (index == 0)
+    {
+        throw socketError(-1, "No interface named " + interfaceName);
+    }
+
+    // protocol 0, this socket never receives anything
+    fd_m = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_m < 0)
+    {
+        throw socketError(-1, "Cannot open a packet socket on " + interfaceName);
+    }
+
+    // has to come before the ring is set up
+    if (config_m.vnetHeader)
+    {
+        int one = 1;
+        if (setsockopt(fd_m, SOL_PACKET, PACKET_VNET_HDR, &one, sizeof(one)) < 0)
+        {
+            throw socketError(fd_m, "PACKET_VNET_HDR is not supported on " + interfaceName);
+        }
+    }
+
+    if (config_m.qdiscBypass)
+    {
+        int one = 1;
+        if (setsockopt(fd_m, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0)
+        {
+            qWarning("PACKET_QDISC_BYPASS is not available on %s: %s", interfaceName.c_str(), std::strerror(errno));
+        }
+    }
+
+    if (config_m.mode == TxMode::TxRing)
+    {
+        int version = TPACKET_V2;
+        if (setsockopt(fd_m, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        {
+            throw socketError(fd_m, "TPACKET_V2 is not supported");
+        }
+
+        uint32_t blockSize = std::max<uint32_t>(config_m.ringFrameSize, sysconf(_SC_PAGESIZE));
+        uint32_t framesPerBlock = blockSize / config_m.ringFrameSize;
+        tpacket_req request{};
+        request.tp_block_size = blockSize;
+        request.tp_block_nr = (config_m.ringFrameCount + framesPerBlock - 1) / framesPerBlock;
+        request.tp_frame_size = config_m.ringFrameSize;
+        request.tp_frame_nr = request.tp_block_nr * framesPerBlock;
+        config_m.ringFrameCount = request.tp_frame_nr;
+        if (setsockopt(fd_m, SOL_PACKET, PACKET_TX_RING, &request, sizeof(request)) < 0)
+        {
+            throw socketError(fd_m, "Cannot set up the TX ring on " + interfaceName);
+        }
+
+        ringSize_m = static_cast<size_t>(request.tp_block_size) * request.tp_block_nr;
+        void *map = mmap(nullptr, ringSize_m, PROT_READ | PROT_WRITE, MAP_SHARED, fd_m, 0);
+        if (map == MAP_FAILED)
+        {
+            throw socketError(fd_m, "Cannot map the TX ring of " + interfaceName);
+        }
+        ring_m = static_cast<uint8_t *>(map);
+    }
+    else
+    {
+        headers_m.resize(config_m.batchSize);
+        vectors_m.resize(2 * config_m.batchSize);
+        messages_m.resize(config_m.batchSize);
+    }
+
+    sockaddr_ll address{};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = 0;
+    address.sll_ifindex = index;
+    if (bind(fd_m, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        if (ring_m != nullptr)
+        {
+            munmap(ring_m, ringSize_m);
+        }
+        throw socketError(fd_m, "Cannot bind a TX socket to " + interfaceName);
+    }
+}
+
+TxPort::~TxPort()
+{
+    if (ring_m != nullptr)
+    {
+        munmap(ring_m, ringSize_m);
+    }
+    if (fd_m >= 0)
+    {
+        close(fd_m);
+    }
+}
+
+bool TxPort::queue(const uint8_t *data, uint32_t size, const VnetHeader *vnet)
+{
+    // frames from ports without PACKET_VNET_HDR get an empty header, no offloads requested
+    static const VnetHeader plain{};
+    if (vnet == nullptr)
+    {
+        vnet = &plain;
+    }
+
+    if (config_m.mode == TxMode::TxRing)
+    {
+        return queueRing(data, size, *vnet);
+    }
+    return queueMessage(data, size, *vnet);
+}
+
+uint32_t TxPort::flush(uint32_t & dropped)
+{
+    if (pending_m == 0)
+    {
+        return 0;
+    }
+    if (config_m.mode == TxMode::TxRing)
+    {
+        return flushRing();
+    }
+    return flushMessages(dropped);
+}
+
+uint32_t TxPort::pending() const
+{
+    return pending_m;
+}
+
+bool TxPort::queueMessage(const uint8_t *data, uint32_t size, const VnetHeader & vnet)
+{
+    if (pending_m == messages_m.size())
+    {
+        return false;
+    }
+
+    // the header goes in front of the frame as its own vector, the frame itself is not copied
+    iovec *vectors = &vectors_m[2 * pending_m];
+    uint32_t count = 0;
+    if (config_m.vnetHeader)
+    {
+        headers_m[pending_m] = vnet;
+        vectors[count++] = {&headers_m[pending_m], sizeof(vnet)};
+    }
+    vectors[count++] = {const_cast<uint8_t *>(data), size};
+    messages_m[pending_m] = {};
+    messages_m[pending_m].msg_hdr.msg_iov = vectors;
+    messages_m[pending_m].msg_hdr.msg_iovlen = count;
+    pending_m++;
+    return true;
+}
+
+bool TxPort::queueRing(const uint8_t *data, uint32_t size, const VnetHeader & vnet)
+{
+    uint32_t headerSize = config_m.vnetHeader ? sizeof(vnet) : 0;
+    if (size + headerSize > config_m.ringFrameSize - TX_RING_DATA_OFFSET)
+    {
+        qDebug("Frame of %u bytes does not fit into a TX ring slot", size);
+        return false;
+    }
+
+    auto *header = reinterpret_cast<tpacket2_hdr *>(ringFrame(ringHead_m));
+    auto status = __atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+    {
+        // the kernel hasn't caught up yet, kick it once and give up if that wasn't enough
+        send(fd_m, nullptr, 0, MSG_DONTWAIT);
+        status = __atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE);
+        if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+        {
+            return false;
+        }
+    }
+
+    auto *slot = reinterpret_cast<uint8_t *>(header) + TX_RING_DATA_OFFSET;
+    std::memcpy(slot, &vnet, headerSize);
+    std::memcpy(slot + headerSize, data, size);
+    header->tp_len = size + headerSize;
+    __atomic_store_n(&header->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    ringHead_m = (ringHead_m + 1) % config_m.ringFrameCount;
+    pending_m++;
+    return true;
+}
+
+// the messages are only valid until the flush, whatever sendmmsg refused is dropped
+uint32_t TxPort::flushMessages(uint32_t & dropped)
+{
+    uint32_t sent = 0;
+    while (sent < pending_m)
+    {
+        int result = sendmmsg(fd_m, messages_m.data() + sent, pending_m - sent, 0);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            qDebug("sendmmsg failed: %s", std::strerror(errno));
+            break;
+        }
+        sent += result;
+    }
+
+    dropped += pending_m - sent;
+    pending_m = 0;
+    return sent;
+}
+
+uint32_t TxPort::flushRing()
+{
+    // frames that the kernel can't take right now stay in the ring for the next kick
+    if (send(fd_m, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS)
+    {
+        qDebug("TX ring kick failed: %s", std::strerror(errno));
+        return 0; // nothing went out, they are still pending
+    }
+
+    uint32_t sent = pending_m;
+    pending_m = 0;
+    return sent;
+}
+
+uint8_t *TxPort::ringFrame(uint32_t index) const
+{
+    return ring_m + static_cast<size_t>(index) * config_m.ringFrameSize;
+}
+
+EgressScheduler::EgressScheduler(const vector<EgressClassConfig> & classes)
+    : strict_m{},
+      weighted_m{},
+      weights_m{},
+      credits_m{},
+      cursor_m(0)
+{
+    for (uint32_t i = 0; i < classes.size(); i++)
+    {
+        if (classes[i].strict)
+        {
+            strict_m.push_back(i);
+            continue;
+        }
+        weighted_m.push_back(i);
+        weights_m.push_back(classes[i].weight);
+        credits_m.push_back(classes[i].weight);
+    }
+}
+
+EgressPort::EgressPort(const interface & destination, const TxConfig & config, const LatencyConfig & latency,
+                       FramePool & pool, XdpFabric *xdp, int cpu)
+    : destination_m(destination),
+      config_m(config),
+      latency_m(latency),
+      cpu_m(cpu),
+      pool_m(pool),
+      xdp_m(xdp),
+      socket_m(nullptr),
+      xdpSocket_m(xdp == nullptr ? nullptr : xdp->socket(destination, 0)),
+      xdpPending_m(0),
+      inFlight_m{},
+      overflowInFlight_m(config.batchSize),
+      overflowUsed_m(0),
+      scratch_m{},
+      classes_m{},
+      scheduler_m(config.classes),
+      wakeup_m(-1),
+      running_m(false),
+      sleeping_m(false),
+      thread_m{},
+      batches_m(0),
+      frames_m(0),
+      dropped_m(0),
+      lastBatch_m(0),
+      maxBatch_m(0)
+{
+    for (uint32_t i = 0; i < config_m.classes.size(); i++)
+    {
+        classes_m.emplace_back(new Class(config_m.classes[i], config_m.queueSize));
+    }
+    inFlight_m.reserve(config_m.batchSize);
+
+    if (xdpSocket_m == nullptr)
+    {
+        socket_m.reset(new TxPort(destination_m.name(), config_m));
+    }
+
+    wakeup_m = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_m < 0)
+    {
+        throw socketError(-1, "Cannot create the wakeup event of " + destination_m.name());
+    }
+}
+
+EgressPort::~EgressPort()
+{
+    stop();
+    close(wakeup_m);
+}
+
+void EgressPort::start()
+{
+    running_m.store(true);
+    thread_m = std::thread(&EgressPort::thread, this);
+}
+
+void EgressPort::stop()
+{
+    if (!thread_m.joinable())
+    {
+        return;
+    }
+
+    running_m.store(false);
+    sleeping_m.store(true);
+    notify();
+    thread_m.join();
+}
+
+bool EgressPort::enqueue(const FrameView & frame, uint32_t pooled, XdpFrame *origin, uint32_t trafficClass)
+{
+    auto & target = *classes_m[trafficClass];
+    bool zeroCopy = this->zeroCopy() && origin != nullptr && !origin->consumed;
+    int64_t now = duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    bool queued = target.queue.push([&](EgressFrame & slot) {
+        slot.size = frame.size;
+        slot.hasVnet = frame.vnet != nullptr;
+        if (slot.hasVnet)
+        {
+            slot.vnet = *frame.vnet;
+        }
+        slot.umem = zeroCopy;
+        slot.frame = zeroCopy ? FramePool::INVALID : pooled;
+        slot.offset = slot.frame == FramePool::INVALID ? 0 : static_cast<int32_t>(frame.data - pool_m.data(pooled));
+        if (zeroCopy)
+        {
+            slot.address = origin->address;
+        }
+        else if (pooled == FramePool::INVALID)
+        {
+            slot.overflow.assign(frame.data, frame.data + frame.size);
+        }
+        slot.enqueued = now;
+    });
+
+    if (!queued)
+    {
+        target.enqueueDrops.fetch_add(1, std::memory_order_relaxed);
+        target.highWater.store(target.queue.capacity(), std::memory_order_relaxed);
+        return false;
+    }
+    if (zeroCopy)
+    {
+        origin->consumed = true;
+
+        // the UMEM frame went instead, the reference isn't needed
+        if (pooled != FramePool::INVALID)
+        {
+            pool_m.release(pooled);
+        }
+    }
+    return true;
+}
+
+bool EgressPort::zeroCopy() const
+{
+    return xdpSocket_m != nullptr;
+}
+
+// pairs with the fence in thread(), either the TX thread sees the new frames or we see it sleeping
+void EgressPort::notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_m.load(std::memory_order_relaxed))
+    {
+        uint64_t one = 1;
+        if (write(wakeup_m, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        {
+            qDebug("Cannot wake up the TX thread of %s: %s", destination_m.name().c_str(), std::strerror(errno));
+        }
+    }
+}
+
+TxStatistics EgressPort::statistics() const
+{
+    TxStatistics statistics{};
+    statistics.batches = batches_m.load(std::memory_order_relaxed);
+    statistics.frames = frames_m.load(std::memory_order_relaxed);
+    statistics.dropped = dropped_m.load(std::memory_order_relaxed);
+    statistics.lastBatch = lastBatch_m.load(std::memory_order_relaxed);
+    statistics.maxBatch = maxBatch_m.load(std::memory_order_relaxed);
+    for (const auto & trafficClass : classes_m)
+    {
+        EgressClassStatistics entry{};
+        entry.strict = trafficClass->config.strict;
+        entry.weight = trafficClass->config.weight;
+        entry.frames = trafficClass->frames.load(std::memory_order_relaxed);
+        entry.depth = trafficClass->queue.size();
+        entry.highWater = trafficClass->highWater.load(std::memory_order_relaxed);
+        entry.enqueueDrops = trafficClass->enqueueDrops.load(std::memory_order_relaxed);
+        entry.latencyTotal = trafficClass->latencyTotal.load(std::memory_order_relaxed);
+        entry.latencyMax = trafficClass->latencyMax.load(std::memory_order_relaxed);
+
+        statistics.depth += entry.depth;
+        statistics.highWater = std::max(statistics.highWater, entry.highWater);
+        statistics.enqueueDrops += entry.enqueueDrops;
+        statistics.classes.push_back(entry);
+    }
+    return statistics;
+}
+
+void EgressPort::thread()
+{
+    tuneThread("TX " + destination_m.name(), latency_m, cpu_m).log();
+
+    while (running_m.load(std::memory_order_acquire))
+    {
+        // the depth only goes down here, so sampling it before draining catches every peak
+        for (auto & trafficClass : classes_m)
+        {
+            uint32_t depth = trafficClass->queue.size();
+            if (depth > trafficClass->highWater.load(std::memory_order_relaxed))
+            {
+                trafficClass->highWater.store(depth, std::memory_order_relaxed);
+            }
+        }
+
+        uint32_t dropped = 0;
+        uint32_t taken = schedule(dropped);
+
+        if (taken > 0)
+        {
+            uint32_t sent = flush(dropped);
+            if (sent > 0)
+            {
+                batches_m.store(batches_m.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                frames_m.store(frames_m.load(std::memory_order_relaxed) + sent, std::memory_order_relaxed);
+                lastBatch_m.store(sent, std::memory_order_relaxed);
+                maxBatch_m.store(std::max(maxBatch_m.load(std::memory_order_relaxed), sent), std::memory_order_relaxed);
+            }
+            dropped_m.store(dropped_m.load(std::memory_order_relaxed) + dropped, std::memory_order_relaxed);
+            continue;
+        }
+
+        // nothing to do, sleep until an RX worker notifies us, unless the thread spins
+        if (latency_m.busyPoll)
+        {
+            continue;
+        }
+        sleeping_m.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (depth() == 0 && running_m.load(std::memory_order_acquire))
+        {
+            pollfd descriptor{};
+            descriptor.fd = wakeup_m;
+            descriptor.events = POLLIN;
+            poll(&descriptor, 1, RX_POLL_TIMEOUT.count());
+
+            uint64_t count = 0;
+            while (read(wakeup_m, &count, sizeof(count)) > 0)
+            {
+            }
+        }
+        sleeping_m.store(false, std::memory_order_relaxed);
+    }
+
+    // the pool and UMEM frames still queued have to go back, from this thread so that
+    // its frame cache is handed back to the pool when it exits
+    for (auto & trafficClass : classes_m)
+    {
+        while (trafficClass->queue.pop([&](EgressFrame & frame) { release(frame); }))
+        {
+        }
+    }
+}
+
+uint32_t EgressPort::schedule(uint32_t & dropped)
+{
+    return scheduler_m.schedule(config_m.batchSize, [&](uint32_t index) { return take(index, dropped); });
+}
+
+bool EgressPort::take(uint32_t index, uint32_t & dropped)
+{
+    auto & source = *classes_m[index];
+    return source.queue.pop([&](EgressFrame & frame) {
+        int64_t now = duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        int64_t latency = now - frame.enqueued;
+        source.frames.store(source.frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        source.latencyTotal.store(source.latencyTotal.load(std::memory_order_relaxed) + latency,
+                                  std::memory_order_relaxed);
+        if (latency > source.latencyMax.load(std::memory_order_relaxed))
+        {
+            source.latencyMax.store(latency, std::memory_order_relaxed);
+        }
+        dropped += !send(frame);
+    });
+}
+
+uint32_t EgressPort::depth() const
+{
+    uint32_t total = 0;
+    for (const auto & trafficClass : classes_m)
+    {
+        total += trafficClass->queue.size();
+    }
+    return total;
+}
+
+// the frame data has to stay valid until the flush, so it is only let go of there
+bool EgressPort::send(EgressFrame & frame)
+{
+    const uint8_t *data = nullptr;
+    if (frame.frame != FramePool::INVALID)
+    {
+        data = pool_m.data(frame.frame) + frame.offset;
+        inFlight_m.push_back(frame.frame);
+        frame.frame = FramePool::INVALID;
+    }
+    else if (!frame.umem)
+    {
+        auto & overflow = overflowInFlight_m[overflowUsed_m++];
+        overflow.swap(frame.overflow);
+        data = overflow.data();
+    }
+
+    if (xdpSocket_m != nullptr)
+    {
+        bool queued = sendXdp(frame, data);
+        xdpPending_m += queued;
+        return queued;
+    }
+    return socket_m->queue(data, frame.size, frame.hasVnet ? &frame.vnet : nullptr);
+}
+
+// AF_XDP has no offloads, checksums are finished here and super-frames can't go through at all
+bool EgressPort::sendXdp(EgressFrame & frame, const uint8_t *data)
+{
+    if (frame.umem)
+    {
+        if (!xdpSocket_m->transmit(frame.address, frame.size))
+        {
+            release(frame);
+            return false;
+        }
+        return true;
+    }
+
+    if (!frame.hasVnet || !(frame.vnet.flags & VNET_F_NEEDS_CSUM))
+    {
+        return xdpSocket_m->transmitCopy(data, frame.size);
+    }
+    if (frame.vnet.gsoType != VNET_GSO_NONE)
+    {
+        qDebug("Cannot send a GSO super-frame of %u bytes to the AF_XDP port %s", frame.size,
+               destination_m.name().c_str());
+        return false;
+    }
+
+    uint32_t start = frame.vnet.csumStart, field = start + frame.vnet.csumOffset;
+    if (field + 2 > frame.size)
+    {
+        return false;
+    }
+
+    // the field holds the pseudo header sum, so summing over it gives the whole checksum
+    // other ports may be sending the same pool frame, the checksum goes into a copy
+    scratch_m.assign(data, data + frame.size);
+    uint32_t sum = 0;
+    for (uint32_t i = start; i + 1 < frame.size; i += 2)
+    {
+        sum += (scratch_m[i] << 8) | scratch_m[i + 1];
+    }
+    if ((frame.size - start) % 2 != 0)
+    {
+        sum += scratch_m[frame.size - 1] << 8;
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    scratch_m[field] = ~sum >> 8;
+    scratch_m[field + 1] = ~sum & 0xff;
+    return xdpSocket_m->transmitCopy(scratch_m.data(), frame.size);
+}
+
+uint32_t EgressPort::flush(uint32_t & dropped)
+{
+    uint32_t sent = 0;
+    if (xdpSocket_m == nullptr)
+    {
+        sent = socket_m->flush(dropped);
+    }
+    else
+    {
+        sent = xdpPending_m;
+        if (sent > 0)
+        {
+            xdpSocket_m->kick();
+        }
+        xdpPending_m = 0;
+    }
+
+    for (auto frame : inFlight_m)
+    {
+        pool_m.release(frame);
+    }
+    inFlight_m.clear();
+    overflowUsed_m = 0;
+    return sent;
+}
+
+void EgressPort::release(EgressFrame & frame)
+{
+    if (frame.umem)
+    {
+        xdp_m->umem().release(frame.address);
+        frame.umem = false;
+    }
+    if (frame.frame != FramePool::INVALID)
+    {
+        pool_m.release(frame.frame);
+        frame.frame = FramePool::INVALID;
+    }
+}
+
+EgressPort::Class::Class(const EgressClassConfig & config, uint32_t queueSize)
+    : config(config),
+      queue(queueSize),
+      frames(0),
+      enqueueDrops(0),
+      highWater(0),
+      latencyTotal(0),
+      latencyMax(0)
+{
+}
+
+TxEngine::TxEngine(const TxConfig & config, const LatencyConfig & latency, FramePool & pool, XdpFabric *xdp)
+    : config_m(config),
+      latency_m(latency),
+      pool_m(pool),
+      xdp_m(xdp),
+      ports_m{}
+{
+    if (config_m.classes.empty())
+    {
+        config_m.classes.push_back({false, 1});
+    }
+    for (auto & trafficClass : config_m.classes)
+    {
+        trafficClass.weight = std::max<uint32_t>(trafficClass.weight, 1);
+    }
+
+    // a class that doesn't exist means the last one
+    uint8_t last = config_m.classes.size() - 1;
+    for (auto & trafficClass : config_m.pcpClass)
+    {
+        trafficClass = std::min(trafficClass, last);
+    }
+    for (auto & trafficClass : config_m.dscpClass)
+    {
+        trafficClass = std::min(trafficClass, last);
+    }
+}
+
+TxEngine::~TxEngine()
+{
+    stop();
+}
+
+void TxEngine::addPort(uint32_t index, const interface & port, int cpu)
+{
+    if (ports_m.size() <= index)
+    {
+        ports_m.resize(index + 1);
+    }
+    ports_m[index].reset(new EgressPort(port, config_m, latency_m, pool_m, xdp_m, cpu));
+}
+
+void TxEngine::start()
+{
+    for (auto & port : ports_m)
+    {
+        if (port)
+        {
+            port->start();
+        }
+    }
+}
+
+void TxEngine::stop()
+{
+    for (auto & port : ports_m)
+    {
+        if (port)
+        {
+            port->stop();
+        }
+    }
+}
+
+EgressPort *TxEngine::port(uint32_t index) const
+{
+    return index < ports_m.size() ? ports_m[index].get() : nullptr;
+}
+
+bool TxEngine::enqueue(uint32_t destination, const FrameView & frame, uint32_t pooled, XdpFrame *origin)
+{
+    EgressPort *port = this->port(destination);
+    if (port == nullptr)
+    {
+        qDebug("No egress port was set up for port %u", destination);
+        return false;
+    }
+    return port->enqueue(frame, pooled, origin, trafficClass(frame));
+}
+
+bool TxEngine::zeroCopy(uint32_t destination) const
+{
+    EgressPort *port = this->port(destination);
+    return port != nullptr && port->zeroCopy();
+}
+
+FramePool & TxEngine::pool() const
+{
+    return pool_m;
+}
+
+void TxEngine::notify()
+{
+    for (auto & port : ports_m)
+    {
+        if (port)
+        {
+            port->notify();
+        }
+    }
+}
+
+// a tag in the frame goes first, it is the one the frame leaves with, the ring reports a stripped one aside
+uint32_t TxEngine::trafficClass(const FrameView & frame) const
+{
+    const uint8_t *data = frame.data;
+    uint16_t type = (data[ETHERNET_TYPE_OFFSET] << 8) | data[ETHERNET_TYPE_OFFSET + 1];
+    if ((type == ETH_P_8021Q || type == ETH_P_8021AD) && frame.size >= ETHERNET_HEADER_SIZE + 2)
+    {
+        return config_m.pcpClass[data[ETHERNET_HEADER_SIZE] >> 5];
+    }
+    if (frame.stripped)
+    {
+        return config_m.pcpClass[frame.strippedTci >> 13];
+    }
+    if (type == ETH_P_IP && frame.size >= ETHERNET_HEADER_SIZE + 2)
+    {
+        return config_m.dscpClass[data[ETHERNET_HEADER_SIZE + 1] >> 2];
+    }
+    if (type == ETH_P_IPV6 && frame.size >= ETHERNET_HEADER_SIZE + 2)
+    {
+        uint8_t trafficClass = (data[ETHERNET_HEADER_SIZE] << 4) | (data[ETHERNET_HEADER_SIZE + 1] >> 4);
+        return config_m.dscpClass[trafficClass >> 2];
+    }
+    return config_m.pcpClass[0];
+}
+
+void TxEngine::synchronize(SharedStorage & storage) const
+{
+    for (uint32_t i = 0; i < ports_m.size() && i < storage.ports.size(); i++)
+    {
+        auto it = storage.interfaces.find(storage.ports[i]);
+        if (ports_m[i] && it != storage.interfaces.end())
+        {
+            it->second.tx = ports_m[i]->statistics();
+        }
+    }
+}
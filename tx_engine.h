@@ -0,0 +1,262 @@
+#pragma once
+
+#include "bounded_queue.h"
+#include "dataplane_config.h"
+#include "frame_pool.h"
+#include "low_latency.h"
+#include "packet_ring.h"
+#include "shared_storage.h"
+#include "xdp_socket.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <tins/network_interface.h>
+#include <vector>
+
+using interface = Tins::NetworkInterface;
+using std::string, std::vector, std::unique_ptr;
+
+// a persistent AF_PACKET socket bound to one egress interface
+// frames are queued and handed to the kernel in one go by flush()
+struct TxPort
+{
+public:
+    TxPort(const string & interfaceName, const TxConfig & config);
+    TxPort(TxPort &&) = delete;
+    TxPort(const TxPort &) = delete;
+    TxPort & operator=(TxPort &&) = delete;
+    TxPort & operator=(const TxPort &) = delete;
+    ~TxPort();
+
+public:
+    // false if the frame was dropped, vnet is only used with PACKET_VNET_HDR, nullptr sends a plain frame
+    // in SendMmsg mode the data is not copied, it has to stay valid until the next flush()
+    bool queue(const uint8_t *data, uint32_t size, const VnetHeader *vnet = nullptr);
+    // returns the number of frames handed to the kernel, dropped counts the ones it refused
+    // in TxRing mode the frames stay in the ring when the kick fails, the next flush() sends them
+    uint32_t flush(uint32_t & dropped);
+    uint32_t pending() const;
+
+private:
+    bool queueMessage(const uint8_t *data, uint32_t size, const VnetHeader & vnet);
+    bool queueRing(const uint8_t *data, uint32_t size, const VnetHeader & vnet);
+    uint32_t flushMessages(uint32_t & dropped);
+    uint32_t flushRing();
+    uint8_t *ringFrame(uint32_t index) const;
+
+private:
+    int fd_m;
+    TxConfig config_m;
+    uint32_t pending_m;
+
+    // sendmmsg batch, two vectors per message, the virtio_net_hdr and the frame
+    vector<VnetHeader> headers_m;
+    vector<iovec> vectors_m;
+    vector<mmsghdr> messages_m;
+
+    // PACKET_TX_RING
+    uint8_t *ring_m;
+    size_t ringSize_m;
+    uint32_t ringHead_m;
+};
+
+// a frame waiting in the queue of an egress port, it holds one reference to its pool frame
+// the slots are reused, the overflow buffers only grow to the largest frame seen
+struct EgressFrame
+{
+    uint32_t frame;           // in the frame pool, FramePool::INVALID if the frame is elsewhere
+    int32_t offset;           // of the frame from FramePool::data(), a pushed VLAN tag starts in front of it
+    vector<uint8_t> overflow; // frames too large for the pool
+    uint32_t size;
+    VnetHeader vnet;
+    bool hasVnet;
+    bool umem;        // the UMEM frame at address goes out without a copy
+    uint64_t address;
+    int64_t enqueued; // steady clock, nanoseconds
+};
+
+// the order the TX thread of a port takes frames off its class queues in: the strict classes in order of priority
+// until they are empty, then the weighted ones round robin, each for as many frames per turn as its weight
+// an empty class gives up the rest of its turn, the position and credits carry over to the next batch
+struct EgressScheduler
+{
+public:
+    EgressScheduler(const vector<EgressClassConfig> & classes);
+    EgressScheduler(EgressScheduler &&) = delete;
+    EgressScheduler(const EgressScheduler &) = delete;
+    EgressScheduler & operator=(EgressScheduler &&) = delete;
+    EgressScheduler & operator=(const EgressScheduler &) = delete;
+
+public:
+    // take(index) pops one frame off the queue of the class, false if it is empty
+    // returns how many frames were taken, at most limit
+    template <typename Take>
+    uint32_t schedule(uint32_t limit, Take && take);
+
+private:
+    vector<uint32_t> strict_m;   // class indices, in order of priority
+    vector<uint32_t> weighted_m; // class indices, in round robin order
+    vector<uint32_t> weights_m;  // of weighted_m
+    vector<uint32_t> credits_m;  // left in the current turn, of weighted_m
+    uint32_t cursor_m;           // into weighted_m
+};
+
+// one egress interface, every RX worker feeds its class queues and a dedicated TX thread drains them
+// a slow or blocked port only fills its own queues, ingress keeps going at full rate
+// under congestion the strict classes go first, so their latency stays bounded by one batch
+struct EgressPort
+{
+public:
+    EgressPort(const interface & destination, const TxConfig & config, const LatencyConfig & latency, FramePool & pool,
+               XdpFabric *xdp, int cpu);
+    EgressPort(EgressPort &&) = delete;
+    EgressPort(const EgressPort &) = delete;
+    EgressPort & operator=(EgressPort &&) = delete;
+    EgressPort & operator=(const EgressPort &) = delete;
+    ~EgressPort();
+
+public:
+    void start();
+    void stop(); // blocking, frames still in the queue are dropped
+
+    // the frame is sent as it was received, including its virtio_net_hdr if it has one
+    // pooled is a frame pool copy of it, the port takes over one reference on success,
+    // frame has to point into that copy then, within its headroom at the earliest
+    // without one the frame is copied to the heap, which is only meant for frames too large for the pool
+    // origin is the UMEM frame the packet was received in, an AF_XDP port takes it over instead
+    // false if the queue of the class is full
+    bool enqueue(const FrameView & frame, uint32_t pooled, XdpFrame *origin, uint32_t trafficClass);
+    bool zeroCopy() const; // AF_XDP port, takes UMEM frames over
+    void notify(); // wakes the TX thread up if it sleeps, once per burst is enough
+
+    TxStatistics statistics() const;
+
+private:
+    struct Class
+    {
+        Class(const EgressClassConfig & config, uint32_t queueSize);
+        EgressClassConfig config;
+        BoundedQueue<EgressFrame> queue;
+
+        std::atomic<int64_t> frames;
+        std::atomic<int64_t> enqueueDrops;
+        std::atomic<uint32_t> highWater;
+        std::atomic<int64_t> latencyTotal;
+        std::atomic<int64_t> latencyMax;
+    };
+
+    void thread();
+    uint32_t schedule(uint32_t & dropped); // takes one batch off the queues, returns how many frames
+    bool take(uint32_t index, uint32_t & dropped);
+    uint32_t depth() const;
+    bool send(EgressFrame & frame);
+    bool sendXdp(EgressFrame & frame, const uint8_t *data);
+    uint32_t flush(uint32_t & dropped); // also lets go of the frames of the batch
+    void release(EgressFrame & frame);
+
+private:
+    interface destination_m;
+    TxConfig config_m;
+    LatencyConfig latency_m;
+    int cpu_m; // the TX thread is pinned to it, unless it is negative
+    FramePool & pool_m;
+    XdpFabric *xdp_m;
+    unique_ptr<TxPort> socket_m;
+    XdpSocket *xdpSocket_m;
+    uint32_t xdpPending_m;
+    vector<uint32_t> inFlight_m;              // pool frames queued to the socket, released after the flush
+    vector<vector<uint8_t>> overflowInFlight_m; // the same for heap frames, swapped out of their slots
+    uint32_t overflowUsed_m;
+    vector<uint8_t> scratch_m;                // checksums are completed in a copy, the frame may be shared
+    vector<unique_ptr<Class>> classes_m;
+    EgressScheduler scheduler_m;
+    int wakeup_m; // eventfd
+    std::atomic<bool> running_m;
+    std::atomic<bool> sleeping_m;
+    std::thread thread_m;
+
+    // only the TX thread writes these
+    std::atomic<int64_t> batches_m;
+    std::atomic<int64_t> frames_m;
+    std::atomic<int64_t> dropped_m;
+    std::atomic<uint32_t> lastBatch_m;
+    std::atomic<uint32_t> maxBatch_m;
+};
+
+// all the egress ports of the switch, set up before any RX worker starts
+// they are indexed like the port table, so the workers reach one without a lookup
+// ports that run on AF_XDP are fed through their XDP sockets instead of AF_PACKET
+struct TxEngine
+{
+public:
+    TxEngine(const TxConfig & config, const LatencyConfig & latency, FramePool & pool, XdpFabric *xdp);
+    TxEngine(TxEngine &&) = delete;
+    TxEngine(const TxEngine &) = delete;
+    TxEngine & operator=(TxEngine &&) = delete;
+    TxEngine & operator=(const TxEngine &) = delete;
+    ~TxEngine();
+
+public:
+    void addPort(uint32_t index, const interface & port, int cpu = -1);
+    void start();
+    void stop();
+
+    // see EgressPort::enqueue, pooled keeps its reference if the frame is not queued
+    bool enqueue(uint32_t destination, const FrameView & frame, uint32_t pooled, XdpFrame *origin = nullptr);
+    bool zeroCopy(uint32_t destination) const;
+    void notify();
+    FramePool & pool() const;
+
+    // copies the counters of the ports into the interface table
+    void synchronize(SharedStorage & storage) const;
+
+private:
+    uint32_t trafficClass(const FrameView & frame) const; // from the 802.1p priority or the IP DSCP
+    EgressPort *port(uint32_t index) const;               // nullptr if it couldn't be set up
+
+private:
+    TxConfig config_m;
+    LatencyConfig latency_m;
+    FramePool & pool_m;
+    XdpFabric *xdp_m;
+    vector<unique_ptr<EgressPort>> ports_m;
+};
+
+// ============================================================================
+// = Inline implementations ===================================================
+// ============================================================================
+
+template <typename Take>
+uint32_t EgressScheduler::schedule(uint32_t limit, Take && take)
+{
+    uint32_t taken = 0;
+    for (auto index : strict_m)
+    {
+        while (taken < limit && take(index))
+        {
+            taken++;
+        }
+    }
+
+    // a full pass over empty classes ends the batch
+    uint32_t empty = 0;
+    while (taken < limit && empty < weighted_m.size())
+    {
+        auto & credits = credits_m[cursor_m];
+        if (credits > 0 && take(weighted_m[cursor_m]))
+        {
+            credits--;
+            taken++;
+            empty = 0;
+            continue;
+        }
+
+        empty += credits > 0;
+        credits = weights_m[cursor_m];
+        cursor_m = (cursor_m + 1) % weighted_m.size();
+    }
+    return taken;
+}
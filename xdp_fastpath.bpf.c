@@ -0,0 +1,223 @@
+// In-kernel fast path of the switch, attached to every switch port.
+// Known unicast between two learned hosts is redirected straight to the
+// egress port, everything else goes on to userspace, which stays in charge
+// of learning and aging. Built with clang -target bpf.
+
+#include <linux/bpf.h>
+#include <linux/icmp.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <bpf/bpf_endian.h>
+#include <bpf/bpf_helpers.h>
+
+#include "xdp_fastpath_maps.h"
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, FASTPATH_MAX_MACS);
+    __type(key, __u64);
+    __type(value, struct fastpath_mac);
+} mac_table SEC(".maps");
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, FASTPATH_MAX_PORTS);
+    __type(key, __u32);
+    __type(value, struct fastpath_port);
+} ports SEC(".maps");
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
+    __uint(max_entries, FASTPATH_MAX_PORTS);
+    __type(key, __u32);
+    __type(value, struct bpf_devmap_val);
+} tx_ports SEC(".maps");
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, FASTPATH_MAX_PORTS);
+    __type(key, __u32);
+    __type(value, struct fastpath_counters);
+} counters SEC(".maps");
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_XSKMAP);
+    __uint(max_entries, FASTPATH_MAX_PORTS * FASTPATH_MAX_QUEUES);
+    __type(key, __u32);
+    __type(value, __u32);
+} xsks_map SEC(".maps");
+
+static __always_inline __u64 mac_key(const unsigned char *mac)
+{
+    return ((__u64)mac[0] << 40) | ((__u64)mac[1] << 32) | ((__u64)mac[2] << 24) | ((__u64)mac[3] << 16) |
+           ((__u64)mac[4] << 8) | (__u64)mac[5];
+}
+
+// the protocol of an IPv4 packet or the next header of an IPv6 one, unlike userspace
+// the IPv6 extension headers aren't walked
+static __always_inline __u32 classify_l4(__u8 protocol, void *l4, void *data_end)
+{
+    if (protocol == IPPROTO_ICMP)
+    {
+        return 1 << FASTPATH_ICMP;
+    }
+    if (protocol == IPPROTO_ICMPV6)
+    {
+        return 1 << FASTPATH_ICMPV6;
+    }
+    if (protocol == IPPROTO_UDP)
+    {
+        return 1 << FASTPATH_UDP;
+    }
+    if (protocol != IPPROTO_TCP)
+    {
+        return 0;
+    }
+
+    __u32 mask = 1 << FASTPATH_TCP;
+    struct tcphdr *tcp = l4;
+    if ((void *)(tcp + 1) <= data_end &&
+        (tcp->source == bpf_htons(80) || tcp->dest == bpf_htons(80) || tcp->source == bpf_htons(443) ||
+         tcp->dest == bpf_htons(443)))
+    {
+        mask |= 1 << FASTPATH_HTTP;
+    }
+    return mask;
+}
+
+// the same protocols as the userspace statistics, one bit per Protocol enum value
+static __always_inline __u32 classify(void *data, void *data_end)
+{
+    struct ethhdr *eth = data;
+    __u32 mask = 1 << FASTPATH_ETHERNET;
+
+    if (eth->h_proto == bpf_htons(ETH_P_ARP))
+    {
+        return mask | (1 << FASTPATH_ARP);
+    }
+    if (eth->h_proto == bpf_htons(ETH_P_IPV6))
+    {
+        struct ipv6hdr *ip6 = (void *)(eth + 1);
+        if ((void *)(ip6 + 1) > data_end)
+        {
+            return mask;
+        }
+        return mask | (1 << FASTPATH_IPV6) | classify_l4(ip6->nexthdr, ip6 + 1, data_end);
+    }
+    if (eth->h_proto != bpf_htons(ETH_P_IP))
+    {
+        return mask;
+    }
+
+    struct iphdr *ip = (void *)(eth + 1);
+    if ((void *)(ip + 1) > data_end)
+    {
+        return mask;
+    }
+    return mask | (1 << FASTPATH_IP) | classify_l4(ip->protocol, (void *)ip + ip->ihl * 4, data_end);
+}
+
+static __always_inline void count(__u32 ifindex, __u32 mask, int output)
+{
+    struct fastpath_counters *entry = bpf_map_lookup_elem(&counters, &ifindex);
+    if (!entry)
+    {
+        return;
+    }
+
+#pragma unroll
+    for (int i = 0; i < FASTPATH_PROTOCOLS; i++)
+    {
+        if (mask & (1 << i))
+        {
+            if (output)
+            {
+                entry->output[i]++;
+            }
+            else
+            {
+                entry->input[i]++;
+            }
+        }
+    }
+}
+
+// frames the fast path doesn't handle go to the AF_XDP socket of the queue, if there is one
+static __always_inline int slow_path(struct xdp_md *ctx, struct fastpath_port *port)
+{
+    if (!port)
+    {
+        return XDP_PASS;
+    }
+    __u32 key = port->slot * FASTPATH_MAX_QUEUES + ctx->rx_queue_index;
+    return bpf_redirect_map(&xsks_map, key, XDP_PASS);
+}
+
+SEC("xdp")
+int psip_fastpath(struct xdp_md *ctx)
+{
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+    struct ethhdr *eth = data;
+    __u32 ingress = ctx->ingress_ifindex;
+
+    struct fastpath_port *port = bpf_map_lookup_elem(&ports, &ingress);
+    if (!port || !port->up || (void *)(eth + 1) > data_end)
+    {
+        return slow_path(ctx, port);
+    }
+
+    // broadcast and multicast are flooded by userspace
+    if (eth->h_dest[0] & 1)
+    {
+        return slow_path(ctx, port);
+    }
+
+    // the source has to be learned on this very port, otherwise userspace has to see the frame to learn it
+    __u64 source_key = mac_key(eth->h_source);
+    struct fastpath_mac *source = bpf_map_lookup_elem(&mac_table, &source_key);
+    if (!source || source->ifindex != ingress)
+    {
+        return slow_path(ctx, port);
+    }
+
+    __u64 destination_key = mac_key(eth->h_dest);
+    struct fastpath_mac *destination = bpf_map_lookup_elem(&mac_table, &destination_key);
+    if (!destination)
+    {
+        return slow_path(ctx, port);
+    }
+
+    struct fastpath_port *egress = bpf_map_lookup_elem(&ports, &destination->ifindex);
+    if (!egress || !egress->up)
+    {
+        return slow_path(ctx, port);
+    }
+
+    // keeps the source alive, userspace turns this into a refreshed timeout
+    __sync_fetch_and_add(&source->hits, 1);
+
+    __u32 mask = classify(data, data_end);
+    count(ingress, mask, 0);
+
+    // the recipient sits on the same port and already has the frame
+    if (destination->ifindex == ingress)
+    {
+        return XDP_DROP;
+    }
+
+    count(destination->ifindex, mask, 1);
+    return bpf_redirect_map(&tx_ports, destination->ifindex, XDP_PASS);
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,250 @@
+#include "xdp_fastpath.h"
+#include <cstring>
+#include <qlogging.h>
+#include <stdexcept>
+
+#ifdef PSIP_HAVE_FASTPATH
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <linux/if_link.h>
+#endif
+
+static_assert(FASTPATH_ETHERNET == static_cast<int>(Protocol::EthernetII) &&
+                  FASTPATH_HTTP == static_cast<int>(Protocol::HTTP) &&
+                  FASTPATH_ICMPV6 == static_cast<int>(Protocol::ICMPv6),
+              "the fast path counters must follow the Protocol enum");
+
+#ifdef PSIP_HAVE_FASTPATH
+
+XdpFastPath::XdpFastPath(const vector<interface> & ports, const XdpConfig & config)
+    : object_m(nullptr),
+      macTable_m(-1),
+      ports_m(-1),
+      txPorts_m(-1),
+      counters_m(-1),
+      xsks_m(-1),
+      interfaces_m(ports),
+      config_m(config),
+      attached_m(false),
+      cpus_m(libbpf_num_possible_cpus()),
+      lastCounters_m{}
+{
+    if (interfaces_m.size() > FASTPATH_MAX_PORTS)
+    {
+        throw std::runtime_error("The XDP fast path supports at most " + std::to_string(FASTPATH_MAX_PORTS) + " ports");
+    }
+
+    object_m = bpf_object__open_file(PSIP_FASTPATH_OBJECT, nullptr);
+    if (libbpf_get_error(object_m))
+    {
+        object_m = nullptr;
+        throw std::runtime_error(string("Cannot open ") + PSIP_FASTPATH_OBJECT);
+    }
+    int result = bpf_object__load(object_m);
+    if (result != 0)
+    {
+        bpf_object__close(object_m);
+        throw std::runtime_error(string("Cannot load the XDP fast path: ") + std::strerror(-result));
+    }
+
+    macTable_m = bpf_object__find_map_fd_by_name(object_m, "mac_table");
+    ports_m = bpf_object__find_map_fd_by_name(object_m, "ports");
+    txPorts_m = bpf_object__find_map_fd_by_name(object_m, "tx_ports");
+    counters_m = bpf_object__find_map_fd_by_name(object_m, "counters");
+    xsks_m = bpf_object__find_map_fd_by_name(object_m, "xsks_map");
+    int program = bpf_program__fd(bpf_object__find_program_by_name(object_m, "psip_fastpath"));
+
+    vector<fastpath_counters> zero(cpus_m, fastpath_counters{});
+    uint32_t flags = config_m.skbMode ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    for (uint32_t i = 0; i < interfaces_m.size(); i++)
+    {
+        uint32_t ifindex = interfaces_m[i].id();
+        fastpath_port port{1, i};
+        bpf_devmap_val device{};
+        device.ifindex = ifindex;
+        bpf_map_update_elem(ports_m, &ifindex, &port, BPF_ANY);
+        bpf_map_update_elem(txPorts_m, &ifindex, &device, BPF_ANY);
+        bpf_map_update_elem(counters_m, &ifindex, zero.data(), BPF_ANY);
+        lastCounters_m[ifindex] = {};
+
+        result = bpf_xdp_attach(ifindex, program, flags, nullptr);
+        if (result != 0)
+        {
+            attached_m = true;
+            detach();
+            bpf_object__close(object_m);
+            throw std::runtime_error("Cannot attach the XDP fast path to " + interfaces_m[i].name() + ": " +
+                                     std::strerror(-result));
+        }
+    }
+    attached_m = true;
+    qInfo("XDP fast path attached to %zu ports (%s mode)", interfaces_m.size(), config_m.skbMode ? "generic" : "native");
+}
+
+XdpFastPath::~XdpFastPath()
+{
+    detach();
+    bpf_object__close(object_m);
+}
+
+void XdpFastPath::learn(const mac_address & mac, const interface & port)
+{
+    uint64_t key = macKey(mac);
+    fastpath_mac value{port.id(), 0, 0};
+    bpf_map_update_elem(macTable_m, &key, &value, BPF_ANY);
+}
+
+void XdpFastPath::forget(uint64_t key)
+{
+    bpf_map_delete_elem(macTable_m, &key);
+}
+
+void XdpFastPath::clear()
+{
+    uint64_t key = 0;
+    while (bpf_map_get_next_key(macTable_m, nullptr, &key) == 0)
+    {
+        bpf_map_delete_elem(macTable_m, &key);
+    }
+}
+
+void XdpFastPath::detach()
+{
+    if (!attached_m)
+    {
+        return;
+    }
+
+    uint32_t flags = config_m.skbMode ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    for (const auto & port : interfaces_m)
+    {
+        bpf_xdp_detach(port.id(), flags, nullptr);
+    }
+    attached_m = false;
+}
+
+void XdpFastPath::refresh(MacTable & macTable)
+{
+    // a hit means the host sent something, the same as being learned again
+    // the kernel doesn't know about VLANs, it only runs while every port is in the default one
+    macTable.forEach([&](uint64_t key, uint32_t) {
+        uint64_t mac = keyMac(key);
+        fastpath_mac value{};
+        if (bpf_map_lookup_elem(macTable_m, &mac, &value) == 0 && value.hits != 0)
+        {
+            macTable.touch(key);
+            value.hits = 0;
+            bpf_map_update_elem(macTable_m, &mac, &value, BPF_EXIST);
+        }
+    });
+}
+
+void XdpFastPath::synchronize(SharedStorage & storage)
+{
+    vector<fastpath_counters> perCpu(cpus_m);
+    auto & shard = storage.statisticsTable.management();
+    for (auto & entry : storage.interfaces)
+    {
+        uint32_t ifindex = entry.first.id();
+        fastpath_port port{entry.second.up, slot(entry.first)};
+        bpf_map_update_elem(ports_m, &ifindex, &port, BPF_EXIST);
+
+        if (bpf_map_lookup_elem(counters_m, &ifindex, perCpu.data()) != 0)
+        {
+            continue;
+        }
+        fastpath_counters total{};
+        for (const auto & cpu : perCpu)
+        {
+            for (int i = 0; i < FASTPATH_PROTOCOLS; i++)
+            {
+                total.input[i] += cpu.input[i];
+                total.output[i] += cpu.output[i];
+            }
+        }
+
+        auto & last = lastCounters_m[ifindex];
+        for (int i = 0; i < FASTPATH_PROTOCOLS; i++)
+        {
+            auto input = total.input[i] - last.input[i];
+            auto output = total.output[i] - last.output[i];
+            if (input == 0 && output == 0)
+            {
+                continue;
+            }
+            // the kernel only counts frames
+            uint32_t index = storage.ports.index(entry.first);
+            uint32_t protocol = protocolBit(static_cast<Protocol>(i));
+            StatisticsTable::count(shard, index, protocol, Direction::Input, input, 0);
+            StatisticsTable::count(shard, index, protocol, Direction::Output, output, 0);
+        }
+        last = total;
+    }
+}
+
+void XdpFastPath::registerSocket(const interface & port, uint32_t queue, int fd)
+{
+    uint32_t key = slot(port) * FASTPATH_MAX_QUEUES + queue;
+    if (bpf_map_update_elem(xsks_m, &key, &fd, BPF_ANY) != 0)
+    {
+        qWarning("Cannot register the AF_XDP socket of %s queue %u with the fast path", port.name().c_str(), queue);
+    }
+}
+
+#else
+
+XdpFastPath::XdpFastPath(const vector<interface> & ports, const XdpConfig & config)
+    : object_m(nullptr),
+      interfaces_m(ports),
+      config_m(config),
+      attached_m(false),
+      cpus_m(0)
+{
+    throw std::runtime_error("psip_switch was built without the XDP fast path");
+}
+
+XdpFastPath::~XdpFastPath()
+{
+}
+
+void XdpFastPath::learn(const mac_address & mac, const interface & port)
+{
+}
+
+void XdpFastPath::forget(uint64_t key)
+{
+}
+
+void XdpFastPath::clear()
+{
+}
+
+void XdpFastPath::detach()
+{
+}
+
+void XdpFastPath::synchronize(SharedStorage & storage)
+{
+}
+
+void XdpFastPath::refresh(MacTable & macTable)
+{
+}
+
+void XdpFastPath::registerSocket(const interface & port, uint32_t queue, int fd)
+{
+}
+
+#endif
+
+uint32_t XdpFastPath::slot(const interface & port) const
+{
+    for (uint32_t i = 0; i < interfaces_m.size(); i++)
+    {
+        if (interfaces_m[i].id() == port.id())
+        {
+            return i;
+        }
+    }
+    return 0;
+}
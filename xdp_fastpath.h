@@ -0,0 +1,50 @@
+#pragma once
+
+#include "dataplane_config.h"
+#include "shared_storage.h"
+#include "xdp_fastpath_maps.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+struct bpf_object;
+
+// the in-kernel fast path, attached to every port of the switch
+// its MAC table mirrors SharedStorage::macTable, learning and aging stay in userspace
+struct XdpFastPath
+{
+public:
+    XdpFastPath(const vector<interface> & ports, const XdpConfig & config);
+    XdpFastPath(XdpFastPath &&) = delete;
+    XdpFastPath(const XdpFastPath &) = delete;
+    XdpFastPath & operator=(XdpFastPath &&) = delete;
+    XdpFastPath & operator=(const XdpFastPath &) = delete;
+    ~XdpFastPath();
+
+public:
+    void learn(const mac_address & mac, const interface & port);
+    void forget(uint64_t key); // see macKey()
+    void clear();
+    void detach(); // the maps stay usable, nothing is redirected anymore
+
+    // mirrors the interface state and adds the fast path counters to the statistics
+    void synchronize(SharedStorage & storage);
+    // refreshes the timeouts of hosts that only talked through the fast path, walks the whole table,
+    // so it is only needed right before the table is aged
+    void refresh(MacTable & macTable);
+
+    // AF_XDP sockets of the port get the frames the fast path doesn't handle
+    void registerSocket(const interface & port, uint32_t queue, int fd);
+
+private:
+    uint32_t slot(const interface & port) const;
+
+private:
+    bpf_object *object_m;
+    int macTable_m, ports_m, txPorts_m, counters_m, xsks_m;
+    vector<interface> interfaces_m;
+    XdpConfig config_m;
+    bool attached_m;
+    int cpus_m;
+    std::map<interface::id_type, fastpath_counters> lastCounters_m;
+};
@@ -0,0 +1,45 @@
+// Map layout shared by the BPF fast path and its userspace loader.
+#pragma once
+
+#include <linux/types.h>
+
+#define FASTPATH_MAX_MACS 65536
+#define FASTPATH_MAX_PORTS 64
+#define FASTPATH_MAX_QUEUES 64
+
+// in the same order as the Protocol enum of the statistics
+enum
+{
+    FASTPATH_ETHERNET,
+    FASTPATH_ARP,
+    FASTPATH_IP,
+    FASTPATH_TCP,
+    FASTPATH_UDP,
+    FASTPATH_ICMP,
+    FASTPATH_HTTP,
+    FASTPATH_IPV6,
+    FASTPATH_ICMPV6,
+    FASTPATH_PROTOCOLS
+};
+
+// keyed by the MAC address packed into the low 48 bits
+struct fastpath_mac
+{
+    __u32 ifindex;
+    __u32 reserved;
+    __u64 hits; // frames from this host that never reached userspace
+};
+
+// keyed by ifindex
+struct fastpath_port
+{
+    __u32 up;
+    __u32 slot; // the AF_XDP sockets of the port sit at slot * FASTPATH_MAX_QUEUES + queue
+};
+
+// per CPU, keyed by ifindex
+struct fastpath_counters
+{
+    __u64 input[FASTPATH_PROTOCOLS];
+    __u64 output[FASTPATH_PROTOCOLS];
+};
@@ -0,0 +1,434 @@
+#include "xdp_socket.h"
+#include "xdp_fastpath.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <qlogging.h>
+#include <stdexcept>
+
+#ifdef PSIP_HAVE_XDP
+
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <xdp/xsk.h>
+
+struct XdpUmem::Rings
+{
+    xsk_ring_prod fill;
+    xsk_ring_cons completion;
+};
+
+struct XdpSocket::Rings
+{
+    xsk_ring_cons rx;
+    xsk_ring_prod tx;
+    xsk_ring_prod fill;
+    xsk_ring_cons completion;
+};
+
+XdpUmem::XdpUmem(const XdpConfig & config)
+    : rings_m(new Rings{}),
+      umem_m(nullptr),
+      area_m(nullptr),
+      size_m(static_cast<size_t>(config.frameSize) * config.frameCount),
+      config_m(config),
+      lock_m{},
+      free_m{}
+{
+    void *area = mmap(nullptr, size_m, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+    {
+        throw std::runtime_error(string("Cannot allocate the UMEM: ") + std::strerror(errno));
+    }
+    area_m = static_cast<uint8_t *>(area);
+
+    xsk_umem_config umemConfig{};
+    umemConfig.fill_size = config_m.ringSize;
+    umemConfig.comp_size = config_m.ringSize;
+    umemConfig.frame_size = config_m.frameSize;
+    umemConfig.frame_headroom = 0;
+    int result = xsk_umem__create(&umem_m, area_m, size_m, &rings_m->fill, &rings_m->completion, &umemConfig);
+    if (result != 0)
+    {
+        munmap(area_m, size_m);
+        throw std::runtime_error(string("Cannot register the UMEM: ") + std::strerror(-result));
+    }
+
+    free_m.reserve(config_m.frameCount);
+    for (uint32_t i = 0; i < config_m.frameCount; i++)
+    {
+        free_m.push_back(static_cast<uint64_t>(i) * config_m.frameSize);
+    }
+}
+
+XdpUmem::~XdpUmem()
+{
+    xsk_umem__delete(umem_m);
+    munmap(area_m, size_m);
+}
+
+uint32_t XdpUmem::allocate(vector<uint64_t> & addresses, uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(lock_m);
+    count = std::min<uint32_t>(count, free_m.size());
+    addresses.insert(addresses.end(), free_m.end() - count, free_m.end());
+    free_m.resize(free_m.size() - count);
+    return count;
+}
+
+void XdpUmem::release(uint64_t address)
+{
+    std::lock_guard<std::mutex> lock(lock_m);
+    free_m.push_back(xsk_umem__extract_addr(address));
+}
+
+void XdpUmem::release(const vector<uint64_t> & addresses)
+{
+    std::lock_guard<std::mutex> lock(lock_m);
+    for (auto address : addresses)
+    {
+        free_m.push_back(xsk_umem__extract_addr(address));
+    }
+}
+
+uint8_t *XdpUmem::data(uint64_t address) const
+{
+    return static_cast<uint8_t *>(xsk_umem__get_data(area_m, address));
+}
+
+uint32_t XdpUmem::frameSize() const
+{
+    return config_m.frameSize;
+}
+
+xsk_umem *XdpUmem::handle() const
+{
+    return umem_m;
+}
+
+XdpSocket::XdpSocket(XdpUmem & umem, const string & interfaceName, uint32_t queue, const XdpConfig & config,
+                     bool fastPath)
+    : umem_m(umem),
+      rings_m(new Rings{}),
+      socket_m(nullptr),
+      config_m(config),
+      deficit_m(config.ringSize),
+      txLock_m{},
+      txPending_m(0),
+      scratch_m{}
+{
+    xsk_socket_config socketConfig{};
+    socketConfig.rx_size = config_m.ringSize;
+    socketConfig.tx_size = config_m.ringSize;
+    socketConfig.xdp_flags = config_m.skbMode ? XDP_FLAGS_SKB_MODE : 0;
+    socketConfig.bind_flags = XDP_USE_NEED_WAKEUP | (config_m.skbMode ? XDP_COPY : 0);
+    socketConfig.libxdp_flags = fastPath ? XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD : 0;
+
+    int result = xsk_socket__create_shared(&socket_m, interfaceName.c_str(), queue, umem_m.handle(), &rings_m->rx,
+                                           &rings_m->tx, &rings_m->fill, &rings_m->completion, &socketConfig);
+    if (result != 0)
+    {
+        throw std::runtime_error("Cannot bind an AF_XDP socket to " + interfaceName + " queue " +
+                                 std::to_string(queue) + ": " + std::strerror(-result));
+    }
+
+    refill();
+    qInfo("AF_XDP socket bound to %s queue %u (%s mode)", interfaceName.c_str(), queue,
+          config_m.skbMode ? "generic" : "native");
+}
+
+XdpSocket::~XdpSocket()
+{
+    xsk_socket__delete(socket_m);
+}
+
+bool XdpSocket::wait(milliseconds timeout, int wakeup)
+{
+    pollfd descriptors[2]{};
+    descriptors[0].fd = xsk_socket__fd(socket_m);
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = wakeup;
+    descriptors[1].events = POLLIN;
+    return poll(descriptors, 2, timeout.count()) > 0 && (descriptors[0].revents & POLLIN) != 0;
+}
+
+uint32_t XdpSocket::receive(vector<XdpFrame> & frames, uint32_t limit)
+{
+    uint32_t index = 0;
+    uint32_t count = xsk_ring_cons__peek(&rings_m->rx, limit, &index);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto *descriptor = xsk_ring_cons__rx_desc(&rings_m->rx, index + i);
+        frames.push_back({descriptor->addr, umem_m.data(descriptor->addr), descriptor->len, false});
+    }
+    xsk_ring_cons__release(&rings_m->rx, count);
+    deficit_m += count;
+    return count;
+}
+
+void XdpSocket::refill()
+{
+    if (deficit_m == 0)
+    {
+        return;
+    }
+
+    scratch_m.clear();
+    uint32_t count = umem_m.allocate(scratch_m, deficit_m);
+    uint32_t index = 0;
+    if (count == 0 || xsk_ring_prod__reserve(&rings_m->fill, count, &index) != count)
+    {
+        umem_m.release(scratch_m);
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        *xsk_ring_prod__fill_addr(&rings_m->fill, index + i) = scratch_m[i];
+    }
+    xsk_ring_prod__submit(&rings_m->fill, count);
+    deficit_m -= count;
+
+    if (xsk_ring_prod__needs_wakeup(&rings_m->fill))
+    {
+        recvfrom(xsk_socket__fd(socket_m), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+}
+
+bool XdpSocket::transmit(uint64_t address, uint32_t size)
+{
+    std::lock_guard<std::mutex> lock(txLock_m);
+    uint32_t index = 0;
+    if (xsk_ring_prod__reserve(&rings_m->tx, 1, &index) != 1)
+    {
+        reclaim();
+        if (xsk_ring_prod__reserve(&rings_m->tx, 1, &index) != 1)
+        {
+            return false;
+        }
+    }
+
+    auto *descriptor = xsk_ring_prod__tx_desc(&rings_m->tx, index);
+    descriptor->addr = address;
+    descriptor->len = size;
+    descriptor->options = 0;
+    xsk_ring_prod__submit(&rings_m->tx, 1);
+    txPending_m++;
+    return true;
+}
+
+bool XdpSocket::transmitCopy(const uint8_t *data, uint32_t size)
+{
+    if (size > umem_m.frameSize())
+    {
+        qDebug("Frame of %u bytes does not fit into a UMEM frame", size);
+        return false;
+    }
+
+    vector<uint64_t> address;
+    if (umem_m.allocate(address, 1) != 1)
+    {
+        return false;
+    }
+    std::memcpy(umem_m.data(address[0]), data, size);
+    if (!transmit(address[0], size))
+    {
+        umem_m.release(address[0]);
+        return false;
+    }
+    return true;
+}
+
+void XdpSocket::kick()
+{
+    std::lock_guard<std::mutex> lock(txLock_m);
+    if (txPending_m > 0 && (config_m.skbMode || xsk_ring_prod__needs_wakeup(&rings_m->tx)))
+    {
+        sendto(xsk_socket__fd(socket_m), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    }
+    txPending_m = 0;
+    reclaim();
+}
+
+int XdpSocket::fd() const
+{
+    return xsk_socket__fd(socket_m);
+}
+
+// expects txLock_m to be held
+void XdpSocket::reclaim()
+{
+    uint32_t index = 0;
+    uint32_t count = xsk_ring_cons__peek(&rings_m->completion, config_m.ringSize, &index);
+    if (count == 0)
+    {
+        return;
+    }
+
+    vector<uint64_t> addresses;
+    addresses.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        addresses.push_back(*xsk_ring_cons__comp_addr(&rings_m->completion, index + i));
+    }
+    xsk_ring_cons__release(&rings_m->completion, count);
+    umem_m.release(addresses);
+}
+
+#else
+
+// built without libxdp, every attempt to use AF_XDP ends in the constructor of the UMEM
+
+struct XdpUmem::Rings
+{
+};
+
+struct XdpSocket::Rings
+{
+};
+
+XdpUmem::XdpUmem(const XdpConfig & config)
+    : umem_m(nullptr),
+      area_m(nullptr),
+      size_m(0),
+      config_m(config)
+{
+    throw std::runtime_error("psip_switch was built without AF_XDP support");
+}
+
+XdpUmem::~XdpUmem()
+{
+}
+
+uint32_t XdpUmem::allocate(vector<uint64_t> & addresses, uint32_t count)
+{
+    return 0;
+}
+
+void XdpUmem::release(uint64_t address)
+{
+}
+
+void XdpUmem::release(const vector<uint64_t> & addresses)
+{
+}
+
+uint8_t *XdpUmem::data(uint64_t address) const
+{
+    return nullptr;
+}
+
+uint32_t XdpUmem::frameSize() const
+{
+    return config_m.frameSize;
+}
+
+xsk_umem *XdpUmem::handle() const
+{
+    return umem_m;
+}
+
+XdpSocket::XdpSocket(XdpUmem & umem, const string & interfaceName, uint32_t queue, const XdpConfig & config,
+                     bool fastPath)
+    : umem_m(umem),
+      socket_m(nullptr),
+      config_m(config),
+      deficit_m(0),
+      txPending_m(0)
+{
+    throw std::runtime_error("psip_switch was built without AF_XDP support");
+}
+
+XdpSocket::~XdpSocket()
+{
+}
+
+bool XdpSocket::wait(milliseconds timeout, int wakeup)
+{
+    return false;
+}
+
+uint32_t XdpSocket::receive(vector<XdpFrame> & frames, uint32_t limit)
+{
+    return 0;
+}
+
+void XdpSocket::refill()
+{
+}
+
+bool XdpSocket::transmit(uint64_t address, uint32_t size)
+{
+    return false;
+}
+
+bool XdpSocket::transmitCopy(const uint8_t *data, uint32_t size)
+{
+    return false;
+}
+
+void XdpSocket::kick()
+{
+}
+
+int XdpSocket::fd() const
+{
+    return -1;
+}
+
+void XdpSocket::reclaim()
+{
+}
+
+#endif
+
+XdpFabric::XdpFabric(const XdpConfig & config, XdpFastPath *fastPath)
+    : config_m(config),
+      umem_m(config),
+      fastPath_m(fastPath),
+      ports_m{}
+{
+}
+
+// the sockets fill their rings from the one UMEM, the ones that come after it ran out would never receive
+void XdpFabric::addPort(const interface & port, uint32_t queues)
+{
+    size_t total = queues;
+    for (const auto & entry : ports_m)
+    {
+        total += entry.second.size();
+    }
+    if (total * config_m.ringSize > config_m.frameCount)
+    {
+        throw std::runtime_error("The UMEM of " + std::to_string(config_m.frameCount) +
+                                 " frames cannot fill the rings of " + std::to_string(total) + " AF_XDP sockets");
+    }
+
+    auto & sockets = ports_m[port.id()];
+    for (uint32_t queue = 0; queue < queues; queue++)
+    {
+        sockets.emplace_back(new XdpSocket(umem_m, port.name(), queue, config_m, fastPath_m != nullptr));
+        if (fastPath_m != nullptr)
+        {
+            fastPath_m->registerSocket(port, queue, sockets.back()->fd());
+        }
+    }
+}
+
+XdpSocket *XdpFabric::socket(const interface & port, uint32_t queue) const
+{
+    auto it = ports_m.find(port.id());
+    if (it == ports_m.end() || it->second.empty())
+    {
+        return nullptr;
+    }
+    return it->second[queue % it->second.size()].get();
+}
+
+XdpUmem & XdpFabric::umem()
+{
+    return umem_m;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "dataplane_config.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tins/network_interface.h>
+#include <vector>
+
+using interface = Tins::NetworkInterface;
+using std::string, std::vector, std::map, std::unique_ptr;
+
+struct xsk_umem;
+struct xsk_socket;
+struct XdpFastPath;
+
+// a received frame inside the UMEM
+// the worker owns it until it is either moved to a TX ring or released
+struct XdpFrame
+{
+    uint64_t address;
+    const uint8_t *data;
+    uint32_t size;
+    bool consumed; // moved to a TX ring, must not be released by the worker
+};
+
+// the packet buffer shared by all the AF_XDP sockets of the switch,
+// so that frames can move between ports without being copied
+struct XdpUmem
+{
+public:
+    XdpUmem(const XdpConfig & config);
+    XdpUmem(XdpUmem &&) = delete;
+    XdpUmem(const XdpUmem &) = delete;
+    XdpUmem & operator=(XdpUmem &&) = delete;
+    XdpUmem & operator=(const XdpUmem &) = delete;
+    ~XdpUmem();
+
+public:
+    uint32_t allocate(vector<uint64_t> & addresses, uint32_t count); // returns how many frames were taken
+    void release(uint64_t address);
+    void release(const vector<uint64_t> & addresses);
+    uint8_t *data(uint64_t address) const;
+    uint32_t frameSize() const;
+    xsk_umem *handle() const;
+
+private:
+    struct Rings;
+
+    unique_ptr<Rings> rings_m; // handed over to the first socket that binds
+    xsk_umem *umem_m;
+    uint8_t *area_m;
+    size_t size_m;
+    XdpConfig config_m;
+    std::mutex lock_m;
+    vector<uint64_t> free_m;
+};
+
+// an AF_XDP socket bound to one queue of one interface
+// the RX side belongs to a single worker, the TX side can be fed by any worker
+struct XdpSocket
+{
+public:
+    // with a fast path the socket doesn't load the default XDP program, the fast path redirects to it
+    XdpSocket(XdpUmem & umem, const string & interfaceName, uint32_t queue, const XdpConfig & config,
+              bool fastPath = false);
+    XdpSocket(XdpSocket &&) = delete;
+    XdpSocket(const XdpSocket &) = delete;
+    XdpSocket & operator=(XdpSocket &&) = delete;
+    XdpSocket & operator=(const XdpSocket &) = delete;
+    ~XdpSocket();
+
+public:
+    bool wait(milliseconds timeout, int wakeup = -1); // returns early once wakeup becomes readable
+    uint32_t receive(vector<XdpFrame> & frames, uint32_t limit);
+    void refill(); // gives the received frames' worth of buffers back to the fill ring
+
+    bool transmit(uint64_t address, uint32_t size);          // moves a UMEM frame to the TX ring
+    bool transmitCopy(const uint8_t *data, uint32_t size);   // copies into a fresh UMEM frame first
+    void kick();                                             // starts the transmission, reclaims sent frames
+    int fd() const;
+
+private:
+    void reclaim();
+
+private:
+    struct Rings;
+
+    XdpUmem & umem_m;
+    unique_ptr<Rings> rings_m;
+    xsk_socket *socket_m;
+    XdpConfig config_m;
+    uint32_t deficit_m; // frames missing from the fill ring
+    std::mutex txLock_m;
+    uint32_t txPending_m;
+    vector<uint64_t> scratch_m;
+};
+
+// all the AF_XDP sockets of the switch, set up before any worker starts
+struct XdpFabric
+{
+public:
+    XdpFabric(const XdpConfig & config, XdpFastPath *fastPath = nullptr);
+    XdpFabric(XdpFabric &&) = delete;
+    XdpFabric(const XdpFabric &) = delete;
+    XdpFabric & operator=(XdpFabric &&) = delete;
+    XdpFabric & operator=(const XdpFabric &) = delete;
+
+public:
+    void addPort(const interface & port, uint32_t queues);
+    XdpSocket *socket(const interface & port, uint32_t queue) const; // nullptr if the port doesn't use AF_XDP
+    XdpUmem & umem();
+
+private:
+    XdpConfig config_m;
+    XdpUmem umem_m;
+    XdpFastPath *fastPath_m;
+    map<interface::id_type, vector<unique_ptr<XdpSocket>>> ports_m;
+};